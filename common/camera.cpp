@@ -1,7 +1,10 @@
+#include <GL/glew.h>
 #include <glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include "camera.h"
 #include "../ergasia/sourcefiles/Snail.h"
+#include "../ergasia/sourcefiles/heightmap.h"
+#include <algorithm>
 
 using namespace glm;
 
@@ -15,7 +18,7 @@ Camera::Camera(GLFWwindow* window) : window(window) {
     fovSpeed = 2.0f;
 }
 
-void Camera::update(Snail* snail) {
+void Camera::update(Snail* snail, Heightmap* terrain) {
     static double lastTime = glfwGetTime();
     double currentTime = glfwGetTime();
     float deltaTime = float(currentTime - lastTime);
@@ -32,20 +35,27 @@ void Camera::update(Snail* snail) {
     if (verticalAngle > 1.5f) verticalAngle = 1.5f;
     if (verticalAngle < -1.5f) verticalAngle = -1.5f;
 
-    float camDist = 23.1214f * snail->radius;
+    float camDist = 23.1214f * snail->shown.radius;
 
     vec3 offset;
     offset.x = camDist * cos(verticalAngle) * sin(horizontalAngle);
     offset.y = camDist * sin(verticalAngle);
     offset.z = camDist * cos(verticalAngle) * cos(horizontalAngle);
 
-    position = snail->x + offset;
+    position = snail->renderPosition + offset;
 
-    vec3 lookTarget = snail->x;
+    vec3 lookTarget = snail->renderPosition;
+
+    // spring arm: stop short of the first terrain hit between target and camera
+    Heightmap::RayHit hit;
+    if (terrain && terrain->intersectSegment(lookTarget, position, hit)) {
+        float t = std::max(hit.t - snail->shown.radius / camDist, 0.05f);
+        position = lookTarget + offset * t;
+    }
 
     vec3 up = vec3(0, 1, 0);
 
-    projectionMatrix = perspective(radians(FoV), (float)width / (float)height, 0.1f, 200.41f * 2 *snail->radius);
+    projectionMatrix = perspective(radians(FoV), (float)width / (float)height, 0.1f, 200.41f * 2 *snail->shown.radius);
     viewMatrix = lookAt(position, lookTarget, up);
 
     lastTime = currentTime;
@@ -4,6 +4,7 @@
 #include <glm/glm.hpp>
 
 class Snail;
+class Heightmap;
 
 class Camera {
 public:
@@ -23,7 +24,8 @@ public:
     float fovSpeed;
 
     Camera(GLFWwindow* window);
-    void update(Snail* snail);
+    // with a terrain the camera is pulled in front of hills between it and the snail
+    void update(Snail* snail, Heightmap* terrain = nullptr);
 };
 
 #endif
@@ -348,7 +348,7 @@ Drawable::~Drawable() {
     glDeleteBuffers(1, &uvsVBO);
     glDeleteBuffers(1, &normalsVBO);
     glDeleteBuffers(1, &elementVBO);
-    glDeleteBuffers(1, &VAO);
+    glDeleteVertexArrays(1, &VAO);
 }
 
 void Drawable::bind() {
@@ -360,7 +360,10 @@ void Drawable::draw(int mode) {
 }
 
 void Drawable::createContext() {
+    VAO = verticesVBO = uvsVBO = normalsVBO = elementVBO = 0;
     indices = vector<unsigned int>();
+    // nothing to upload, e.g. a Heightmap drawn by the HeightfieldRenderer
+    if (vertices.empty()) return;
     indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
 
     glGenVertexArrays(1, &VAO);
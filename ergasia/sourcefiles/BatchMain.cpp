@@ -0,0 +1,238 @@
+// supersnail_batch: many independent headless runs in one process, for
+// sweeping tuning parameters. Every combination of the swept values is run
+// on every seed; runs on the same seed share one read-only layout, and each
+// run is one job on a pool with a thread per core. One CSV row per run.
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include "SimulationWorld.h"
+#include "InputRecording.h"
+#include "InputScript.h"
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace glm;
+
+/** What a sweep can vary, the defaults are the game's */
+struct RunParameters {
+    float muK, muS;
+    float staminaDepletionRate;
+    float eagleSpeed, eagleDiveSpeed, eagleSightRange;
+};
+
+static const RunParameters DEFAULTS = { 2.0f, 5.0f, 20.0f, 15.0f, 40.0f, 100.0f };
+
+static const struct { const char* name; float RunParameters::*field; } PARAMETERS[] = {
+    { "muK", &RunParameters::muK },
+    { "muS", &RunParameters::muS },
+    { "staminaDepletionRate", &RunParameters::staminaDepletionRate },
+    { "eagleSpeed", &RunParameters::eagleSpeed },
+    { "eagleDiveSpeed", &RunParameters::eagleDiveSpeed },
+    { "eagleSightRange", &RunParameters::eagleSightRange },
+};
+
+struct Sweep {
+    float RunParameters::*field;
+    vector<float> values;
+};
+
+struct RunResult {
+    unsigned int seed;
+    RunParameters parameters;
+    int steps;
+    float distance, maxSpeed, minStamina;
+    float sprintSeconds, grabbedSeconds;
+    int grabs, eaten, dents;
+    vec3 finalPosition;
+    double wallMs;
+};
+
+// name=from:to:count, count evenly spaced values including both ends
+static Sweep parseSweep(const string& spec) {
+    size_t eq = spec.find('=');
+    if (eq == string::npos) throw runtime_error("Sweep needs name=from:to:count: " + spec);
+    string name = spec.substr(0, eq);
+    Sweep sweep;
+    sweep.field = nullptr;
+    for (const auto& p : PARAMETERS) {
+        if (name == p.name) sweep.field = p.field;
+    }
+    if (!sweep.field) throw runtime_error("Unknown sweep parameter: " + name);
+
+    float from, to;
+    int count = 1;
+    string range = spec.substr(eq + 1);
+    size_t a = range.find(':'), b = a == string::npos ? string::npos : range.find(':', a + 1);
+    if (a == string::npos) {
+        from = to = stof(range);
+    }
+    else {
+        from = stof(range.substr(0, a));
+        to = stof(range.substr(a + 1, b == string::npos ? string::npos : b - a - 1));
+        count = b == string::npos ? 2 : stoi(range.substr(b + 1));
+    }
+    if (count < 1) throw runtime_error("Sweep needs at least one value: " + spec);
+    for (int i = 0; i < count; i++) {
+        sweep.values.push_back(count == 1 ? from : from + (to - from) * i / (count - 1));
+    }
+    return sweep;
+}
+
+static RunResult run(WorldLayout* layout, const RunParameters& parameters, const vector<InputState>* inputs,
+                     int steps, float physicsStep) {
+    auto start = chrono::steady_clock::now();
+    SimulationWorld world(layout);
+    world.simulation.muK = parameters.muK;
+    world.simulation.muS = parameters.muS;
+    world.snail.staminaDepletionRate = parameters.staminaDepletionRate;
+    world.eagle.speed = parameters.eagleSpeed;
+    world.eagle.diveSpeed = parameters.eagleDiveSpeed;
+    world.eagle.sightRange = parameters.eagleSightRange;
+
+    RunResult r;
+    r.seed = layout->seed;
+    r.parameters = parameters;
+    r.distance = r.maxSpeed = r.sprintSeconds = r.grabbedSeconds = 0.0f;
+    r.minStamina = world.snail.stamina;
+    r.grabs = 0;
+    bool grabbed = false;
+    const SnailBody& snail = world.snail;
+    for (int i = 0; i < steps; i++) {
+        InputState input = inputs ? (*inputs)[i % inputs->size()] : scriptedInput(i * physicsStep);
+        world.simulation.step(physicsStep, input);
+
+        r.distance += length(snail.x - snail.previousX);
+        r.maxSpeed = std::max(r.maxSpeed, length(snail.v));
+        r.minStamina = std::min(r.minStamina, snail.stamina);
+        if (snail.isSprinting) r.sprintSeconds += physicsStep;
+        bool held = world.eagle.state == GRABBING;
+        if (held) r.grabbedSeconds += physicsStep;
+        if (held && !grabbed) r.grabs++;
+        grabbed = held;
+    }
+    r.steps = steps;
+    r.eaten = world.eaten;
+    r.dents = world.dents;
+    r.finalPosition = snail.x;
+    r.wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return r;
+}
+
+int main(int argc, char* argv[]) {
+    float seconds = 60.0f;
+    float physicsStep = 1.0f / 120.0f;
+    unsigned int firstSeed = 1;
+    int seedCount = 1, treeCount = 700, flowerCount = 100, threads = 0;
+    string csvPath, inputPath;
+    vector<Sweep> sweeps;
+    try {
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--seconds" && i + 1 < argc) seconds = stof(argv[++i]);
+            else if (arg == "--physics-hz" && i + 1 < argc) physicsStep = 1.0f / stof(argv[++i]);
+            else if (arg == "--seed" && i + 1 < argc) firstSeed = (unsigned int)stoul(argv[++i]);
+            else if (arg == "--seeds" && i + 1 < argc) seedCount = stoi(argv[++i]);
+            else if (arg == "--trees" && i + 1 < argc) treeCount = stoi(argv[++i]);
+            else if (arg == "--flowers" && i + 1 < argc) flowerCount = stoi(argv[++i]);
+            else if (arg == "--threads" && i + 1 < argc) threads = stoi(argv[++i]);
+            else if (arg == "--sweep" && i + 1 < argc) sweeps.push_back(parseSweep(argv[++i]));
+            else if (arg == "--input" && i + 1 < argc) inputPath = argv[++i];
+            else if (arg == "--csv" && i + 1 < argc) csvPath = argv[++i];
+            else {
+                cout << "usage: supersnail_batch [--seconds S] [--physics-hz HZ] [--seed N] [--seeds N] [--trees N]"
+                        " [--flowers N] [--threads N] [--sweep name=from:to:count]... [--input RECORDING]"
+                        " [--csv FILE]" << endl;
+                cout << "sweepable:";
+                for (const auto& p : PARAMETERS) cout << " " << p.name;
+                cout << endl;
+                return 1;
+            }
+        }
+
+        // a recording drives every run with the same controls, looped
+        vector<InputState> recorded;
+        if (!inputPath.empty()) {
+            InputRecording recording(inputPath);
+            recording.check(InputRecording::GENERATED_TERRAIN);
+            InputState input;
+            bool hashed;
+            uint64_t hash;
+            while (recording.next(input, hashed, hash)) recorded.push_back(input);
+            if (recorded.empty()) throw runtime_error("Input recording has no steps: " + inputPath);
+        }
+        const vector<InputState>* inputs = recorded.empty() ? nullptr : &recorded;
+
+        auto setupStart = chrono::steady_clock::now();
+        vector<WorldLayout*> layouts;
+        for (int s = 0; s < seedCount; s++) layouts.push_back(new WorldLayout(firstSeed + s, treeCount, flowerCount));
+        double setupMs = chrono::duration<double, milli>(chrono::steady_clock::now() - setupStart).count();
+
+        // cartesian product of the sweeps
+        vector<RunParameters> points(1, DEFAULTS);
+        for (const Sweep& sweep : sweeps) {
+            vector<RunParameters> expanded;
+            for (const RunParameters& p : points) {
+                for (float value : sweep.values) {
+                    RunParameters q = p;
+                    q.*sweep.field = value;
+                    expanded.push_back(q);
+                }
+            }
+            points.swap(expanded);
+        }
+
+        int steps = (int)ceil(seconds / physicsStep);
+        vector<RunResult> results(layouts.size() * points.size());
+        auto runStart = chrono::steady_clock::now();
+        {
+            ThreadPool pool(threads);
+            for (size_t l = 0; l < layouts.size(); l++) {
+                for (size_t p = 0; p < points.size(); p++) {
+                    RunResult* out = &results[l * points.size() + p];
+                    WorldLayout* layout = layouts[l];
+                    const RunParameters parameters = points[p];
+                    pool.submit([=] { *out = run(layout, parameters, inputs, steps, physicsStep); });
+                }
+            }
+            pool.wait();
+            threads = pool.size();
+        }
+        double runMs = chrono::duration<double, milli>(chrono::steady_clock::now() - runStart).count();
+
+        ofstream file;
+        if (!csvPath.empty()) {
+            file.open(csvPath.c_str());
+            if (!file) throw runtime_error("Could not open CSV for writing: " + csvPath);
+        }
+        ostream& csv = csvPath.empty() ? cout : file;
+        csv << "seed";
+        for (const auto& p : PARAMETERS) csv << "," << p.name;
+        csv << ",steps,distance,maxSpeed,minStamina,sprintSeconds,grabs,grabbedSeconds,eaten,dents,finalX,finalY,finalZ,wallMs\n";
+        csv << setprecision(6);
+        for (const RunResult& r : results) {
+            csv << r.seed;
+            for (const auto& p : PARAMETERS) csv << "," << r.parameters.*p.field;
+            csv << "," << r.steps << "," << r.distance << "," << r.maxSpeed << "," << r.minStamina
+                << "," << r.sprintSeconds << "," << r.grabs << "," << r.grabbedSeconds << "," << r.eaten
+                << "," << r.dents << "," << r.finalPosition.x << "," << r.finalPosition.y << "," << r.finalPosition.z
+                << "," << r.wallMs << "\n";
+        }
+
+        double totalSteps = (double)results.size() * steps;
+        cerr << fixed << setprecision(2);
+        cerr << layouts.size() << " layouts in " << setupMs << " ms, " << results.size() << " runs of " << steps
+             << " steps on " << threads << " threads in " << runMs << " ms, "
+             << (runMs > 0.0 ? totalSteps / runMs * 1000.0 : 0.0) << " steps/s" << endl;
+        for (WorldLayout* layout : layouts) delete layout;
+    }
+    catch (exception& ex) {
+        cout << ex.what() << endl;
+        return 1;
+    }
+    return 0;
+}
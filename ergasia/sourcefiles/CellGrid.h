@@ -0,0 +1,87 @@
+#ifndef CELL_GRID_H
+#define CELL_GRID_H
+
+#include <vector>
+#include <algorithm>
+
+/**
+ * Static items bucketed by square x/z cell, cell (x, z) covering
+ * [x, x + 1) * cellSize by [z, z + 1) * cellSize. The grid is dense over the
+ * cells that hold anything and stored as two flat arrays, built by a
+ * counting sort: where each cell starts, and the items packed cell by cell.
+ * Cells are ordered x-major, so the cells (x, z0..z1) of one column are
+ * one contiguous range of items and a 3x3 neighbourhood is three of them.
+ */
+template <class T>
+class CellGrid {
+public:
+    /** A contiguous run of items */
+    struct Range {
+        const T* first;
+        const T* last;
+        const T* begin() const { return first; }
+        const T* end() const { return last; }
+        bool empty() const { return first == last; }
+    };
+
+    CellGrid() : minX(0), minZ(0), columns(0), rows(0), cellStart(1, 0) {}
+
+    /** Buckets values[i] into cell (cellX[i], cellZ[i]), keeping their order within a cell */
+    void build(const std::vector<int>& cellX, const std::vector<int>& cellZ, const std::vector<T>& values) {
+        clear();
+        if (values.empty()) return;
+        int maxX = minX = cellX[0], maxZ = minZ = cellZ[0];
+        for (size_t i = 1; i < values.size(); i++) {
+            minX = std::min(minX, cellX[i]); maxX = std::max(maxX, cellX[i]);
+            minZ = std::min(minZ, cellZ[i]); maxZ = std::max(maxZ, cellZ[i]);
+        }
+        columns = maxX - minX + 1;
+        rows = maxZ - minZ + 1;
+        cellStart.assign((size_t)columns * rows + 1, 0);
+        for (size_t i = 0; i < values.size(); i++) cellStart[index(cellX[i], cellZ[i]) + 1]++;
+        for (size_t c = 1; c < cellStart.size(); c++) cellStart[c] += cellStart[c - 1];
+        std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+        items.resize(values.size());
+        for (size_t i = 0; i < values.size(); i++) items[fill[index(cellX[i], cellZ[i])]++] = values[i];
+    }
+
+    void clear() {
+        minX = minZ = columns = rows = 0;
+        cellStart.assign(1, 0);
+        items.clear();
+    }
+
+    /** Items of cells (x, z0..z1), cells outside the grid hold nothing */
+    Range column(int x, int z0, int z1) const {
+        x -= minX;
+        z0 = std::max(z0 - minZ, 0);
+        z1 = std::min(z1 - minZ, rows - 1);
+        if (x < 0 || x >= columns || z0 > z1) return Range{ nullptr, nullptr };
+        const T* base = items.data();
+        return Range{ base + cellStart[x * rows + z0], base + cellStart[x * rows + z1 + 1] };
+    }
+    Range cell(int x, int z) const { return column(x, z, z); }
+
+    /** Calls visit(x, z, items) for every cell that holds anything */
+    template <class Visit>
+    void forEachCell(Visit visit) const {
+        for (int x = 0; x < columns; x++) {
+            for (int z = 0; z < rows; z++) {
+                Range r = { items.data() + cellStart[x * rows + z], items.data() + cellStart[x * rows + z + 1] };
+                if (!r.empty()) visit(minX + x, minZ + z, r);
+            }
+        }
+    }
+
+    size_t size() const { return items.size(); }
+
+private:
+    int minX, minZ, columns, rows;
+    /** items of cell c are [cellStart[c], cellStart[c + 1]) */
+    std::vector<int> cellStart;
+    std::vector<T> items;
+
+    int index(int x, int z) const { return (x - minX) * rows + (z - minZ); }
+};
+
+#endif
@@ -1,14 +1,28 @@
 #include "Collision.h"
-#include "heightmap.h"
-#include "snail.h"
+#include "HeightGrid.h"
+#include "SnailBody.h"
+#include "FlowerField.h"
+#include <cstdlib>
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <cmath> 
 
+using namespace std;
 using namespace glm;
 
 const float g = 9.80665f;
 
+TreeGrid treeGrid;
+FlowerGrid flowerGrid;
+float cellSize = 10.0f;
+
+// trees collide as vertical cylinders this much wider than the trunk
+static const float TREE_RADIUS = 0.5f;
+static const float TREE_CLEARANCE = 1.0f;
+static const float TREE_HEIGHT = 20.0f;
+
 bool checkForBoxSnailCollision(vec3& pos, const float& r, const float& size, vec3& n) {
     bool collided = false;
     vec3 totalNormal(0.0f);
@@ -43,7 +57,7 @@ bool checkForBoxSnailCollision(vec3& pos, const float& r, const float& size, vec
     return false;
 }
 
-void handleBoxSnailCollision(Heightmap* heightmap, Snail* snail) {
+void handleBoxSnailCollision(HeightGrid* heightmap, SnailBody* snail) {
     vec3 n;
     if (checkForBoxSnailCollision(snail->x, snail->radius, heightmap->scalar / 2, n)) {
         snail->v = snail->v - 2.0f * dot(snail->v, n) * n;
@@ -51,10 +65,10 @@ void handleBoxSnailCollision(Heightmap* heightmap, Snail* snail) {
     }
 }
 
-bool handleSnailTerrainCollision(Snail* snail, Heightmap* terrain, bool onTree) {
-    if (!snail || !terrain) return false; 
+bool handleSnailTerrainCollision(SnailBody* snail, const GroundSample& ground, bool onTree) {
+    if (!snail) return false; 
 
-    float groundHeight = terrain->getHeightAt(snail->x.x, snail->x.z);
+    float groundHeight = ground.height;
     float radius = snail->radius;
     float snailBottom = snail->x.y - radius;
     vec3 targetUp;
@@ -71,7 +85,7 @@ bool handleSnailTerrainCollision(Snail* snail, Heightmap* terrain, bool onTree)
             return true;
         }
 
-        targetUp = terrain->getNormalAt(snail->x.x, snail->x.z);
+        targetUp = ground.normal;
         snail->x.y = (groundHeight + radius + 0.04f);
         targetForward = snail->q * vec3(0, 0, -1);
 
@@ -100,84 +114,211 @@ bool handleSnailTerrainCollision(Snail* snail, Heightmap* terrain, bool onTree)
     return false;
 }
 
-bool handleSnailTreeCollision(Snail* snail, const std::vector<mat4>& instanceMatrices) {
-    float treeRadius = 0.5f;
-    float combinedRadius = snail->radius + treeRadius + 1.0f;
+bool handleSnailTreeCollision(SnailBody* snail, const std::vector<mat4>& instanceMatrices, const TreeGrid& grid,
+                              int* contactTree) {
+    float combinedRadius = snail->radius + TREE_RADIUS + TREE_CLEARANCE;
     float detectionDist = combinedRadius + 0.1f;
-    float treeHeight = 20.0f;
 
-    int snailGridX = static_cast<int>(floor(snail->x.x / cellSize));
-    int snailGridZ = static_cast<int>(floor(snail->x.z / cellSize));
+    int snailGridX = gridCell(snail->x.x);
+    int snailGridZ = gridCell(snail->x.z);
 
     for (int x = -1; x <= 1; x++) {
-        for (int z = -1; z <= 1; z++) {
-            GridKey key = { snailGridX + x, snailGridZ + z };
-
-            if (treeGrid.find(key) != treeGrid.end()) {
-                const std::vector<int>& indices = treeGrid[key];
-
-                for (int index : indices) {
-
-                    if (index >= instanceMatrices.size()) continue;
-
-                    const auto& modelMatrix = instanceMatrices[index];
-                    vec3 treePos = vec3(modelMatrix[3]);
-                    float treeTopY = treePos.y + treeHeight;
-
-                    float dx = snail->x.x - treePos.x;
-                    float dz = snail->x.z - treePos.z;
-                    float distSq = dx * dx + dz * dz;
-
-                    if (abs(snail->x.y - (treeTopY + snail->radius)) < 0.5f && distSq < detectionDist * detectionDist) {
-                        snail->x.y = treeTopY - 0.1;
-                        vec3 surfaceNormal = vec3(0, 1, 0);
-                        return true;
-                    }
-
-                    if (snail->x.y < (treeTopY + snail->radius) && distSq < detectionDist * detectionDist) {
-
-                        float distance = sqrt(distSq);
-                        float normalX = dx / distance;
-                        float normalZ = dz / distance;
-
-                        snail->x.x = treePos.x + (normalX * combinedRadius);
-                        snail->x.z = treePos.z + (normalZ * combinedRadius);
-                        vec3 treeNormal = vec3(normalX, 0.0f, normalZ);
-
-                        float heightFromBase = snail->x.y - treePos.y;
-                        vec3 forward = snail->q * vec3(0, 0, 1);
-                        if (!snail->isRetracted && forward.y < -0.2f && heightFromBase < 2.5f) {
-                            return false;
-                        }
-
-                        if (snail->isRetracted) {
-                            if (dot(snail->v, treeNormal) < 0.0f) {
-                                snail->v = reflect(snail->v, treeNormal) * 1.0f;
-                                snail->P = snail->v * snail->m;
-                            }
-                        }
-                        else {
-                            vec3 targetUp = treeNormal;
-                            vec3 currentForward = snail->q * vec3(0, 0, -1);
-
-                            vec3 newY = targetUp;
-                            vec3 newX = normalize(cross(currentForward, newY));
-                            if (length(newX) < 0.001f) newX = normalize(cross(vec3(0, 1, 0), newY));
-                            vec3 newZ = normalize(cross(newX, newY));
-
-                            mat3 targetRotMat;
-                            targetRotMat[0] = newX;
-                            targetRotMat[1] = newY;
-                            targetRotMat[2] = newZ;
-
-                            quat targetQ = quat_cast(targetRotMat);
-                            snail->q = normalize(slerp(snail->q, targetQ, 0.2f));
-                        }
-                        return true;
-                    }
+        for (int index : grid.column(snailGridX + x, snailGridZ - 1, snailGridZ + 1)) {
+
+            if (index >= instanceMatrices.size()) continue;
+
+            const auto& modelMatrix = instanceMatrices[index];
+            vec3 treePos = vec3(modelMatrix[3]);
+            float treeTopY = treePos.y + TREE_HEIGHT;
+
+            float dx = snail->x.x - treePos.x;
+            float dz = snail->x.z - treePos.z;
+            float distSq = dx * dx + dz * dz;
+
+            if (abs(snail->x.y - (treeTopY + snail->radius)) < 0.5f && distSq < detectionDist * detectionDist) {
+                snail->x.y = treeTopY - 0.1;
+                vec3 surfaceNormal = vec3(0, 1, 0);
+                return true;
+            }
+
+            if (snail->x.y < (treeTopY + snail->radius) && distSq < detectionDist * detectionDist) {
+
+                float distance = sqrt(distSq);
+                float normalX = dx / distance;
+                float normalZ = dz / distance;
+
+                snail->x.x = treePos.x + (normalX * combinedRadius);
+                snail->x.z = treePos.z + (normalZ * combinedRadius);
+                vec3 treeNormal = vec3(normalX, 0.0f, normalZ);
+
+                float heightFromBase = snail->x.y - treePos.y;
+                vec3 forward = snail->q * vec3(0, 0, 1);
+                if (!snail->isRetracted && forward.y < -0.2f && heightFromBase < 2.5f) {
+                    return false;
+                }
+
+                if (snail->isRetracted) {
+                    if (contactTree) *contactTree = index;
                 }
+                else {
+                    vec3 targetUp = treeNormal;
+                    vec3 currentForward = snail->q * vec3(0, 0, -1);
+
+                    vec3 newY = targetUp;
+                    vec3 newX = normalize(cross(currentForward, newY));
+                    if (length(newX) < 0.001f) newX = normalize(cross(vec3(0, 1, 0), newY));
+                    vec3 newZ = normalize(cross(newX, newY));
+
+                    mat3 targetRotMat;
+                    targetRotMat[0] = newX;
+                    targetRotMat[1] = newY;
+                    targetRotMat[2] = newZ;
+
+                    quat targetQ = quat_cast(targetRotMat);
+                    snail->q = normalize(slerp(snail->q, targetQ, 0.2f));
+                }
+                return true;
             }
         }
     }
     return false;
-}
\ No newline at end of file
+}
+
+float sweepSnailTrees(const vec3& from, const vec3& to, float radius, const std::vector<mat4>& instanceMatrices,
+                      const TreeGrid& grid) {
+    // the same cylinders handleSnailTreeCollision pushes out of
+    float combinedRadius = radius + TREE_RADIUS + TREE_CLEARANCE;
+    vec3 d = to - from;
+    float a = d.x * d.x + d.z * d.z;
+    float first = 1.0f;
+
+    // every cell whose trees can reach the swept segment
+    int x0 = gridCell(std::min(from.x, to.x) - combinedRadius), x1 = gridCell(std::max(from.x, to.x) + combinedRadius);
+    int z0 = gridCell(std::min(from.z, to.z) - combinedRadius), z1 = gridCell(std::max(from.z, to.z) + combinedRadius);
+    for (int x = x0; x <= x1; x++) {
+        for (int index : grid.column(x, z0, z1)) {
+            if (index >= (int)instanceMatrices.size()) continue;
+            vec3 treePos = vec3(instanceMatrices[index][3]);
+            float top = treePos.y + TREE_HEIGHT + radius;
+            float fx = from.x - treePos.x, fz = from.z - treePos.z;
+            float c = fx * fx + fz * fz - combinedRadius * combinedRadius;
+
+            // landing on top: crossing the height the snail rests at, above the trunk
+            if (d.y < 0.0f && from.y >= top && to.y < top) {
+                float t = (from.y - top) / -d.y;
+                float px = fx + d.x * t, pz = fz + d.z * t;
+                if (t < first && px * px + pz * pz < combinedRadius * combinedRadius) first = t;
+            }
+            // the side: a circle in x/z, already overlapping is left to the push-out
+            if (c <= 0.0f || a <= 0.0f) continue;
+            float b = fx * d.x + fz * d.z;
+            float disc = b * b - a * c;
+            if (b >= 0.0f || disc < 0.0f) continue;
+            float t = (-b - sqrt(disc)) / a;
+            float y = from.y + d.y * t;
+            if (t < first && y >= treePos.y && y < top) first = t;
+        }
+    }
+    return first;
+}
+
+float sweepSnailTerrain(HeightField* ground, const vec3& from, const vec3& to, float radius, float maxSlope) {
+    // the gap under the sphere closes no faster than its drop plus the
+    // steepest climb along its path, so advancing by gap / closing never
+    // steps past the first touch
+    vec3 d = to - from;
+    float closing = -d.y + maxSlope * sqrt(d.x * d.x + d.z * d.z);
+    if (closing <= 0.0f) return 1.0f;
+    float tolerance = 0.01f;
+    float t = 0.0f;
+    for (int i = 0; i < 32; i++) {
+        vec3 p = from + d * t;
+        float gap = p.y - radius - ground->getHeightAt(p.x, p.z);
+        // starting in contact is the end-of-step test's business, and a
+        // start closer than the tolerance (resting, lifted just clear by the
+        // end-of-step test) only stops where the gap halves
+        if (i == 0) {
+            if (gap <= 0.0f) return 1.0f;
+            tolerance = std::min(tolerance, 0.5f * gap);
+        }
+        if (gap < tolerance) return t;
+        t += gap / closing;
+        if (t >= 1.0f) return 1.0f;
+    }
+    return t;
+}
+
+InstanceBvh::Box treeCollisionBox(const mat4& tree) {
+    float r = TREE_RADIUS + TREE_CLEARANCE;
+    vec3 base(tree[3]);
+    InstanceBvh::Box box = { base - vec3(r, 0.0f, r), base + vec3(r, TREE_HEIGHT, r) };
+    return box;
+}
+
+bool treesBlock(const InstanceBvh& instances, const std::vector<mat4>& treeMatrices, const vec3& a, const vec3& b) {
+    float r = TREE_RADIUS + TREE_CLEARANCE;
+    vec3 d = b - a;
+    float dd = d.x * d.x + d.z * d.z;
+    return instances.segmentBlocked(a, b, [&](const InstanceBvh::Item& item, float&) {
+        if (item.kind != TREE_INSTANCES || item.index >= (int)treeMatrices.size()) return false;
+        vec3 base(treeMatrices[item.index][3]);
+        // where the segment is within r of the trunk axis in x/z
+        float fx = a.x - base.x, fz = a.z - base.z;
+        float c = fx * fx + fz * fz - r * r;
+        float t0 = 0.0f, t1 = 1.0f;
+        if (dd > 0.0f) {
+            float h = fx * d.x + fz * d.z;
+            float disc = h * h - dd * c;
+            if (disc < 0.0f) return false;
+            float s = sqrt(disc);
+            t0 = std::max((-h - s) / dd, 0.0f);
+            t1 = std::min((-h + s) / dd, 1.0f);
+            if (t0 > t1) return false;
+        }
+        else if (c > 0.0f) return false;
+        // and within the trunk's height somewhere along that stretch
+        float y0 = a.y + d.y * t0, y1 = a.y + d.y * t1;
+        return std::max(y0, y1) >= base.y && std::min(y0, y1) <= base.y + TREE_HEIGHT;
+    });
+}
+
+vector<mat4> placeTrees(HeightField* ground, int amount, float scalar, int mapSize) {
+	vector<mat4> instanceMatrices;
+    for (int i = 0; i < amount; i++) {
+        float x = (rand() % (mapSize * 2) - mapSize); // Random X
+        float z = (rand() % (mapSize * 2) - mapSize); // Random Z
+        float y = ground->getHeightAt(x, z);    // Get Y from heightmap
+        mat4 model = translate(mat4(1.0f), vec3(x, y, z));
+        model = rotate(model, radians((float)(rand() % 360)), vec3(0, 1, 0)); // Random rotation
+        model = scale(model, vec3(scalar, scalar, scalar));
+        instanceMatrices.push_back(model);
+    }
+	return instanceMatrices;
+}
+
+void buildTreeGrid(const std::vector<mat4>& instanceMatrices, TreeGrid& grid) {
+    vector<int> cellX, cellZ, indices;
+    for (int i = 0; i < instanceMatrices.size(); i++) {
+        vec3 pos = vec3(instanceMatrices[i][3]);
+        cellX.push_back(gridCell(pos.x));
+        cellZ.push_back(gridCell(pos.z));
+        indices.push_back(i);
+    }
+    grid.build(cellX, cellZ, indices);
+}
+
+void buildFlowerGrid(const std::vector<FlowerField*>& kinds, FlowerGrid& grid) {
+    vector<int> cellX, cellZ;
+    vector<FlowerHandle> handles;
+    for (FlowerField* flower : kinds) {
+        if (!flower) continue;
+        for (int i = 0; i < flower->instanceMatrices.size(); i++) {
+            vec3 pos = vec3(flower->instanceMatrices[i][3]);
+            cellX.push_back(gridCell(pos.x));
+            cellZ.push_back(gridCell(pos.z));
+            // Store the pointer and the index
+            handles.push_back({ flower, i });
+        }
+    }
+    grid.build(cellX, cellZ, handles);
+}
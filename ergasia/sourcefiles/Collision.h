@@ -2,32 +2,65 @@
 #define COLLISION_H
 
 #include <glm/glm.hpp>
-#include "heightmap.h"
-#include <unordered_map>
+#include "HeightGrid.h"
+#include "HeightField.h"
 #include <vector>
+#include <cmath>
+#include "CellGrid.h"
+#include "InstanceBvh.h"
 
-class Snail;
+class SnailBody;
+class FlowerField;
 
-struct GridKey {
-    int x, z;
-    bool operator==(const GridKey& other) const {
-        return x == other.x && z == other.z;
-    }
+struct FlowerHandle {
+    FlowerField* type; 
+    int index;   
 };
 
-struct GridKeyHash {
-    std::size_t operator()(const GridKey& k) const {
-        return std::hash<int>()(k.x) ^ (std::hash<int>()(k.z) << 1);
-    }
-};
-
-extern std::unordered_map<GridKey, std::vector<int>, GridKeyHash> treeGrid;
+// tree instance indices and flowers per cellSize x cellSize cell
+typedef CellGrid<int> TreeGrid;
+typedef CellGrid<FlowerHandle> FlowerGrid;
+// kinds of the items in an InstanceBvh of the world, flowers are FLOWER_INSTANCES + their FlowerKind
+enum InstanceKind { TREE_INSTANCES, GRASS_INSTANCES, FLOWER_INSTANCES };
+// the game's world; headless runs keep their own
+extern TreeGrid treeGrid;
+extern FlowerGrid flowerGrid;
 extern float cellSize; 
 
-void handleBoxSnailCollision(Heightmap* heightmap, Snail* snail);
+/** The cell of a world x or z coordinate */
+inline int gridCell(float worldCoordinate) { return static_cast<int>(floor(worldCoordinate / cellSize)); }
+
+void handleBoxSnailCollision(HeightGrid* heightmap, SnailBody* snail);
 bool checkForBoxSnailCollision(glm::vec3& pos, const float& r, const float& size, glm::vec3& n);
-bool handleSnailTerrainCollision(Snail* snail, Heightmap* terrain, bool onTree);
+/** ground: sampled under the snail, only its height changes here */
+bool handleSnailTerrainCollision(SnailBody* snail, const GroundSample& ground, bool onTree);
+
+/**
+ * Pushes the snail off the trunks it is inside. A crawling snail turns up
+ * the trunk; for a retracted one the trunk's index goes to contactTree and
+ * its velocity is left to the caller's contact solve.
+ */
+bool handleSnailTreeCollision(SnailBody* snail, const std::vector<glm::mat4>& treeMatrices, const TreeGrid& grid = treeGrid,
+                              int* contactTree = nullptr);
+
+// Swept tests for a sphere of radius moving from -> to during a step. Each
+// returns the fraction of the move before the first contact, 1 for none.
+// Contacts the sphere starts in are left to the end-of-step tests above.
+/** against the tree cylinders, sides and tops */
+float sweepSnailTrees(const glm::vec3& from, const glm::vec3& to, float radius,
+                      const std::vector<glm::mat4>& treeMatrices, const TreeGrid& grid = treeGrid);
+/** against the ground by conservative advancement, maxSlope bounds its gradient (HeightField::maxSlope) */
+float sweepSnailTerrain(HeightField* ground, const glm::vec3& from, const glm::vec3& to, float radius, float maxSlope);
+
+/** World box of the cylinder tree collides as, whatever its model's scale */
+InstanceBvh::Box treeCollisionBox(const glm::mat4& tree);
+/** Whether the collision cylinder of any TREE_INSTANCES item in instances crosses the segment a -> b */
+bool treesBlock(const InstanceBvh& instances, const std::vector<glm::mat4>& treeMatrices, const glm::vec3& a, const glm::vec3& b);
 
-bool handleSnailTreeCollision(Snail* snail, const std::vector<glm::mat4>& treeMatrices);
+// amount trees scattered over [-mapSize, mapSize)^2 on ground, drawing from rand()
+std::vector<glm::mat4> placeTrees(HeightField* ground, int amount, float scalar, int mapSize);
+// fill a tree or flower grid from scratch
+void buildTreeGrid(const std::vector<glm::mat4>& instanceMatrices, TreeGrid& grid = treeGrid);
+void buildFlowerGrid(const std::vector<FlowerField*>& kinds, FlowerGrid& grid = flowerGrid);
 
 #endif
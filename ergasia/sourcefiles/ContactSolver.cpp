@@ -0,0 +1,133 @@
+#include "ContactSolver.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+// share of an overlap pushed out per step, and the overlap left alone
+static const float CONTACT_BIAS = 0.2f;
+static const float CONTACT_SLOP = 0.01f;
+// slower contacts do not bounce, as in the rigid body kernel
+static const float BOUNCE_SPEED = 1.0f;
+
+static void perpendiculars(const vec3& n, vec3& t1, vec3& t2) {
+    t1 = normalize(abs(n.x) > 0.57735f ? vec3(n.y, -n.x, 0.0f) : vec3(0.0f, n.z, -n.y));
+    t2 = cross(n, t1);
+}
+
+void ContactSolver::clear() {
+    bodies.clear();
+    contacts.clear();
+}
+
+int ContactSolver::addBody(const vec3& v, const vec3& w, const mat3& invI, float invMass) {
+    Body body;
+    body.v = v;
+    body.w = w;
+    body.invI = invI;
+    body.invMass = invMass;
+    body.dP = body.dL = vec3(0.0f);
+    bodies.push_back(body);
+    return (int)bodies.size() - 1;
+}
+
+void ContactSolver::addContact(int a, int b, int slotA, int slotB, const vec3& normal, const vec3& rA, const vec3& rB,
+                               float penetration, float restitution, float friction, float dt) {
+    const Body& A = bodies[slotA];
+    Contact c;
+    c.a = a;
+    c.b = b;
+    c.slotA = slotA;
+    c.slotB = slotB;
+    c.normal = normal;
+    perpendiculars(normal, c.tangent1, c.tangent2);
+    c.rA = rA;
+    c.rB = slotB >= 0 ? rB : vec3(0.0f);
+
+    // 1 / (inverse mass along d at the contact point)
+    auto mass = [&](const vec3& d) {
+        vec3 ra = cross(c.rA, d);
+        float k = A.invMass + dot(ra, A.invI * ra);
+        if (slotB >= 0) {
+            const Body& B = bodies[slotB];
+            vec3 rb = cross(c.rB, d);
+            k += B.invMass + dot(rb, B.invI * rb);
+        }
+        return k > 0.0f ? 1.0f / k : 0.0f;
+    };
+    c.normalMass = mass(normal);
+    c.tangentMass1 = mass(c.tangent1);
+    c.tangentMass2 = mass(c.tangent2);
+
+    // a gap may close within the step but no further, an overlap is pushed
+    // out, and only a contact that closes within the step bounces
+    float vn = dot(relativeVelocity(c), normal);
+    c.target = penetration < 0.0f ? penetration / dt : CONTACT_BIAS * std::max(penetration - CONTACT_SLOP, 0.0f) / dt;
+    if (vn < -BOUNCE_SPEED && vn * dt < penetration) c.target = std::max(c.target, -restitution * vn);
+    c.friction = friction;
+    c.normalImpulse = c.tangentImpulse1 = c.tangentImpulse2 = 0.0f;
+    contacts.push_back(c);
+}
+
+void ContactSolver::apply(const Contact& c, const vec3& impulse) {
+    Body& A = bodies[c.slotA];
+    A.v -= impulse * A.invMass;
+    A.w -= A.invI * cross(c.rA, impulse);
+    A.dP -= impulse;
+    A.dL -= cross(c.rA, impulse);
+    if (c.slotB < 0) return;
+    Body& B = bodies[c.slotB];
+    B.v += impulse * B.invMass;
+    B.w += B.invI * cross(c.rB, impulse);
+    B.dP += impulse;
+    B.dL += cross(c.rB, impulse);
+}
+
+vec3 ContactSolver::relativeVelocity(const Contact& c) const {
+    const Body& A = bodies[c.slotA];
+    vec3 dv = -(A.v + cross(A.w, c.rA));
+    if (c.slotB >= 0) {
+        const Body& B = bodies[c.slotB];
+        dv += B.v + cross(B.w, c.rB);
+    }
+    return dv;
+}
+
+void ContactSolver::solve() {
+    // warm start from the contacts the same pairs had last step
+    auto before = [](const Contact& l, const Contact& r) { return l.a < r.a || (l.a == r.a && l.b < r.b); };
+    sort(contacts.begin(), contacts.end(), before);
+    size_t k = 0;
+    for (Contact& c : contacts) {
+        while (k < previousContacts.size() && before(previousContacts[k], c)) k++;
+        if (k == previousContacts.size() || before(c, previousContacts[k])) continue;
+        const Contact& old = previousContacts[k];
+        vec3 friction = old.tangent1 * old.tangentImpulse1 + old.tangent2 * old.tangentImpulse2;
+        c.normalImpulse = old.normalImpulse;
+        c.tangentImpulse1 = dot(friction, c.tangent1);
+        c.tangentImpulse2 = dot(friction, c.tangent2);
+        apply(c, c.normal * c.normalImpulse + c.tangent1 * c.tangentImpulse1 + c.tangent2 * c.tangentImpulse2);
+    }
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        for (Contact& c : contacts) {
+            // friction first, bounded by the normal impulse so far
+            float limit = c.friction * c.normalImpulse;
+            vec3 dv = relativeVelocity(c);
+            float t1 = clamp(c.tangentImpulse1 - dot(dv, c.tangent1) * c.tangentMass1, -limit, limit);
+            float t2 = clamp(c.tangentImpulse2 - dot(dv, c.tangent2) * c.tangentMass2, -limit, limit);
+            apply(c, c.tangent1 * (t1 - c.tangentImpulse1) + c.tangent2 * (t2 - c.tangentImpulse2));
+            c.tangentImpulse1 = t1;
+            c.tangentImpulse2 = t2;
+
+            // contacts only push, the accumulated impulse never pulls
+            dv = relativeVelocity(c);
+            float jn = std::max(c.normalImpulse + (c.target - dot(dv, c.normal)) * c.normalMass, 0.0f);
+            apply(c, c.normal * (jn - c.normalImpulse));
+            c.normalImpulse = jn;
+        }
+    }
+    previousContacts.swap(contacts);
+    contacts.clear();
+}
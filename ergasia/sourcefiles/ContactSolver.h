@@ -0,0 +1,74 @@
+#ifndef CONTACT_SOLVER_H
+#define CONTACT_SOLVER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * Sequential impulses over sphere contacts with restitution and Coulomb
+ * friction, warm started from the impulses the same pairs had the step
+ * before, so stacks and piles settle instead of jittering. Each pair of
+ * spheres touches at one point, so every manifold is one contact.
+ *
+ * A step adds the bodies in contact with the velocities they are about to
+ * integrate with, then their contacts, and solves; each body's gain in
+ * momentum and angular momentum is read back and applied by the caller.
+ * RigidBodyWorld solves its debris with one, Simulation the snail against
+ * the ground, the trees and the debris with another.
+ */
+class ContactSolver {
+public:
+    /** the velocity of a body while solving and the momentum it gained */
+    struct Body {
+        glm::vec3 v, w, dP, dL;
+        glm::mat3 invI;
+        float invMass;
+    };
+    /** passes over the contacts per solve */
+    int iterations;
+
+    ContactSolver() : iterations(8) {}
+
+    /** Forgets the bodies and contacts added, the last solve's impulses stay for warm starting */
+    void clear();
+    /** Adds a body with its world inverse inertia and returns its slot */
+    int addBody(const glm::vec3& v, const glm::vec3& w, const glm::mat3& invI, float invMass);
+    const Body& body(int slot) const { return bodies[slot]; }
+    /**
+     * Contact of the bodies in slots slotA and slotB, or of slotA with
+     * something static when slotB is -1. a and b name the pair for warm
+     * starting, so the same pair must carry them from step to step. normal
+     * points from a to b, rA and rB reach from each center to the contact
+     * point. A negative penetration is a gap that may close within dt but no
+     * further, an overlap is pushed out over a few steps.
+     */
+    void addContact(int a, int b, int slotA, int slotB, const glm::vec3& normal, const glm::vec3& rA,
+                    const glm::vec3& rB, float penetration, float restitution, float friction, float dt);
+    /** Warm starts and solves the contacts added since clear() */
+    void solve();
+
+private:
+    struct Contact {
+        int a, b;
+        /** of a and b in bodies, slotB -1 for static */
+        int slotA, slotB;
+        /** from a towards b */
+        glm::vec3 normal, tangent1, tangent2;
+        /** the contact point from each center */
+        glm::vec3 rA, rB;
+        float normalMass, tangentMass1, tangentMass2;
+        /** normal velocity the solve drives towards: a bounce, a push out or how close it may come */
+        float target;
+        float friction;
+        /** accumulated impulses, the next step starts from them */
+        float normalImpulse, tangentImpulse1, tangentImpulse2;
+    };
+    std::vector<Body> bodies;
+    /** this step's contacts sorted by (a, b) once solved, and the last step's */
+    std::vector<Contact> contacts, previousContacts;
+
+    void apply(const Contact& c, const glm::vec3& impulse);
+    glm::vec3 relativeVelocity(const Contact& c) const;
+};
+
+#endif
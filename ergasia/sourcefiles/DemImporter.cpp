@@ -0,0 +1,190 @@
+#include "DemImporter.h"
+#include "HeightStore.h"
+#include <stb_image_aug.h>
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+static bool endsWith(const string& s, const string& suffix) {
+    if (s.size() < suffix.size()) return false;
+    string tail = s.substr(s.size() - suffix.size());
+    transform(tail.begin(), tail.end(), tail.begin(), ::tolower);
+    return tail == suffix;
+}
+
+// Converts one row of 8 or 16 bit big/little endian samples to uint16, maxval becoming 65535
+static void decodeRow(const unsigned char* in, int width, int bytesPerSample, bool bigEndian, int maxval,
+                      uint16_t* out) {
+    for (int c = 0; c < width; c++) {
+        uint32_t v;
+        if (bytesPerSample == 1) v = in[c];
+        else if (bigEndian) v = ((uint32_t)in[2 * c] << 8) | in[2 * c + 1];
+        else v = in[2 * c] | ((uint32_t)in[2 * c + 1] << 8);
+        v = std::min(v, (uint32_t)maxval);
+        out[c] = (uint16_t)((v * 65535u + maxval / 2) / maxval);
+    }
+}
+
+// Streams rows of a file whose samples start at dataOffset
+static void importStream(ifstream& in, size_t dataOffset, int width, int height, int bytesPerSample, bool bigEndian,
+                         int maxval, const string& destination, const DemImportOptions& options) {
+    vector<unsigned char> buffer((size_t)width * bytesPerSample);
+    HeightStore::write(destination, width, height, options.tileSize, options.scale, options.offset,
+        [&](int r, uint16_t* out) {
+            in.seekg((streamoff)(dataOffset + (size_t)r * buffer.size()));
+            in.read(reinterpret_cast<char*>(&buffer[0]), buffer.size());
+            if (!in) throw runtime_error("Unexpected end of elevation data");
+            decodeRow(&buffer[0], width, bytesPerSample, bigEndian, maxval, out);
+        });
+}
+
+static void importRaw(const string& source, const string& destination, const DemImportOptions& options) {
+    ifstream in(source.c_str(), ios::binary | ios::ate);
+    if (!in) throw runtime_error("Could not open elevation file: " + source);
+    size_t bytes = (size_t)in.tellg();
+    int width = options.width, height = options.height;
+    if (width == 0 || height == 0) {
+        width = height = (int)(sqrt((double)(bytes / 2)) + 0.5);
+    }
+    if ((size_t)width * height * 2 > bytes) throw runtime_error("Raw elevation file is smaller than its size: " + source);
+    importStream(in, 0, width, height, 2, options.bigEndian, 65535, destination, options);
+}
+
+// P5 header: magic, width, height, maxval, each separated by whitespace, '#' comments allowed
+static void importPgm(const string& source, const string& destination, const DemImportOptions& options) {
+    ifstream in(source.c_str(), ios::binary);
+    if (!in) throw runtime_error("Could not open elevation file: " + source);
+    auto token = [&]() {
+        string t;
+        int ch;
+        while ((ch = in.get()) != EOF) {
+            if (ch == '#') { while ((ch = in.get()) != EOF && ch != '\n'); continue; }
+            if (isspace(ch)) { if (!t.empty()) break; continue; }
+            t += (char)ch;
+        }
+        return t;
+    };
+    if (token() != "P5") throw runtime_error("Only binary (P5) PGM files are supported: " + source);
+    int width = atoi(token().c_str());
+    int height = atoi(token().c_str());
+    int maxval = atoi(token().c_str());
+    if (width < 2 || height < 2 || maxval <= 0 || maxval > 65535) throw runtime_error("Malformed PGM header: " + source);
+    // PGM samples are big endian, maxval is full scale
+    importStream(in, (size_t)in.tellg(), width, height, maxval < 256 ? 1 : 2, true, maxval, destination, options);
+}
+
+static uint32_t readBE32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Grayscale PNG: concatenate IDAT, inflate with stb's zlib, undo the row filters
+static void importPng(const string& source, const string& destination, const DemImportOptions& options) {
+    ifstream in(source.c_str(), ios::binary);
+    if (!in) throw runtime_error("Could not open elevation file: " + source);
+    static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    unsigned char sig[8];
+    in.read(reinterpret_cast<char*>(sig), 8);
+    if (!in || memcmp(sig, signature, 8) != 0) throw runtime_error("Not a PNG file: " + source);
+
+    int width = 0, height = 0, depth = 0;
+    vector<char> compressed;
+    while (in) {
+        unsigned char head[8];
+        in.read(reinterpret_cast<char*>(head), 8);
+        if (!in) break;
+        uint32_t length = readBE32(head);
+        string type(reinterpret_cast<char*>(head + 4), 4);
+        // the PNG limit, and all of the chunk must be there
+        if (length > 0x7fffffffu) throw runtime_error("Malformed PNG: " + source);
+        vector<unsigned char> chunk(length);
+        if (length > 0) {
+            in.read(reinterpret_cast<char*>(&chunk[0]), length);
+            if ((uint32_t)in.gcount() != length) throw runtime_error("Malformed PNG: " + source);
+        }
+        in.ignore(4); // crc
+        if (type == "IHDR") {
+            if (length != 13) throw runtime_error("Malformed PNG: " + source);
+            width = (int)readBE32(&chunk[0]);
+            height = (int)readBE32(&chunk[4]);
+            depth = chunk[8];
+            if (chunk[9] != 0 || (depth != 8 && depth != 16) || chunk[12] != 0) {
+                throw runtime_error("Only non-interlaced 8/16-bit grayscale PNG is supported: " + source);
+            }
+        }
+        else if (type == "IDAT") {
+            // stb's inflate counts in int
+            if (compressed.size() + length > (size_t)INT_MAX) {
+                throw runtime_error("PNG is too large to inflate in memory, convert it to raw: " + source);
+            }
+            compressed.insert(compressed.end(), chunk.begin(), chunk.end());
+        }
+        else if (type == "IEND") {
+            break;
+        }
+    }
+    if (width < 2 || height < 2 || compressed.empty()) throw runtime_error("Malformed PNG: " + source);
+
+    int bpp = depth / 8;
+    size_t rowBytes = (size_t)width * bpp;
+    size_t rawSize = (rowBytes + 1) * (size_t)height;
+    // stb's inflate counts in int
+    if (rawSize > (size_t)INT_MAX) throw runtime_error("PNG is too large to inflate in memory, convert it to raw: " + source);
+    int rawLength = 0;
+    char* raw = stbi_zlib_decode_malloc_guesssize(&compressed[0], (int)compressed.size(), (int)rawSize, &rawLength);
+    if (!raw || (size_t)rawLength < rawSize) {
+        free(raw);
+        throw runtime_error("Could not inflate PNG data: " + source);
+    }
+    vector<char>().swap(compressed);
+
+    vector<unsigned char> prev(rowBytes, 0), cur(rowBytes);
+    try {
+        HeightStore::write(destination, width, height, options.tileSize, options.scale, options.offset,
+            [&](int r, uint16_t* out) {
+                const unsigned char* line = reinterpret_cast<const unsigned char*>(raw) + (size_t)r * (rowBytes + 1);
+                int filter = line[0];
+                const unsigned char* src = line + 1;
+                for (size_t i = 0; i < rowBytes; i++) {
+                    int a = i >= (size_t)bpp ? cur[i - bpp] : 0;
+                    int b = prev[i];
+                    int c = i >= (size_t)bpp ? prev[i - bpp] : 0;
+                    int x = src[i];
+                    switch (filter) {
+                    case 1: x += a; break;
+                    case 2: x += b; break;
+                    case 3: x += (a + b) / 2; break;
+                    case 4: {
+                        int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+                        x += (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                        break;
+                    }
+                    default: break;
+                    }
+                    cur[i] = (unsigned char)x;
+                }
+                decodeRow(&cur[0], width, bpp, true, depth == 8 ? 255 : 65535, out);
+                swap(prev, cur);
+            });
+    }
+    catch (...) {
+        free(raw);
+        throw;
+    }
+    free(raw);
+}
+
+void importDem(const string& source, const string& destination, const DemImportOptions& options) {
+    cout << "Importing elevation data " << source << " -> " << destination << endl;
+    if (endsWith(source, ".pgm")) importPgm(source, destination, options);
+    else if (endsWith(source, ".png")) importPng(source, destination, options);
+    else importRaw(source, destination, options);
+}
@@ -0,0 +1,26 @@
+#ifndef DEM_IMPORTER_H
+#define DEM_IMPORTER_H
+
+#include <string>
+
+/**
+ * Converts surveyed elevation data into a HeightStore file. Supported inputs:
+ * binary PGM (P5, 8 or 16 bit), grayscale PNG (8 or 16 bit, not interlaced)
+ * and headerless raw 16-bit samples. 8-bit data is widened to 16 bits.
+ */
+struct DemImportOptions {
+    DemImportOptions()
+        : width(0), height(0), bigEndian(false), scale(1.0f / 65535.0f), offset(0.0f), tileSize(256) {
+    }
+    /** raw input only; 0 assumes a square image */
+    int width, height;
+    bool bigEndian;
+    /** stored height = offset + scale * sample, in Heightmap units (multiplied by scalarY) */
+    float scale, offset;
+    int tileSize;
+};
+
+/** throws std::runtime_error on unreadable or unsupported input */
+void importDem(const std::string& source, const std::string& destination, const DemImportOptions& options);
+
+#endif
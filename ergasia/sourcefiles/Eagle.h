@@ -1,43 +1,23 @@
 #ifndef EAGLE_H
 #define EAGLE_H
 
-#include <vector>
 #include <glm/glm.hpp>
 #include <GL/glew.h>
-#include <string>
 #include <common/model.h> 
+#include "EagleAI.h"
 
-class Snail;
-
-enum EagleState {
-    PATROLLING,
-    DIVING,
-    GRABBING,
-    RETURNING
-};
-
-class Eagle {
+class Eagle : public EagleAI {
 public:
-    glm::vec3 position;
-    glm::vec3 velocity;
-    float speed;
-    float rotationY;
+    /** what draw() shows, only written by interpolate() on the render thread */
+    glm::mat4 modelMatrix;
 
     Drawable* model;
-    EagleState state;
-    float patrolTimer;
-    float attackCooldown;    
-    float diveSpeed;          
-    glm::vec3 startDivePos;   
-    bool hasSnail;
     Eagle(glm::vec3 startPos);
     ~Eagle();
 
-    void update(float dt, Snail* snail);
     void draw(GLuint shaderID, GLuint modelLocation, GLuint colorLocation);
-
-private:
-    void updatePatrol(float dt);
+    /** Sets modelMatrix alpha of the way through the snapshot's step */
+    void interpolate(const EagleSnapshot& snapshot, float alpha);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,116 @@
+#include "EagleAI.h"
+#include "SnailBody.h"
+#include "HeightGrid.h"
+
+using namespace glm;
+
+EagleAI::EagleAI(vec3 startPos) {
+    position = startPos;
+    velocity = vec3(1.0f, 0.0f, 0.0f);
+    speed = 15.0f;
+    diveSpeed = 40.0f;
+    sightRange = 100.0f;
+    state = PATROLLING;
+    patrolTimer = 0.0f;
+    rotationY = 0.0f;
+    attackCooldown = 0.0f;
+    hasSnail = false;
+    savePrevious();
+}
+
+void EagleAI::update(float dt, SnailBody* snail, HeightGrid* terrain) {
+    float distToSnail = distance(vec3(position.x, 0, position.z), vec3(snail->x.x, 0, snail->x.z));
+    vec3 directionToSnail = normalize(snail->x - position);
+
+    switch (state) {
+    case PATROLLING:
+        updatePatrol(dt);
+        position += velocity * dt;
+        if (distToSnail < sightRange && attackCooldown <= 0.0f && canSee(snail, terrain)) {
+            state = DIVING;
+            startDivePos = position;
+            velocity = directionToSnail * diveSpeed;
+        }
+
+        if (attackCooldown > 0) attackCooldown -= dt;
+        break;
+
+    case DIVING:
+        velocity = directionToSnail * diveSpeed;
+        position += velocity * dt;
+
+        if (distance(position, snail->x) < 3.0f && snail->isRetracted) {
+            state = GRABBING;
+            hasSnail = true;
+        }
+
+        if (position.y < snail->x.y + 1.0f) {
+            state = RETURNING;
+        }
+        break;
+
+    case GRABBING:
+        velocity = vec3(1.0f, 20.0f, -1.0f);
+        position += velocity * dt;
+
+        snail->x = position - vec3(0, 2.0f, 0);
+        snail->v = vec3(0);
+
+        if (position.y > 150.0f || !snail->isRetracted) {
+            hasSnail = false;
+            state = PATROLLING;
+            attackCooldown = 10.0f;
+            snail->v = vec3(-3.0f, -5.0f, 3.0f);
+        }
+        break;
+
+    case RETURNING:
+        if (position.y < 130.0f) {
+            velocity = vec3(0.0f, 15.0f, 0.0f);
+            position += velocity * dt;
+        }
+        else {
+            state = PATROLLING;
+            attackCooldown = 5.0f;
+        }
+        break;
+    }
+
+    if (length(velocity) > 0.1f) {
+        rotationY = -atan2(velocity.x, velocity.z);
+    }
+}
+
+bool EagleAI::canSee(const SnailBody* snail, HeightGrid* terrain) const {
+    vec3 target = snail->x + vec3(0, snail->radius, 0);
+    if (terrain && !terrain->lineOfSight(position, target)) return false;
+    return !cover || !cover(position, target);
+}
+
+void EagleAI::updatePatrol(float dt) {
+    patrolTimer += dt;
+
+    float radius = 50.0f;
+    float centerX = 0.0f;
+    float centerZ = 0.0f;
+
+    float targetX = centerX + sin(patrolTimer * 0.5f) * radius;
+    float targetZ = centerZ + cos(patrolTimer * 0.5f) * radius;
+
+    float targetY = 130.0f;
+
+    vec3 targetPos(targetX, targetY, targetZ);
+    vec3 dir = normalize(targetPos - position);
+
+    velocity = dir * speed;
+}
+
+void EagleAI::savePrevious() {
+    previousPosition = position;
+    previousRotationY = rotationY;
+}
+
+EagleSnapshot EagleAI::snapshot() const {
+    EagleSnapshot snapshot = { previousPosition, position, previousRotationY, rotationY };
+    return snapshot;
+}
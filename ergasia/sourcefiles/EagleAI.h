@@ -0,0 +1,57 @@
+#ifndef EAGLE_AI_H
+#define EAGLE_AI_H
+
+#include <functional>
+#include <glm/glm.hpp>
+
+class SnailBody;
+class HeightGrid;
+
+/** Eagle pose before and after one physics step, copied out for drawing */
+struct EagleSnapshot {
+    glm::vec3 previousPosition, position;
+    float previousRotationY, rotationY;
+};
+
+enum EagleState {
+    PATROLLING,
+    DIVING,
+    GRABBING,
+    RETURNING
+};
+
+/** The eagle's flight and hunting, Eagle adds the model */
+class EagleAI {
+public:
+    glm::vec3 position;
+    glm::vec3 velocity;
+    float speed;
+    float rotationY;
+    /** pose before the last physics step */
+    glm::vec3 previousPosition;
+    float previousRotationY;
+
+    EagleState state;
+    float patrolTimer;
+    float attackCooldown;    
+    float diveSpeed;          
+    /** how close the snail must be for a dive */
+    float sightRange;
+    glm::vec3 startDivePos;   
+    bool hasSnail;
+    /** whether anything besides the terrain hides b from a, trees for one */
+    std::function<bool(const glm::vec3& a, const glm::vec3& b)> cover;
+    EagleAI(glm::vec3 startPos);
+
+    // with a terrain the eagle only dives at a snail it can see
+    void update(float dt, SnailBody* snail, HeightGrid* terrain = nullptr);
+    /** Call before each fixed physics step */
+    void savePrevious();
+    EagleSnapshot snapshot() const;
+
+private:
+    void updatePatrol(float dt);
+    bool canSee(const SnailBody* snail, HeightGrid* terrain) const;
+};
+
+#endif
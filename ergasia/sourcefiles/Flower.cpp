@@ -33,32 +33,19 @@ void Flower::loadMTL(const char* path) {
 
 }
 
-void Flower::generatePositions(Heightmap* terrain, int count, float scale, int mapSize) {
-    instanceMatrices.clear();
-    for (int i = 0; i < count; i++) {
-        float x = (rand() % (mapSize * 2) - mapSize);
-        float z = (rand() % (mapSize * 2) - mapSize);
-        float y = terrain->getHeightAt(x, z);
-
-        mat4 model = translate(mat4(1.0f), vec3(x, y, z));
-
-        vec3 normal = normalize(terrain->getNormalAt(x, z)); 
-        vec3 up = vec3(0.0f, 1.0f, 0.0f); 
-
-        if (abs(dot(up, normal)) < 0.999f) {
-            vec3 axis = normalize(cross(up, normal));
-            float angle = acos(dot(up, normal));
-            model = rotate(model, angle, axis);
-        }
-        model = rotate(model, radians((float)(rand() % 360)), vec3(0, 1, 0));
+Flower::Flower(const char* objPath, const char* mtlPath, HeightField* terrain, int count, float scale, bool mtl,int mapSize)
+    : FlowerField(terrain, count, scale, mapSize) {
+    if (!loadModel(objPath, mtlPath, mtl)) return;
+    setupInstances();
+}
 
-        model = glm::scale(model, vec3(scale));
-        instanceMatrices.push_back(model);
-    }
+Flower::Flower(const char* objPath, const char* mtlPath, const mat4* matrices, int count, bool mtl)
+    : FlowerField(matrices, count) {
+    if (!loadModel(objPath, mtlPath, mtl)) return;
+    setupInstances();
 }
 
-Flower::Flower(const char* objPath, const char* mtlPath, Heightmap* terrain, int count, float scale, bool mtl,int mapSize) {
-    this->instanceCount = count;
+bool Flower::loadModel(const char* objPath, const char* mtlPath, bool mtl) {
 	this->hasTexture = !mtl;
     if (mtl) loadMTL(mtlPath);
     else textureID = loadSOIL(mtlPath);
@@ -66,13 +53,16 @@ Flower::Flower(const char* objPath, const char* mtlPath, Heightmap* terrain, int
     loadOBJWithTiny(objPath, vertices, uvs, normals);
     if (vertices.empty()) {
         cout << "CRITICAL ERROR: Failed to load model or model is empty: " << objPath << endl;
-        return; 
+        return false; 
     }
     vertexCount = vertices.size();
+    return true;
+}
 
-    generatePositions(terrain, count, scale, mapSize);
+void Flower::setupInstances() {
+    int count = (int)instanceMatrices.size();
+    this->instanceCount = count;
     instanceColors.resize(count, this->color);
-	edible.resize(count, true);
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
 
@@ -158,46 +148,23 @@ void Flower::draw(GLuint shaderProgram,bool drawShading) {
     glBindVertexArray(0);
 }
 
-bool Flower::checkCollisionByIndex(int index, Snail* snail, bool isRetracted) {
-    if (index < 0 || index >= instanceMatrices.size()) return false;
-
-    
-    vec3 flowPos = vec3(instanceMatrices[index][3]);
-    float combinedRadius = snail->radius + 0.5f; 
-    float detectionDist = combinedRadius + 0.1f;
-
-    float dx = snail->x.x - flowPos.x;
-    float dz = snail->x.z - flowPos.z;
-    float distSq = dx * dx + dz * dz;
+void Flower::showEaten(int index) {
+    if (!this->hasTexture) {
+        instanceColors[index] = color * 0.1f;
+    }
+    else {
+        this->color = vec3(0.1f); 
+        this->hasTexture = false;
+    }
 
-    if (distSq < detectionDist * detectionDist && this->edible[index]) {
+    // Upload change to GPU
+    glBindBuffer(GL_ARRAY_BUFFER, colorVBO);
+    glBufferSubData(GL_ARRAY_BUFFER, index * sizeof(vec3), sizeof(vec3), &instanceColors[index]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-        //collision
-        if (isRetracted) {
-			// slow snail down
-            snail->v *= 0.99f;
-            snail->P = snail->v * snail->m;
-            snail->w *= 0.99f;
-            snail->L = snail->w * snail->I_inv;
-            return true;
-        }
-        else {//eat
-            if (!this->hasTexture) {
-                instanceColors[index] = color * 0.1f;
-            }
-            else {
-                this->color = vec3(0.1f); 
-                this->hasTexture = false;
-            }
-
-            // Upload change to GPU
-            glBindBuffer(GL_ARRAY_BUFFER, colorVBO);
-            glBufferSubData(GL_ARRAY_BUFFER, index * sizeof(vec3), sizeof(vec3), &instanceColors[index]);
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-            this->edible[index] = false;
-            return true;
-        }
-    }
-    return false;
-}
\ No newline at end of file
+void Flower::updateInstance(int index, const mat4& matrix) {
+    instanceMatrices[index] = matrix;
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferSubData(GL_ARRAY_BUFFER, index * sizeof(mat4), sizeof(mat4), &instanceMatrices[index]);
+}
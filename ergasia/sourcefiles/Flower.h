@@ -2,15 +2,13 @@
 #include <vector>
 #include <glm/glm.hpp>
 #include <GL/glew.h>
-#include "heightmap.h"
-#include "Snail.h"
+#include "FlowerField.h"
 
-class Flower {
+class Flower : public FlowerField {
 public:
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec2> uvs;
     std::vector<glm::vec3> normals;
-    std::vector<glm::mat4> instanceMatrices;
 
     GLuint VAO, vertexVBO, uvVBO, normalVBO, instanceVBO;
     GLuint textureID;
@@ -18,19 +16,22 @@ public:
     std::vector<glm::vec3> instanceColors;
     GLuint colorVBO;
 
-    std::vector<bool> edible;
-
     glm::vec3 color;
     bool hasTexture;
     int vertexCount;
     int instanceCount;
 
-    Flower(const char* objPath, const char* mtlPath, Heightmap* terrain, int count, float scale, bool mtl, int mapSize);
+    Flower(const char* objPath, const char* mtlPath, HeightField* terrain, int count, float scale, bool mtl, int mapSize);
+    // instances from a saved world instead of random placement
+    Flower(const char* objPath, const char* mtlPath, const glm::mat4* matrices, int count, bool mtl);
     ~Flower();
 
     void draw(GLuint shaderProgram,bool drawShading);
-    bool checkCollisionByIndex(int index, Snail* snail, bool isRetracted);
+    // darkens an eaten instance; uploads, so only on the GL thread
+    void showEaten(int index);
+    void updateInstance(int index, const glm::mat4& matrix);
 private:
     void loadMTL(const char* path);
-    void generatePositions(Heightmap* terrain, int count, float scale, int mapSize);
+    bool loadModel(const char* objPath, const char* mtlPath, bool mtl);
+    void setupInstances();
 };
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "FlowerField.h"
+#include "SnailBody.h"
+#include <cstdlib>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+using namespace glm;
+
+FlowerField::FlowerField(HeightField* terrain, int count, float scale, int mapSize) {
+    generatePositions(terrain, count, scale, mapSize);
+    edible.resize(instanceMatrices.size(), true);
+}
+
+FlowerField::FlowerField(const mat4* matrices, int count) {
+    instanceMatrices.assign(matrices, matrices + count);
+    edible.resize(instanceMatrices.size(), true);
+}
+
+void FlowerField::generatePositions(HeightField* terrain, int count, float scale, int mapSize) {
+    instanceMatrices.clear();
+    for (int i = 0; i < count; i++) {
+        float x = (rand() % (mapSize * 2) - mapSize);
+        float z = (rand() % (mapSize * 2) - mapSize);
+        float y = terrain->getHeightAt(x, z);
+
+        mat4 model = translate(mat4(1.0f), vec3(x, y, z));
+
+        vec3 normal = normalize(terrain->getNormalAt(x, z)); 
+        vec3 up = vec3(0.0f, 1.0f, 0.0f); 
+
+        if (abs(dot(up, normal)) < 0.999f) {
+            vec3 axis = normalize(cross(up, normal));
+            float angle = acos(dot(up, normal));
+            model = rotate(model, angle, axis);
+        }
+        model = rotate(model, radians((float)(rand() % 360)), vec3(0, 1, 0));
+
+        model = glm::scale(model, vec3(scale));
+        instanceMatrices.push_back(model);
+    }
+}
+
+bool FlowerField::checkCollisionByIndex(int index, SnailBody* snail, bool isRetracted) {
+    if (index < 0 || index >= instanceMatrices.size()) return false;
+
+    
+    vec3 flowPos = vec3(instanceMatrices[index][3]);
+    float combinedRadius = snail->radius + 0.5f; 
+    float detectionDist = combinedRadius + 0.1f;
+
+    float dx = snail->x.x - flowPos.x;
+    float dz = snail->x.z - flowPos.z;
+    float distSq = dx * dx + dz * dz;
+
+    if (distSq < detectionDist * detectionDist && this->edible[index]) {
+
+        //collision
+        if (isRetracted) {
+			// slow snail down
+            snail->v *= 0.99f;
+            snail->P = snail->v * snail->m;
+            snail->w *= 0.99f;
+            snail->L *= 0.99f;
+            return true;
+        }
+        else {//eat, showEaten() darkens it
+            this->edible[index] = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FlowerField::updateInstance(int index, const mat4& matrix) {
+    instanceMatrices[index] = matrix;
+}
@@ -0,0 +1,31 @@
+#ifndef FLOWER_FIELD_H
+#define FLOWER_FIELD_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "HeightField.h"
+
+class SnailBody;
+
+/** Where one kind of flower grows and which are still there, Flower draws them */
+class FlowerField {
+public:
+    std::vector<glm::mat4> instanceMatrices;
+    std::vector<bool> edible;
+
+    // count instances scattered over [-mapSize, mapSize)^2, standing on terrain
+    FlowerField(HeightField* terrain, int count, float scale, int mapSize);
+    // instances from a saved world instead of random placement
+    FlowerField(const glm::mat4* matrices, int count);
+    virtual ~FlowerField() {}
+
+    // retracted: slows the snail down; otherwise eats the instance, true when it touched one
+    bool checkCollisionByIndex(int index, SnailBody* snail, bool isRetracted);
+    // moves an instance, Flower also uploads it
+    virtual void updateInstance(int index, const glm::mat4& matrix);
+
+private:
+    void generatePositions(HeightField* terrain, int count, float scale, int mapSize);
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef HEIGHT_FIELD_H
+#define HEIGHT_FIELD_H
+
+#include <glm/glm.hpp>
+
+/** The ground under one point, see HeightField::sample */
+struct GroundSample {
+    float height;
+    /** unit length */
+    glm::vec3 normal;
+    float type;
+};
+
+/**
+ * Anything the snail can stand on. Gameplay and collision code only needs
+ * these queries, so it works the same on the single Heightmap and on the
+ * streamed tile terrain.
+ */
+class HeightField {
+public:
+    virtual ~HeightField() {}
+    virtual float getHeightAt(float worldX, float worldZ) = 0;
+    virtual glm::vec3 getNormalAt(float worldX, float worldZ) = 0;
+    /** 1 rock, 0 grass, -1 bouncy, interpolated in between */
+    virtual float getGroundTypeAt(float worldX, float worldZ) = 0;
+    /** Upper bound on how much getHeightAt() rises per unit of horizontal distance */
+    virtual float maxSlope() = 0;
+
+    /** All three queries at once, for code that needs them together */
+    GroundSample sample(float worldX, float worldZ) {
+        GroundSample s;
+        s.height = getHeightAt(worldX, worldZ);
+        s.normal = glm::normalize(getNormalAt(worldX, worldZ));
+        s.type = getGroundTypeAt(worldX, worldZ);
+        return s;
+    }
+};
+
+#endif
@@ -0,0 +1,464 @@
+#include "HeightGrid.h"
+#include "Random.h"
+#include "Parallel.h"
+#include "MaterialLayer.h"
+#include "HeightStore.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <iostream>
+#include <mutex>
+
+using namespace std;
+using namespace glm;
+
+HeightGrid::HeightGrid(const HillAlgorithmParameters& params)
+    : HeightGrid(generate(params), params.rows, params.columns, params.scalar, params.scalarY)
+{
+}
+
+HeightGrid::HeightGrid(int rows, int cols, float scalar, float scalarY, const float* heights, const unsigned char* materials)
+    : HeightGrid(fromGrids(rows, cols, heights, materials), rows, cols, scalar, scalarY)
+{
+}
+
+HeightGrid::HeightGrid(const HeightStore* store, int rows, int cols, float scalar, float scalarY)
+    : HeightGrid(fromStore(store, rows, cols), rows, cols, scalar, scalarY)
+{
+    this->store = store;
+    storeGradient = gradientOf(store, scalar, scalarY);
+}
+
+HeightGrid::HeightGrid(const GridData& data, int rows, int cols, float scalar, float scalarY)
+{
+    this->scalar = scalar;
+    this->scalarY = scalarY;
+    this->rows = rows;
+    this->cols = cols;
+    this->position = glm::vec3(0.0f, 0.0f, 0.0f);
+    this->heightGrid = data.grid;
+    this->materials = data.materials;
+    this->store = nullptr;
+    pyramid.build(heightGrid);
+    SampleRect all = { 0, 0, rows, cols };
+    gridGradient = gradientOver(all);
+    storeGradient = vec2(0.0f);
+}
+
+HeightGrid::GridData HeightGrid::generate(const HillAlgorithmParameters& params)
+{
+    auto startTime = chrono::high_resolution_clock::now();
+    GridData data;
+    // Initialize grids
+    std::vector<std::vector<float>> grid(params.rows, std::vector<float>(params.columns, 0.0f));
+
+    // Each hill draws from its own counter-based stream, so hill i is the
+    // same no matter which thread stamps it.
+    struct Hill { int cR, cC, rad; float h; };
+    std::vector<Hill> hills(params.numHills);
+    for (int i = 0; i < params.numHills; i++) {
+        CounterRng rng(params.seed, i);
+        hills[i].cR = rng.uniformInt(0, params.rows - 1);
+        hills[i].cC = rng.uniformInt(0, params.columns - 1);
+        hills[i].rad = rng.uniformInt(params.hillRadiusMin, params.hillRadiusMax);
+        hills[i].h = rng.uniform(params.hillMinHeight, params.hillMaxHeight);
+    }
+
+    //gen Hills: every thread owns a band of rows and applies the hills that
+    //overlap it in index order, which keeps the clamping order of the serial loop
+    parallelFor(0, params.rows, [&](int r0, int r1) {
+        if (params.noise.amplitude != 0.0f) {
+            for (int r = r0; r < r1; r++) {
+                fbmRow(0.0f, 1.0f, (float)r, params.columns, params.seed, params.noise, &grid[r][0]);
+            }
+        }
+        for (const Hill& hill : hills) {
+            int rBegin = std::max(hill.cR - hill.rad, r0);
+            int rEnd = std::min(hill.cR + hill.rad, r1);
+            int cBegin = std::max(hill.cC - hill.rad, 0);
+            int cEnd = std::min(hill.cC + hill.rad, params.columns);
+            float r2 = float(hill.rad * hill.rad);
+            for (int r = rBegin; r < rEnd; r++) {
+                float dy = float(hill.cR - r);
+                for (int c = cBegin; c < cEnd; c++) {
+                    float dx = float(hill.cC - c);
+                    float hVal = (r2 - dx * dx - dy * dy) / 5;
+                    if (hVal > 0.0f) {
+                        grid[r][c] += hill.h * (hVal / r2);
+                        if (grid[r][c] > 1.0f) grid[r][c] = 1.0f;
+                    }
+                }
+            }
+        }
+    }, 16);
+
+    classifyMaterials(grid, data.materials);
+
+    data.grid = std::move(grid);
+
+    if (params.verbose) {
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - startTime);
+        cout << "Terrain generated in " << elapsed.count() << " ms (seed " << params.seed << ", "
+            << workerCount() << " threads)" << endl;
+    }
+    return data;
+}
+
+void HeightGrid::classifyMaterials(const vector<vector<float>>& grid, vector<unsigned char>& materials) {
+    int rows = (int)grid.size();
+    int cols = rows > 0 ? (int)grid[0].size() : 0;
+    // class flags per sample, rock and bouncy interleaved
+    std::vector<unsigned char> classes((size_t)rows * cols * MATERIAL_CHANNELS);
+    parallelFor(0, rows, [&](int r0, int r1) {
+        for (int r = r0; r < r1; r++) {
+            for (int c = 0; c < cols; c++) {
+                float height = grid[r][c];
+                unsigned char* cls = &classes[((size_t)r * cols + c) * MATERIAL_CHANNELS];
+
+                //bouncy <0
+                // Rock (Value <0.07)
+                // grass psila >=0.07
+                cls[0] = height >= 0.0f && height < 0.07f ? 1 : 0;  // Rock Area
+                cls[1] = height < 0.0f ? 1 : 0;                     // Bouncy Area
+            }
+        }
+    }, 16);
+
+    // 3x3 blur into weights, the border keeps its unblurred class
+    materials.resize(classes.size());
+    blurMaterials(&classes[0], rows, cols, &materials[0]);
+}
+
+HeightGrid::GridData HeightGrid::fromStore(const HeightStore* store, int rows, int cols) {
+    GridData data;
+    data.grid.assign(rows, vector<float>(cols));
+    float stepR = (float)(store->height() - 1) / (rows - 1);
+    float stepC = (float)(store->width() - 1) / (cols - 1);
+    parallelFor(0, rows, [&](int r0, int r1) {
+        for (int r = r0; r < r1; r++)
+            for (int c = 0; c < cols; c++)
+                data.grid[r][c] = store->bilinear(r * stepR, c * stepC);
+    }, 16);
+    classifyMaterials(data.grid, data.materials);
+    return data;
+}
+
+HeightGrid::GridData HeightGrid::fromGrids(int rows, int cols, const float* heights, const unsigned char* materials) {
+    GridData data;
+    data.grid.resize(rows);
+    for (int r = 0; r < rows; r++) {
+        data.grid[r].assign(heights + r * cols, heights + (r + 1) * cols);
+    }
+    data.materials.assign(materials, materials + (size_t)rows * cols * MATERIAL_CHANNELS);
+    return data;
+}
+
+float HeightGrid::getHeightAt(float worldX, float worldZ) {
+    float localX = (worldX - position.x) / scalar;
+    float localZ = (worldZ - position.z) / scalar;
+    float u = localX + 0.5f;
+    float v = localZ + 0.5f;
+    if (u < 0.0f || u >= 1.0f || v < 0.0f || v >= 1.0f) return -99999.0f;
+    if (store) return store->bilinear(v * (store->height() - 1), u * (store->width() - 1)) * scalarY + position.y;
+
+    float r_f = v * (rows - 1);
+    float c_f = u * (cols - 1);
+    int r = (int)r_f;
+    int c = (int)c_f;
+    if (r < 0) r = 0; if (r >= rows - 1) r = rows - 2;
+    if (c < 0) c = 0; if (c >= cols - 1) c = cols - 2;
+
+    // Digrammikh parembolh
+    float h00 = heightGrid[r][c];     float h10 = heightGrid[r + 1][c];
+    float h01 = heightGrid[r][c + 1]; float h11 = heightGrid[r + 1][c + 1];
+    float percentU = c_f - c; float percentV = r_f - r;
+    float hTop = h00 * (1.0f - percentU) + h01 * percentU;
+    float hBot = h10 * (1.0f - percentU) + h11 * percentU;
+    return (hTop * (1.0f - percentV) + hBot * percentV) * scalarY + position.y;
+}
+
+float HeightGrid::getGroundTypeAt(float worldX, float worldZ) {
+    float localX = (worldX - position.x) / scalar;
+    float localZ = (worldZ - position.z) / scalar;
+    float u = localX + 0.5f;
+    float v = localZ + 0.5f;
+
+    if (u < 0.0f || u >= 1.0f || v < 0.0f || v >= 1.0f) return 0.0f; 
+
+    // nearest sample, the weights are already smooth
+    int r = (int)(v * (rows - 1) + 0.5f);
+    int c = (int)(u * (cols - 1) + 0.5f);
+    return materialType(&materials[((size_t)r * cols + c) * MATERIAL_CHANNELS]);
+}
+
+vec3 HeightGrid::getNormalAt(float worldX, float worldZ) {
+    float localX = (worldX - position.x) / scalar;
+    float localZ = (worldZ - position.z) / scalar;
+    if (store) {
+        int r = (int)((localZ + 0.5f) * (store->height() - 1));
+        int c = (int)((localX + 0.5f) * (store->width() - 1));
+        float stepX = scalar / (float)(store->width() - 1);
+        float stepZ = scalar / (float)(store->height() - 1);
+        vec3 tangentX(2.0f * stepX, (store->at(r, c + 1) - store->at(r, c - 1)) * scalarY, 0.0f);
+        vec3 tangentZ(0.0f, (store->at(r + 1, c) - store->at(r - 1, c)) * scalarY, 2.0f * stepZ);
+        return normalize(cross(tangentZ, tangentX));
+    }
+    int r = (int)((localZ + 0.5f) * (rows - 1));
+    int c = (int)((localX + 0.5f) * (cols - 1));
+    if (r < 1) r = 1; if (r >= rows - 1) r = rows - 2;
+    if (c < 1) c = 1; if (c >= cols - 1) c = cols - 2;
+    float hL = heightGrid[r][c - 1]; float hR = heightGrid[r][c + 1];
+    float hD = heightGrid[r - 1][c]; float hU = heightGrid[r + 1][c];
+    float unitStep = scalar / (float)(cols - 1);
+    vec3 tangentX(2.0f * unitStep, (hR - hL) * scalarY, 0.0f);
+    vec3 tangentZ(0.0f, (hU - hD) * scalarY, 2.0f * unitStep);
+    return normalize(cross(tangentZ, tangentX));
+}
+// Inside a bilinear cell the slope along x lies between the slopes of its two
+// x edges, likewise for z, so the steepest sample differences bound the
+// gradient everywhere in between.
+float HeightGrid::maxSlope() {
+    return length(store ? storeGradient : gridGradient);
+}
+
+vec2 HeightGrid::gradientOver(const SampleRect& rect) const {
+    float riseX = 0.0f, riseZ = 0.0f;
+    for (int r = rect.r0; r < rect.r1; r++) {
+        for (int c = rect.c0; c < rect.c1; c++) {
+            if (c + 1 < cols) riseX = std::max(riseX, fabs(heightGrid[r][c + 1] - heightGrid[r][c]));
+            if (r + 1 < rows) riseZ = std::max(riseZ, fabs(heightGrid[r + 1][c] - heightGrid[r][c]));
+        }
+    }
+    return vec2(riseX * (cols - 1), riseZ * (rows - 1)) * (scalarY / scalar);
+}
+
+vec2 HeightGrid::gradientOf(const HeightStore* store, float scalar, float scalarY) {
+    int w = store->width(), h = store->height();
+    mutex resultMutex;
+    float riseX = 0.0f, riseZ = 0.0f;
+    parallelFor(0, h, [&](int r0, int r1) {
+        float bandX = 0.0f, bandZ = 0.0f;
+        for (int r = r0; r < r1; r++) {
+            for (int c = 0; c < w; c++) {
+                float s = store->at(r, c);
+                bandX = std::max(bandX, fabs(store->at(r, c + 1) - s));
+                bandZ = std::max(bandZ, fabs(store->at(r + 1, c) - s));
+            }
+        }
+        lock_guard<mutex> lock(resultMutex);
+        riseX = std::max(riseX, bandX);
+        riseZ = std::max(riseZ, bandZ);
+    }, 64);
+    return vec2(riseX * (w - 1), riseZ * (h - 1)) * (scalarY / scalar);
+}
+
+void HeightGrid::updatePyramid(int r0, int c0, int r1, int c1) {
+    pyramid.update(heightGrid, r0, c0, r1, c1);
+}
+
+vec3 HeightGrid::gridVertex(int r, int c) const {
+    return vec3(position.x + (-0.5f + (float)c / (cols - 1)) * scalar,
+                position.y + heightGrid[r][c] * scalarY,
+                position.z + (-0.5f + (float)r / (rows - 1)) * scalar);
+}
+
+// clips the parameter range of o + t * d to [lo, hi] along one axis
+static bool clipSlab(float o, float d, float lo, float hi, float& t0, float& t1) {
+    if (d == 0.0f) return o >= lo && o <= hi;
+    float a = (lo - o) / d, b = (hi - o) / d;
+    if (a > b) swap(a, b);
+    t0 = std::max(t0, a);
+    t1 = std::min(t1, b);
+    return t0 <= t1;
+}
+
+// Moller-Trumbore, two sided
+static bool rayTriangle(const vec3& o, const vec3& d, const vec3& a, const vec3& b, const vec3& c, float& t) {
+    vec3 e1 = b - a, e2 = c - a;
+    vec3 p = cross(d, e2);
+    float det = dot(e1, p);
+    if (fabs(det) < 1e-12f) return false;
+    float inv = 1.0f / det;
+    vec3 s = o - a;
+    float u = dot(s, p) * inv;
+    if (u < 0.0f || u > 1.0f) return false;
+    vec3 q = cross(s, e1);
+    float v = dot(d, q) * inv;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    t = dot(e2, q) * inv;
+    return true;
+}
+
+bool HeightGrid::hitCell(const RayContext& ray, int i, int j, float t0, float t1, RayHit& hit) const {
+    // same split as the mesh: (j,i) (j+1,i) (j,i+1) and (j+1,i) (j+1,i+1) (j,i+1)
+    vec3 a = gridVertex(j, i), b = gridVertex(j + 1, i), c = gridVertex(j, i + 1), d = gridVertex(j + 1, i + 1);
+    float slack = 1e-4f * (t1 - t0) + 1e-6f;
+    float best = numeric_limits<float>::max();
+    vec3 n;
+    float t;
+    if (rayTriangle(ray.origin, ray.dir, a, b, c, t) && t >= t0 - slack && t <= t1 + slack && t < best) {
+        best = t;
+        n = cross(b - a, c - a);
+    }
+    if (rayTriangle(ray.origin, ray.dir, b, d, c, t) && t >= t0 - slack && t <= t1 + slack && t < best) {
+        best = t;
+        n = cross(d - b, c - b);
+    }
+    if (best == numeric_limits<float>::max()) return false;
+
+    n = normalize(n);
+    if (n.y < 0.0f) n = -n;
+    hit.hit = true;
+    hit.t = std::max(best, 0.0f);
+    hit.point = ray.origin + ray.dir * hit.t;
+    hit.normal = n;
+    return true;
+}
+
+// 2D DDA over the cells [i0, i1) x [j0, j1) of one pyramid level, in ray
+// order. Cells whose height bounds the ray misses over its span are skipped,
+// the rest are refined on the level below.
+bool HeightGrid::marchLevel(const RayContext& ray, int level, float t0, float t1, int i0, int j0, int i1, int j1, RayHit& hit) const {
+    const HeightPyramid::Level& L = pyramid.levels[level];
+    const float inf = numeric_limits<float>::max();
+    float size = (float)(1 << level);
+
+    vec2 p = ray.gridOrigin + ray.gridDir * t0;
+    int i = glm::clamp((int)floor(p.x / size), i0, i1 - 1);
+    int j = glm::clamp((int)floor(p.y / size), j0, j1 - 1);
+
+    int stepI = ray.gridDir.x > 0.0f ? 1 : (ray.gridDir.x < 0.0f ? -1 : 0);
+    int stepJ = ray.gridDir.y > 0.0f ? 1 : (ray.gridDir.y < 0.0f ? -1 : 0);
+    float nextI = stepI != 0 ? ((i + (stepI > 0 ? 1 : 0)) * size - ray.gridOrigin.x) / ray.gridDir.x : inf;
+    float nextJ = stepJ != 0 ? ((j + (stepJ > 0 ? 1 : 0)) * size - ray.gridOrigin.y) / ray.gridDir.y : inf;
+    float deltaI = stepI != 0 ? size / fabs(ray.gridDir.x) : inf;
+    float deltaJ = stepJ != 0 ? size / fabs(ray.gridDir.y) : inf;
+
+    float t = t0;
+    while (true) {
+        float tEnd = std::min(std::min(nextI, nextJ), t1);
+        float ya = ray.origin.y + ray.dir.y * t;
+        float yb = ray.origin.y + ray.dir.y * tEnd;
+        float lo = L.minH[j * L.width + i] * scalarY + position.y;
+        float hi = L.maxH[j * L.width + i] * scalarY + position.y;
+        if (std::min(ya, yb) <= hi && std::max(ya, yb) >= lo) {
+            if (level == 0) {
+                if (hitCell(ray, i, j, t, tEnd, hit)) return true;
+            }
+            else {
+                const HeightPyramid::Level& C = pyramid.levels[level - 1];
+                if (marchLevel(ray, level - 1, t, tEnd, 2 * i, 2 * j,
+                               std::min(2 * i + 2, C.width), std::min(2 * j + 2, C.height), hit)) return true;
+            }
+        }
+        if (tEnd >= t1) break;
+        t = tEnd;
+        if (nextI < nextJ) { i += stepI; nextI += deltaI; }
+        else { j += stepJ; nextJ += deltaJ; }
+        if (i < i0 || i >= i1 || j < j0 || j >= j1) break;
+    }
+    return false;
+}
+
+bool HeightGrid::raycast(const vec3& origin, const vec3& dir, float maxT, RayHit& hit) {
+    hit.hit = false;
+    hit.t = maxT;
+    if (pyramid.levels.empty()) return false;
+
+    // grid space: one unit per cell, x along columns, y along rows
+    float sx = (cols - 1) / scalar, sz = (rows - 1) / scalar;
+    RayContext ray;
+    ray.origin = origin;
+    ray.dir = dir;
+    ray.gridOrigin = vec2((origin.x - position.x) * sx + 0.5f * (cols - 1), (origin.z - position.z) * sz + 0.5f * (rows - 1));
+    ray.gridDir = vec2(dir.x * sx, dir.z * sz);
+
+    float t0 = 0.0f, t1 = maxT;
+    if (!clipSlab(ray.gridOrigin.x, ray.gridDir.x, 0.0f, (float)(cols - 1), t0, t1)) return false;
+    if (!clipSlab(ray.gridOrigin.y, ray.gridDir.y, 0.0f, (float)(rows - 1), t0, t1)) return false;
+
+    int top = pyramid.top();
+    return marchLevel(ray, top, t0, t1, 0, 0, pyramid.levels[top].width, pyramid.levels[top].height, hit);
+}
+
+bool HeightGrid::intersectSegment(const vec3& a, const vec3& b, RayHit& hit) {
+    return raycast(a, b - a, 1.0f, hit);
+}
+
+bool HeightGrid::lineOfSight(const vec3& a, const vec3& b) {
+    RayHit hit;
+    return !intersectSegment(a, b, hit);
+}
+
+void HeightGrid::raycastBatch(const vector<Ray>& rays, vector<RayHit>& hits) {
+    hits.resize(rays.size());
+    parallelFor(0, (int)rays.size(), [&](int b, int e) {
+        for (int k = b; k < e; k++) raycast(rays[k].origin, rays[k].dir, rays[k].maxT, hits[k]);
+    }, 256);
+}
+
+void HeightGrid::segmentBatch(const vector<vec3>& from, const vector<vec3>& to, vector<RayHit>& hits) {
+    hits.resize(from.size());
+    parallelFor(0, (int)from.size(), [&](int b, int e) {
+        for (int k = b; k < e; k++) intersectSegment(from[k], to[k], hits[k]);
+    }, 256);
+}
+
+HeightGrid::SampleRect HeightGrid::deform(const vec3& center, float radius, const function<float(float)>& profile) {
+    SampleRect edit;
+    float stepX = scalar / (float)(cols - 1), stepZ = scalar / (float)(rows - 1);
+    float fc = ((center.x - position.x) / scalar + 0.5f) * (cols - 1);
+    float fr = ((center.z - position.z) / scalar + 0.5f) * (rows - 1);
+    edit.c0 = std::max((int)floor(fc - radius / stepX), 0);
+    edit.c1 = std::min((int)ceil(fc + radius / stepX) + 1, cols);
+    edit.r0 = std::max((int)floor(fr - radius / stepZ), 0);
+    edit.r1 = std::min((int)ceil(fr + radius / stepZ) + 1, rows);
+    if (edit.empty()) return edit;
+
+    for (int r = edit.r0; r < edit.r1; r++) {
+        float dz = (r - fr) * stepZ;
+        for (int c = edit.c0; c < edit.c1; c++) {
+            float dx = (c - fc) * stepX;
+            float d = sqrt(dx * dx + dz * dz);
+            if (d < radius) heightGrid[r][c] += profile(d / radius) / scalarY;
+        }
+    }
+    // queries follow the edited grid from now on
+    store = nullptr;
+    pyramid.update(heightGrid, edit.r0, edit.c0, edit.r1, edit.c1);
+
+    // normals and material windows reach one sample further
+    SampleRect dirty;
+    dirty.r0 = std::max(edit.r0 - 1, 0); dirty.r1 = std::min(edit.r1 + 1, rows);
+    dirty.c0 = std::max(edit.c0 - 1, 0); dirty.c1 = std::min(edit.c1 + 1, cols);
+    updateMaterials(dirty);
+    gridGradient = glm::max(gridGradient, gradientOver(dirty));
+
+    return dirty;
+}
+
+void HeightGrid::updateMaterials(const SampleRect& rect) {
+    auto rockAt = [&](int r, int c) { float h = heightGrid[r][c]; return h >= 0.0f && h < 0.07f ? 1 : 0; };
+    auto bouncyAt = [&](int r, int c) { return heightGrid[r][c] < 0.0f ? 1 : 0; };
+    for (int r = rect.r0; r < rect.r1; r++) {
+        for (int c = rect.c0; c < rect.c1; c++) {
+            unsigned char* w = &materials[((size_t)r * cols + c) * MATERIAL_CHANNELS];
+            if (r == 0 || c == 0 || r == rows - 1 || c == cols - 1) {
+                // the border keeps its unblurred class
+                w[0] = rockAt(r, c) ? 255 : 0;
+                w[1] = bouncyAt(r, c) ? 255 : 0;
+                continue;
+            }
+            int rock = 0, bouncy = 0;
+            for (int ir = -1; ir <= 1; ir++) {
+                for (int ic = -1; ic <= 1; ic++) {
+                    rock += rockAt(r + ir, c + ic);
+                    bouncy += bouncyAt(r + ir, c + ic);
+                }
+            }
+            w[0] = MATERIAL_WINDOW_WEIGHT[rock];
+            w[1] = MATERIAL_WINDOW_WEIGHT[bouncy];
+        }
+    }
+}
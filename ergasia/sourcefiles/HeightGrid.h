@@ -0,0 +1,129 @@
+#ifndef HEIGHT_GRID_H
+#define HEIGHT_GRID_H
+
+#include <vector>
+#include <functional>
+#include <glm/glm.hpp>
+#include "TerrainNoise.h"
+#include "HeightField.h"
+#include "HeightPyramid.h"
+
+class HeightStore;
+
+/**
+ * The single-map terrain as data: heights, material weights and the height
+ * pyramid, with every query and edit the game needs. Nothing here touches
+ * GL; Heightmap adds the mesh and textures on top.
+ */
+class HeightGrid : public HeightField {
+public:
+    struct HillAlgorithmParameters {
+        HillAlgorithmParameters(int rows, int columns, int numHills, int rMin, int rMax, float hMin, float hMax, float s, float sY, unsigned int seed = 0)
+            : rows(rows), columns(columns), numHills(numHills), hillRadiusMin(rMin), hillRadiusMax(rMax), hillMinHeight(hMin), hillMaxHeight(hMax), scalar(s), scalarY(sY), seed(seed), buildMesh(true), verbose(true){
+        }
+        int rows, columns, numHills, hillRadiusMin, hillRadiusMax;
+        float hillMinHeight, hillMaxHeight,scalar, scalarY;
+        // same seed + parameters -> bit-identical world, independent of thread count
+        unsigned int seed;
+        // optional fBm/ridged layer added under the hills
+        NoiseParameters noise;
+        // false when the HeightfieldRenderer draws the terrain from a texture
+        bool buildMesh;
+        // print how long generation took
+        bool verbose;
+    };
+    float scalar, scalarY;
+    glm::vec3 position;
+
+    std::vector<std::vector<float>> heightGrid;
+    // material weights 0..255 per sample, row-major pairs of rock and bouncy
+    // (grass is the rest), see MaterialLayer.h; also the RG8 splat texels
+    std::vector<unsigned char> materials;
+
+    int rows, cols;
+
+    // full-resolution heights for DEM terrain (queries sample it, heightGrid is
+    // the mesh-resolution copy), null for generated terrain
+    const HeightStore* store;
+
+    // min/max bounds of heightGrid, rebuilt by the constructor and updatePyramid()
+    HeightPyramid pyramid;
+    // steepest rise per world unit along x and z between neighbouring samples
+    // of heightGrid (raised by deform(), never lowered) and of the store
+    glm::vec2 gridGradient, storeGradient;
+
+    struct Ray {
+        glm::vec3 origin, dir;
+        float maxT;
+    };
+    // t is in units of dir, so a normalized dir gives world distance
+    struct RayHit {
+        bool hit;
+        float t;
+        glm::vec3 point, normal;
+    };
+
+    HeightGrid(const HillAlgorithmParameters& params);
+    // rebuild from stored row-major heights and material weights (world files)
+    HeightGrid(int rows, int cols, float scalar, float scalarY, const float* heights, const unsigned char* materials);
+    // DEM terrain: heightGrid and materials are a rows x cols resampling of the store, which must outlive this
+    HeightGrid(const HeightStore* store, int rows, int cols, float scalar, float scalarY);
+    virtual ~HeightGrid() {}
+
+    float getHeightAt(float worldX, float worldZ);
+    glm::vec3 getNormalAt(float worldX, float worldZ);
+    float getGroundTypeAt(float worldX, float worldZ);
+    float maxSlope();
+
+    // first hit of origin + t * dir with the terrain triangles, 0 <= t <= maxT
+    bool raycast(const glm::vec3& origin, const glm::vec3& dir, float maxT, RayHit& hit);
+    // segment a -> b, hit.t is the fraction along it
+    bool intersectSegment(const glm::vec3& a, const glm::vec3& b, RayHit& hit);
+    bool lineOfSight(const glm::vec3& a, const glm::vec3& b);
+    // independent queries, spread over worker threads when there are many
+    void raycastBatch(const std::vector<Ray>& rays, std::vector<RayHit>& hits);
+    void segmentBatch(const std::vector<glm::vec3>& from, const std::vector<glm::vec3>& to, std::vector<RayHit>& hits);
+    // call after editing heightGrid samples rows [r0, r1), columns [c0, c1)
+    void updatePyramid(int r0, int c0, int r1, int c1);
+
+    // samples rows [r0, r1), columns [c0, c1)
+    struct SampleRect {
+        int r0, c0, r1, c1;
+        bool empty() const { return r0 >= r1 || c0 >= c1; }
+    };
+    // Raises the terrain by profile(d / radius) world units at horizontal
+    // distance d < radius from center (negative dents it). Updates the
+    // pyramid and materials of the touched samples only and returns them
+    // (one sample wider than the edit, for the normals), so callers can
+    // refresh what sits on top. A DEM store is detached: queries use the
+    // edited grid afterwards.
+    virtual SampleRect deform(const glm::vec3& center, float radius, const std::function<float(float)>& profile);
+
+private:
+    // PRIVATE struct to hold data temporarily
+    struct GridData {
+        std::vector<std::vector<float>> grid;
+        std::vector<unsigned char> materials;
+    };
+
+    HeightGrid(const GridData& data, int rows, int cols, float scalar, float scalarY);
+
+    struct RayContext {
+        glm::vec3 origin, dir;
+        glm::vec2 gridOrigin, gridDir;
+    };
+    bool marchLevel(const RayContext& ray, int level, float t0, float t1, int i0, int j0, int i1, int j1, RayHit& hit) const;
+    bool hitCell(const RayContext& ray, int i, int j, float t0, float t1, RayHit& hit) const;
+    glm::vec3 gridVertex(int r, int c) const;
+
+    static GridData generate(const HillAlgorithmParameters& params);
+    static GridData fromStore(const HeightStore* store, int rows, int cols);
+    static void classifyMaterials(const std::vector<std::vector<float>>& grid, std::vector<unsigned char>& materials);
+    static GridData fromGrids(int rows, int cols, const float* heights, const unsigned char* materials);
+    void updateMaterials(const SampleRect& rect);
+    // the gradient bound over the samples of rect
+    glm::vec2 gradientOver(const SampleRect& rect) const;
+    static glm::vec2 gradientOf(const HeightStore* store, float scalar, float scalarY);
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "HeightPyramid.h"
+#include <algorithm>
+
+using namespace std;
+
+void HeightPyramid::build(const vector<vector<float>>& grid) {
+    levels.clear();
+    int rows = (int)grid.size();
+    int cols = rows > 0 ? (int)grid[0].size() : 0;
+    if (rows < 2 || cols < 2) return;
+
+    Level base;
+    base.width = cols - 1;
+    base.height = rows - 1;
+    base.minH.resize(base.width * base.height);
+    base.maxH.resize(base.width * base.height);
+    levels.push_back(base);
+    updateLevel0(grid, 0, 0, base.height, base.width);
+
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        Level next;
+        next.width = (levels.back().width + 1) / 2;
+        next.height = (levels.back().height + 1) / 2;
+        next.minH.resize(next.width * next.height);
+        next.maxH.resize(next.width * next.height);
+        levels.push_back(next);
+        updateLevel(top(), 0, 0, next.height, next.width);
+    }
+}
+
+void HeightPyramid::update(const vector<vector<float>>& grid, int r0, int c0, int r1, int c1) {
+    if (levels.empty()) return;
+    // a sample belongs to the (up to) four quads around it
+    int j0 = max(r0 - 1, 0), i0 = max(c0 - 1, 0);
+    int j1 = min(r1, levels[0].height), i1 = min(c1, levels[0].width);
+    if (j0 >= j1 || i0 >= i1) return;
+    updateLevel0(grid, j0, i0, j1, i1);
+    for (int l = 1; l < (int)levels.size(); l++) {
+        j0 /= 2; i0 /= 2;
+        j1 = (j1 + 1) / 2; i1 = (i1 + 1) / 2;
+        updateLevel(l, j0, i0, j1, i1);
+    }
+}
+
+void HeightPyramid::updateLevel0(const vector<vector<float>>& grid, int j0, int i0, int j1, int i1) {
+    Level& L = levels[0];
+    for (int j = j0; j < j1; j++) {
+        for (int i = i0; i < i1; i++) {
+            float a = grid[j][i], b = grid[j][i + 1], c = grid[j + 1][i], d = grid[j + 1][i + 1];
+            L.minH[j * L.width + i] = min(min(a, b), min(c, d));
+            L.maxH[j * L.width + i] = max(max(a, b), max(c, d));
+        }
+    }
+}
+
+void HeightPyramid::updateLevel(int level, int j0, int i0, int j1, int i1) {
+    const Level& C = levels[level - 1];
+    Level& L = levels[level];
+    for (int j = j0; j < j1; j++) {
+        for (int i = i0; i < i1; i++) {
+            float lo = C.minH[(2 * j) * C.width + 2 * i];
+            float hi = C.maxH[(2 * j) * C.width + 2 * i];
+            for (int cj = 2 * j; cj < min(2 * j + 2, C.height); cj++) {
+                for (int ci = 2 * i; ci < min(2 * i + 2, C.width); ci++) {
+                    lo = min(lo, C.minH[cj * C.width + ci]);
+                    hi = max(hi, C.maxH[cj * C.width + ci]);
+                }
+            }
+            L.minH[j * L.width + i] = lo;
+            L.maxH[j * L.width + i] = hi;
+        }
+    }
+}
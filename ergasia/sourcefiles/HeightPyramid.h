@@ -0,0 +1,29 @@
+#ifndef HEIGHT_PYRAMID_H
+#define HEIGHT_PYRAMID_H
+
+#include <vector>
+
+/**
+ * Min/max mip pyramid over the cells of a height grid. Level 0 holds the
+ * bounds of each quad (its four corner samples), every further level the
+ * bounds of 2x2 cells below it, up to a single root cell.
+ */
+class HeightPyramid {
+public:
+    struct Level {
+        int width, height;
+        std::vector<float> minH, maxH;
+    };
+    std::vector<Level> levels;
+
+    void build(const std::vector<std::vector<float>>& grid);
+    /** Refreshes the cells touching samples rows [r0, r1), columns [c0, c1) */
+    void update(const std::vector<std::vector<float>>& grid, int r0, int c0, int r1, int c1);
+    int top() const { return (int)levels.size() - 1; }
+
+private:
+    void updateLevel0(const std::vector<std::vector<float>>& grid, int j0, int i0, int j1, int i1);
+    void updateLevel(int level, int j0, int i0, int j1, int i1);
+};
+
+#endif
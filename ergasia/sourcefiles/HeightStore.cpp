@@ -0,0 +1,88 @@
+#include "HeightStore.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+static const char STORE_MAGIC[4] = { 'S', 'S', 'H', 'S' };
+static const uint32_t STORE_VERSION = 1;
+
+static int log2Exact(int x) {
+    int s = 0;
+    while ((1 << s) < x) s++;
+    return (1 << s) == x ? s : -1;
+}
+
+HeightStore::HeightStore(const string& path) : file(path) {
+    header = reinterpret_cast<const Header*>(file.data());
+    bool valid = file.size() >= sizeof(Header) && memcmp(header->magic, STORE_MAGIC, 4) == 0 &&
+                 header->version == STORE_VERSION && header->width >= 2 && header->height >= 2;
+    if (valid) {
+        shift = log2Exact(header->tileSize);
+        mask = header->tileSize - 1;
+        stride = header->tileSize + 1;
+        tileSamples = (size_t)stride * stride;
+        valid = shift >= 0 &&
+                file.size() >= sizeof(Header) + (size_t)header->tilesX * header->tilesY * tileSamples * sizeof(uint16_t);
+    }
+    if (!valid) throw runtime_error("Not a valid height store: " + path);
+    samples = reinterpret_cast<const uint16_t*>(file.data() + sizeof(Header));
+}
+
+void HeightStore::write(const string& path, int width, int height, int tileSize, float scale, float offset,
+                        const function<void(int, uint16_t*)>& row) {
+    if (width < 2 || height < 2) throw runtime_error("Height store needs at least 2x2 samples");
+    if (log2Exact(tileSize) < 0) throw runtime_error("Height store tile size must be a power of two");
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STORE_MAGIC, 4);
+    header.version = STORE_VERSION;
+    header.width = width;
+    header.height = height;
+    header.tileSize = tileSize;
+    // tiles cover the cells, the last sample row/column is the apron of the last tile
+    header.tilesX = (width - 2) / tileSize + 1;
+    header.tilesY = (height - 2) / tileSize + 1;
+    header.scale = scale;
+    header.offset = offset;
+
+    ofstream out(path.c_str(), ios::binary | ios::trunc);
+    if (!out) throw runtime_error("Could not open height store for writing: " + path);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    int stride = tileSize + 1;
+    vector<uint16_t> band((size_t)stride * width);
+    vector<uint16_t> tile((size_t)stride * stride);
+    int next = 0;
+    for (int ty = 0; ty < header.tilesY; ty++) {
+        for (int i = 0; i < stride; i++) {
+            int r = min(ty * tileSize + i, height - 1);
+            uint16_t* dst = &band[(size_t)i * width];
+            if (i == 0 && ty > 0) {
+                // first row of this band is the apron row of the previous one
+                memcpy(dst, &band[(size_t)tileSize * width], width * sizeof(uint16_t));
+            }
+            else if (r < next) {
+                memcpy(dst, dst - width, width * sizeof(uint16_t));
+            }
+            else {
+                row(r, dst);
+                next = r + 1;
+            }
+        }
+        for (int tx = 0; tx < header.tilesX; tx++) {
+            for (int lr = 0; lr < stride; lr++) {
+                for (int lc = 0; lc < stride; lc++) {
+                    int c = min(tx * tileSize + lc, width - 1);
+                    tile[(size_t)lr * stride + lc] = band[(size_t)lr * width + c];
+                }
+            }
+            out.write(reinterpret_cast<const char*>(&tile[0]), tile.size() * sizeof(uint16_t));
+        }
+    }
+    if (!out) throw runtime_error("Failed writing height store: " + path);
+}
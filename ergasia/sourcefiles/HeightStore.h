@@ -0,0 +1,79 @@
+#ifndef HEIGHT_STORE_H
+#define HEIGHT_STORE_H
+
+#include <string>
+#include <functional>
+#include <cstdint>
+#include "MappedFile.h"
+
+/**
+ * Large height field kept as 16-bit samples in square tiles of a memory
+ * mapped file; height = offset + scale * sample. Each tile also stores the
+ * first row and column of its right and lower neighbours, so the four
+ * samples of any bilinear lookup live in one tile and only the tiles that
+ * are actually touched get paged in.
+ */
+class HeightStore {
+public:
+    /** throws std::runtime_error on a missing or malformed file */
+    explicit HeightStore(const std::string& path);
+
+    int width() const { return header->width; }
+    int height() const { return header->height; }
+    float scale() const { return header->scale; }
+    float offset() const { return header->offset; }
+
+    /** Height at sample (row, column), clamped to the edges */
+    float at(int r, int c) const {
+        r = r < 0 ? 0 : (r >= header->height ? header->height - 1 : r);
+        c = c < 0 ? 0 : (c >= header->width ? header->width - 1 : c);
+        int tr = r >> shift, tc = c >> shift;
+        if (tr == header->tilesY) tr--;
+        if (tc == header->tilesX) tc--;
+        const uint16_t* tile = samples + (size_t)(tr * header->tilesX + tc) * tileSamples;
+        return header->offset + header->scale * tile[(r - (tr << shift)) * stride + (c - (tc << shift))];
+    }
+
+    /** Bilinear height at fractional sample coordinates, clamped to the edges */
+    float bilinear(float r, float c) const {
+        float maxR = (float)(header->height - 1), maxC = (float)(header->width - 1);
+        r = r < 0.0f ? 0.0f : (r > maxR ? maxR : r);
+        c = c < 0.0f ? 0.0f : (c > maxC ? maxC : c);
+        int r0 = (int)r, c0 = (int)c;
+        if (r0 > header->height - 2) r0 = header->height - 2;
+        if (c0 > header->width - 2) c0 = header->width - 2;
+        float fr = r - r0, fc = c - c0;
+        int tr = r0 >> shift, tc = c0 >> shift;
+        const uint16_t* s = samples + (size_t)(tr * header->tilesX + tc) * tileSamples
+                            + (r0 & mask) * stride + (c0 & mask);
+        float top = s[0] + (s[1] - (float)s[0]) * fc;
+        float bot = s[stride] + (s[stride + 1] - (float)s[stride]) * fc;
+        return header->offset + header->scale * (top + (bot - top) * fr);
+    }
+
+    /**
+     * Writes a store of width x height samples. row(r, out) must fill out with
+     * the width samples of row r; rows are requested in increasing order and
+     * only tileSize + 1 of them are held in memory at a time. tileSize must be
+     * a power of two. Throws std::runtime_error on write failure.
+     */
+    static void write(const std::string& path, int width, int height, int tileSize, float scale, float offset,
+                      const std::function<void(int, uint16_t*)>& row);
+
+private:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        int32_t width, height, tileSize, tilesX, tilesY;
+        float scale, offset;
+        uint32_t pad[6];
+    };
+
+    MappedFile file;
+    const Header* header;
+    const uint16_t* samples;
+    int shift, mask, stride;
+    size_t tileSamples;
+};
+
+#endif
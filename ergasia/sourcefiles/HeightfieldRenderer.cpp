@@ -0,0 +1,99 @@
+#include "HeightfieldRenderer.h"
+#include "heightmap.h"
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+// shadowMapSampler is on 2, splatMapSampler on 3, bouncySampler on 4
+static const int HEIGHT_MAP_UNIT = 5;
+
+HeightfieldRenderer::HeightfieldRenderer(Heightmap* heightmap, int patchSize)
+    : heightmap(heightmap), patchSize(patchSize) {
+    int rows = heightmap->rows;
+    int cols = heightmap->cols;
+    patchesPerRow = (cols - 1 + patchSize - 1) / patchSize;
+    patchesPerColumn = (rows - 1 + patchSize - 1) / patchSize;
+
+    // one patch of (patchSize + 1)^2 vertices, xz hold the sample offset inside the chunk
+    vector<vec3> vertices;
+    vertices.reserve((patchSize + 1) * (patchSize + 1));
+    for (int r = 0; r <= patchSize; r++) {
+        for (int c = 0; c <= patchSize; c++) {
+            vertices.push_back(vec3((float)c, 0.0f, (float)r));
+        }
+    }
+    vector<unsigned int> indices;
+    indices.reserve(patchSize * patchSize * 6);
+    for (int i = 0; i < patchSize; i++) {
+        for (int j = 0; j < patchSize; j++) {
+            unsigned int v00 = i * (patchSize + 1) + j;
+            unsigned int v10 = (i + 1) * (patchSize + 1) + j;
+            indices.push_back(v00); indices.push_back(v10); indices.push_back(v00 + 1);
+            indices.push_back(v10); indices.push_back(v10 + 1); indices.push_back(v00 + 1);
+        }
+    }
+    indexCount = (int)indices.size();
+
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vec3), &vertices[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(0);
+    glGenBuffers(1, &EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    glGenTextures(1, &heightTextureID);
+    glBindTexture(GL_TEXTURE_2D, heightTextureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, cols, rows, 0, GL_RED, GL_FLOAT, NULL);
+    // the shaders use texelFetch, filtering never applies
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    updateRegion(0, 0, rows, cols);
+}
+
+HeightfieldRenderer::~HeightfieldRenderer() {
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteTextures(1, &heightTextureID);
+}
+
+void HeightfieldRenderer::updateRegion(int r0, int c0, int r1, int c1) {
+    r0 = std::max(r0, 0); c0 = std::max(c0, 0);
+    r1 = std::min(r1, heightmap->rows); c1 = std::min(c1, heightmap->cols);
+    if (r0 >= r1 || c0 >= c1) return;
+
+    int width = c1 - c0;
+    vector<float> pixels(width * (r1 - r0));
+    for (int r = r0; r < r1; r++) {
+        copy(heightmap->heightGrid[r].begin() + c0, heightmap->heightGrid[r].begin() + c1, pixels.begin() + (r - r0) * width);
+    }
+    glBindTexture(GL_TEXTURE_2D, heightTextureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, c0, r0, width, r1 - r0, GL_RED, GL_FLOAT, &pixels[0]);
+}
+
+void HeightfieldRenderer::draw(GLuint program) {
+    glActiveTexture(GL_TEXTURE0 + HEIGHT_MAP_UNIT);
+    glBindTexture(GL_TEXTURE_2D, heightTextureID);
+    glUniform1i(glGetUniformLocation(program, "heightMapSampler"), HEIGHT_MAP_UNIT);
+    glUniform2i(glGetUniformLocation(program, "heightMapSize"), heightmap->cols, heightmap->rows);
+    glUniform1i(glGetUniformLocation(program, "patchSize"), patchSize);
+    glUniform1i(glGetUniformLocation(program, "patchesPerRow"), patchesPerRow);
+    glUniform1i(glGetUniformLocation(program, "heightfieldMode"), 1);
+
+    glBindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, NULL, patchesPerRow * patchesPerColumn);
+    glBindVertexArray(0);
+
+    // the same programs draw regular meshes afterwards
+    glUniform1i(glGetUniformLocation(program, "heightfieldMode"), 0);
+}
@@ -0,0 +1,32 @@
+#ifndef HEIGHTFIELD_RENDERER_H
+#define HEIGHTFIELD_RENDERER_H
+
+#include <GL/glew.h>
+
+class Heightmap;
+
+/**
+ * Alternate terrain renderer: heightGrid lives in one R32F texture and a
+ * single small grid patch is drawn instanced once per chunk, displaced in
+ * the ShadowMapping and Depth vertex shaders. Edits only need
+ * updateRegion() instead of a mesh rebuild.
+ */
+class HeightfieldRenderer {
+public:
+    HeightfieldRenderer(Heightmap* heightmap, int patchSize = 32);
+    ~HeightfieldRenderer();
+
+    /** Draws every chunk with program (ShadowMapping or Depth), M must already be set */
+    void draw(GLuint program);
+    /** Re-uploads rows [r0, r1) and columns [c0, c1) of heightGrid */
+    void updateRegion(int r0, int c0, int r1, int c1);
+
+    GLuint heightTextureID;
+
+private:
+    Heightmap* heightmap;
+    GLuint VAO, VBO, EBO;
+    int indexCount, patchSize, patchesPerRow, patchesPerColumn;
+};
+
+#endif
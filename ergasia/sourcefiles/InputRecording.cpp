@@ -0,0 +1,97 @@
+#include "InputRecording.h"
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+static const char RECORDING_MAGIC[4] = { 'S', 'S', 'I', 'R' };
+static const uint32_t RECORDING_VERSION = 2;
+static const uint8_t ANGLE_FLAG = 1, HASH_FLAG = 2;
+
+const char* InputRecording::terrainSourceName(int source) {
+    switch (source) {
+    case GENERATED_TERRAIN: return "generated";
+    case WORLD_FILE_TERRAIN: return "world file";
+    case DEM_TERRAIN: return "DEM";
+    case STREAMED_TERRAIN: return "streamed";
+    default: return "unknown";
+    }
+}
+
+const char* InputRecording::producerName(int producer) {
+    switch (producer) {
+    case GAME_PRODUCER: return "the game";
+    case SIM_PRODUCER: return "supersnail_sim";
+    default: return "an unknown program";
+    }
+}
+
+InputRecording::Writer::Writer(const string& path, Header header)
+    : out(path.c_str(), ios::binary | ios::trunc), hashInterval(header.hashInterval), cameraAngle(0.0f), count(0) {
+    if (!out) throw runtime_error("Could not open input recording for writing: " + path);
+    memcpy(header.magic, RECORDING_MAGIC, 4);
+    header.version = RECORDING_VERSION;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+}
+
+bool InputRecording::Writer::hashDue() const {
+    return hashInterval > 0 && (count + 1) % hashInterval == 0;
+}
+
+void InputRecording::Writer::record(const InputState& input, uint64_t stateHash) {
+    uint8_t bytes[2 + sizeof(float) + sizeof(uint64_t)];
+    size_t size = 2;
+    bytes[0] = (uint8_t)input.keys;
+    bytes[1] = 0;
+    // the first record always carries the heading
+    if (count == 0 || input.cameraAngle != cameraAngle) {
+        bytes[1] |= ANGLE_FLAG;
+        memcpy(bytes + size, &input.cameraAngle, sizeof(float));
+        size += sizeof(float);
+        cameraAngle = input.cameraAngle;
+    }
+    if (hashDue()) {
+        bytes[1] |= HASH_FLAG;
+        memcpy(bytes + size, &stateHash, sizeof(uint64_t));
+        size += sizeof(uint64_t);
+    }
+    out.write(reinterpret_cast<const char*>(bytes), (streamsize)size);
+    count++;
+}
+
+InputRecording::InputRecording(const string& path) : file(path), offset(sizeof(Header)), cameraAngle(0.0f), count(0) {
+    if (file.size() < sizeof(Header) || memcmp(header().magic, RECORDING_MAGIC, 4) != 0 ||
+        header().version != RECORDING_VERSION) {
+        throw runtime_error("Not a valid input recording: " + path);
+    }
+}
+
+void InputRecording::check(TerrainSource source) const {
+    if (header().terrainSource == source) return;
+    throw runtime_error(string("Recording by ") + producerName(header().producer) + " was made on " +
+                        terrainSourceName(header().terrainSource) + " terrain, this replay builds " +
+                        terrainSourceName(source) + " terrain");
+}
+
+bool InputRecording::next(InputState& input, bool& hashed, uint64_t& stateHash) {
+    const char* data = file.data();
+    size_t size = file.size();
+    if (offset + 2 > size) return false;
+    uint8_t flags = (uint8_t)data[offset + 1];
+    size_t length = 2 + ((flags & ANGLE_FLAG) ? sizeof(float) : 0) + ((flags & HASH_FLAG) ? sizeof(uint64_t) : 0);
+    // a session cut short may end in a partial record
+    if (offset + length > size) return false;
+
+    input.keys = (uint8_t)data[offset];
+    size_t at = offset + 2;
+    if (flags & ANGLE_FLAG) {
+        memcpy(&cameraAngle, data + at, sizeof(float));
+        at += sizeof(float);
+    }
+    input.cameraAngle = cameraAngle;
+    hashed = (flags & HASH_FLAG) != 0;
+    if (hashed) memcpy(&stateHash, data + at, sizeof(uint64_t));
+    offset += length;
+    count++;
+    return true;
+}
@@ -0,0 +1,97 @@
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+#include "MappedFile.h"
+#include "SnailForcing.h"
+
+/**
+ * The controls of a play session, one record per fixed physics step, after a
+ * header with everything the world was built from. Fed back through the same
+ * steps by the same build it reproduces the session exactly, so a reported
+ * stutter or bug becomes a repeatable run. A record is the key bits and a
+ * flags byte, followed by the camera heading only when it changed and by a
+ * hash of the state after the step every hashInterval steps:
+ *
+ *     uint8 keys, uint8 flags, [float cameraAngle], [uint64 stateHash]
+ *
+ * A replay has to build the same world, so one made from a different
+ * terrain source than the recording is refused (see check()).
+ */
+class InputRecording {
+public:
+    /** where the recorded world's terrain came from */
+    enum TerrainSource {
+        GENERATED_TERRAIN,
+        WORLD_FILE_TERRAIN,
+        DEM_TERRAIN,
+        STREAMED_TERRAIN
+    };
+    /** the program that made the recording */
+    enum Producer {
+        GAME_PRODUCER,
+        SIM_PRODUCER
+    };
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t seed;
+        float physicsStep;
+        int32_t treeCount, flowerCount, shellCount;
+        /** IntegratorType of the snail */
+        int32_t integrator;
+        /** steps between state hashes, 0 for none */
+        uint32_t hashInterval;
+        /** a TerrainSource and a Producer */
+        int32_t terrainSource, producer;
+    };
+
+    static const char* terrainSourceName(int source);
+    static const char* producerName(int producer);
+
+    /** Appends records to a file as the steps run */
+    class Writer {
+    public:
+        /** throws std::runtime_error when the file cannot be written */
+        Writer(const std::string& path, Header header);
+
+        /** true when the step about to be recorded should carry a state hash */
+        bool hashDue() const;
+        /** The input of one step, and the state hash after it when hashDue() */
+        void record(const InputState& input, uint64_t stateHash = 0);
+        int steps() const { return count; }
+
+    private:
+        std::ofstream out;
+        uint32_t hashInterval;
+        float cameraAngle;
+        int count;
+    };
+
+    /** Maps path read-only, throws std::runtime_error on a missing or malformed file */
+    explicit InputRecording(const std::string& path);
+
+    const Header& header() const { return *reinterpret_cast<const Header*>(file.data()); }
+    /** throws std::runtime_error unless the replaying world's terrain comes from the recorded source */
+    void check(TerrainSource source) const;
+
+    /**
+     * The input of the next step, false once the recording is used up.
+     * hashed is set when the state after this step was hashed into stateHash.
+     */
+    bool next(InputState& input, bool& hashed, uint64_t& stateHash);
+    /** steps read so far */
+    int position() const { return count; }
+
+private:
+    MappedFile file;
+    size_t offset;
+    float cameraAngle;
+    int count;
+};
+
+#endif
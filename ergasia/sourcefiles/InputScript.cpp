@@ -0,0 +1,36 @@
+#include "InputScript.h"
+#include <cmath>
+
+struct ScriptSegment {
+    float duration;
+    unsigned int keys;
+    float cameraAngle;
+};
+
+// Taps of KEY_RETRACT are one segment long, the step toggles on the press.
+static const ScriptSegment SCRIPT[] = {
+    { 3.0f, KEY_FORWARD, 0.0f },
+    { 2.0f, KEY_FORWARD | KEY_RIGHT, 0.0f },
+    { 2.0f, KEY_FORWARD | KEY_SPRINT | KEY_EAT, 0.0f },
+    { 0.1f, KEY_RETRACT, 0.0f },
+    { 4.0f, KEY_FORWARD, 0.8f },
+    { 2.0f, KEY_LEFT | KEY_FLY, 0.8f },
+    { 2.0f, 0, 0.0f },
+    { 0.1f, KEY_RETRACT, 0.0f },
+    { 2.0f, KEY_BACK | KEY_LEFT | KEY_EAT, 0.0f },
+};
+
+InputState scriptedInput(float t) {
+    float lap = 0.0f;
+    for (const ScriptSegment& s : SCRIPT) lap += s.duration;
+    t = std::fmod(t, lap);
+    for (const ScriptSegment& s : SCRIPT) {
+        if (t < s.duration) {
+            InputState input = { s.keys, s.cameraAngle };
+            return input;
+        }
+        t -= s.duration;
+    }
+    InputState none = { 0, 0.0f };
+    return none;
+}
@@ -0,0 +1,13 @@
+#ifndef INPUT_SCRIPT_H
+#define INPUT_SCRIPT_H
+
+#include "SnailForcing.h"
+
+/**
+ * A fixed lap of controls for headless runs, repeating forever: crawling and
+ * turning, sprinting, retracting and rolling, eating and flying once the
+ * pizza is found. t is simulated seconds since the start.
+ */
+InputState scriptedInput(float t);
+
+#endif
@@ -0,0 +1,274 @@
+#include "InstanceBvh.h"
+
+using namespace std;
+using namespace glm;
+
+// SAH bins per axis, items per leaf worth stopping at, and a depth the query stacks always hold
+static const int BINS = 16;
+static const int LEAF_ITEMS = 4;
+static const int MAX_DEPTH = 60;
+
+static float area(const vec3& min, const vec3& max) {
+    vec3 d = max - min;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+void InstanceBvh::add(int kind, int index, const Box& world) {
+    Item item = { kind, index };
+    items.push_back(item);
+    boxes.push_back(world);
+}
+
+void InstanceBvh::clear() {
+    nodes.clear();
+    items.clear();
+    boxes.clear();
+    parents.clear();
+    leaves.clear();
+    slots.clear();
+}
+
+InstanceBvh::Box InstanceBvh::transform(const Box& local, const mat4& model) {
+    // the box of the eight transformed corners
+    Box world = { vec3(model[3]), vec3(model[3]) };
+    for (int axis = 0; axis < 3; axis++) {
+        vec3 column(model[axis]);
+        vec3 a = column * local.min[axis], b = column * local.max[axis];
+        world.min += glm::min(a, b);
+        world.max += glm::max(a, b);
+    }
+    return world;
+}
+
+InstanceBvh::Box InstanceBvh::merge(const Box& a, const Box& b) {
+    Box box = { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+    return box;
+}
+
+void InstanceBvh::fit(Node& node) const {
+    node.min = vec3(1e30f);
+    node.max = vec3(-1e30f);
+    for (int i = node.first; i < node.first + node.count; i++) {
+        node.min = glm::min(node.min, boxes[i].min);
+        node.max = glm::max(node.max, boxes[i].max);
+    }
+}
+
+void InstanceBvh::build() {
+    nodes.clear();
+    if (items.empty()) return;
+    nodes.reserve(2 * items.size());
+    vector<vec3> centers(items.size());
+    for (size_t i = 0; i < items.size(); i++) centers[i] = 0.5f * (boxes[i].min + boxes[i].max);
+
+    Node root;
+    root.first = 0;
+    root.count = (int)items.size();
+    fit(root);
+    nodes.push_back(root);
+    // depth first, a node's children are allocated together
+    vector<pair<int, int>> pending(1, make_pair(0, 0));
+    while (!pending.empty()) {
+        int node = pending.back().first, depth = pending.back().second;
+        pending.pop_back();
+        if (depth >= MAX_DEPTH) continue;
+        subdivide(node, centers);
+        if (nodes[node].count == 0) {
+            pending.push_back(make_pair(nodes[node].first, depth + 1));
+            pending.push_back(make_pair(nodes[node].first + 1, depth + 1));
+        }
+    }
+
+    // the way back up from each item, for refit()
+    parents.assign(nodes.size(), -1);
+    leaves.assign(items.size(), 0);
+    slots.clear();
+    for (int n = 0; n < (int)nodes.size(); n++) {
+        const Node& node = nodes[n];
+        if (node.count == 0) {
+            parents[node.first] = parents[node.first + 1] = n;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; i++) {
+            leaves[i] = n;
+            if (items[i].kind >= (int)slots.size()) slots.resize(items[i].kind + 1);
+            vector<int>& slot = slots[items[i].kind];
+            if (items[i].index >= (int)slot.size()) slot.resize(items[i].index + 1, -1);
+            slot[items[i].index] = i;
+        }
+    }
+}
+
+void InstanceBvh::refit(int kind, int index, const Box& world) {
+    if (kind < 0 || kind >= (int)slots.size() || index < 0 || index >= (int)slots[kind].size()) return;
+    int slot = slots[kind][index];
+    if (slot < 0) return;
+    boxes[slot] = world;
+    for (int n = leaves[slot]; n >= 0; n = parents[n]) {
+        Node& node = nodes[n];
+        if (node.count > 0) fit(node);
+        else {
+            node.min = glm::min(nodes[node.first].min, nodes[node.first + 1].min);
+            node.max = glm::max(nodes[node.first].max, nodes[node.first + 1].max);
+        }
+    }
+}
+
+void InstanceBvh::subdivide(int index, vector<vec3>& centers) {
+    Node node = nodes[index];
+    if (node.count <= LEAF_ITEMS) return;
+    vec3 cmin(1e30f), cmax(-1e30f);
+    for (int i = node.first; i < node.first + node.count; i++) {
+        cmin = glm::min(cmin, centers[i]);
+        cmax = glm::max(cmax, centers[i]);
+    }
+
+    // cheapest split over every axis' bins, by the surface area heuristic
+    float bestCost = area(node.min, node.max) * node.count;
+    int bestAxis = -1, bestSplit = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = cmax[axis] - cmin[axis];
+        if (extent <= 0.0f) continue;
+        struct Bin { vec3 min, max; int count; } bins[BINS];
+        for (Bin& b : bins) { b.min = vec3(1e30f); b.max = vec3(-1e30f); b.count = 0; }
+        float scale = BINS / extent;
+        for (int i = node.first; i < node.first + node.count; i++) {
+            int b = std::min((int)((centers[i][axis] - cmin[axis]) * scale), BINS - 1);
+            bins[b].min = glm::min(bins[b].min, boxes[i].min);
+            bins[b].max = glm::max(bins[b].max, boxes[i].max);
+            bins[b].count++;
+        }
+        // costs of everything left of each split, then sweep in from the right
+        float leftCost[BINS - 1];
+        vec3 lmin(1e30f), lmax(-1e30f);
+        int left = 0;
+        for (int s = 0; s < BINS - 1; s++) {
+            left += bins[s].count;
+            lmin = glm::min(lmin, bins[s].min);
+            lmax = glm::max(lmax, bins[s].max);
+            leftCost[s] = left > 0 ? area(lmin, lmax) * left : 0.0f;
+        }
+        vec3 rmin(1e30f), rmax(-1e30f);
+        int right = 0;
+        for (int s = BINS - 1; s > 0; s--) {
+            right += bins[s].count;
+            rmin = glm::min(rmin, bins[s].min);
+            rmax = glm::max(rmax, bins[s].max);
+            float cost = leftCost[s - 1] + (right > 0 ? area(rmin, rmax) * right : 0.0f);
+            if (right > 0 && right < node.count && cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = s;
+            }
+        }
+    }
+    if (bestAxis < 0) return;
+
+    // partition items, boxes and centers in place around the split
+    float scale = BINS / (cmax[bestAxis] - cmin[bestAxis]);
+    int i = node.first, j = node.first + node.count - 1;
+    while (i <= j) {
+        int b = std::min((int)((centers[i][bestAxis] - cmin[bestAxis]) * scale), BINS - 1);
+        if (b < bestSplit) i++;
+        else {
+            swap(items[i], items[j]);
+            swap(boxes[i], boxes[j]);
+            swap(centers[i], centers[j]);
+            j--;
+        }
+    }
+    int leftCount = i - node.first;
+    if (leftCount == 0 || leftCount == node.count) return;
+
+    Node left, right;
+    left.first = node.first;
+    left.count = leftCount;
+    right.first = i;
+    right.count = node.count - leftCount;
+    fit(left);
+    fit(right);
+    nodes[index].first = (int)nodes.size();
+    nodes[index].count = 0;
+    nodes.push_back(left);
+    nodes.push_back(right);
+}
+
+void InstanceBvh::overlapSphere(const vec3& center, float radius, vector<Item>& out) const {
+    if (nodes.empty()) return;
+    float r2 = radius * radius;
+    auto overlaps = [&](const vec3& min, const vec3& max) {
+        vec3 d = center - glm::clamp(center, min, max);
+        return dot(d, d) <= r2;
+    };
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (!overlaps(node.min, node.max)) continue;
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; i++) {
+            if (overlaps(boxes[i].min, boxes[i].max)) out.push_back(items[i]);
+        }
+    }
+}
+
+void InstanceBvh::frustum(const mat4& viewProjection, vector<Item>& out) const {
+    if (nodes.empty()) return;
+    // the six clip planes, a point is inside when dot(plane, (p, 1)) >= 0 for all
+    mat4 m = transpose(viewProjection);
+    vec4 planes[6] = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2] };
+    // -1 outside, 0 crossing, 1 inside every plane
+    auto classify = [&](const vec3& min, const vec3& max) {
+        int result = 1;
+        for (const vec4& p : planes) {
+            vec3 n(p);
+            vec3 far(n.x >= 0.0f ? max.x : min.x, n.y >= 0.0f ? max.y : min.y, n.z >= 0.0f ? max.z : min.z);
+            vec3 near(n.x >= 0.0f ? min.x : max.x, n.y >= 0.0f ? min.y : max.y, n.z >= 0.0f ? min.z : max.z);
+            if (dot(n, far) + p.w < 0.0f) return -1;
+            if (dot(n, near) + p.w < 0.0f) result = 0;
+        }
+        return result;
+    };
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        int index = stack[--top];
+        const Node& node = nodes[index];
+        int inside = classify(node.min, node.max);
+        if (inside < 0) continue;
+        if (inside > 0) {
+            // the whole subtree, its leaves are one contiguous run of items
+            const Node* first = &node;
+            while (first->count == 0) first = &nodes[first->first];
+            const Node* last = &node;
+            while (last->count == 0) last = &nodes[last->first + 1];
+            out.insert(out.end(), items.begin() + first->first, items.begin() + last->first + last->count);
+            continue;
+        }
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; i++) {
+            if (classify(boxes[i].min, boxes[i].max) >= 0) out.push_back(items[i]);
+        }
+    }
+}
+
+void InstanceBvh::overlapSphereBatch(const vector<vec3>& centers, const vector<float>& radii,
+                                     vector<vector<Item>>& out) const {
+    out.resize(centers.size());
+    parallelFor(0, (int)centers.size(), [&](int b, int e) {
+        for (int k = b; k < e; k++) {
+            out[k].clear();
+            overlapSphere(centers[k], radii[k], out[k]);
+        }
+    }, 256);
+}
@@ -0,0 +1,188 @@
+#ifndef INSTANCE_BVH_H
+#define INSTANCE_BVH_H
+
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "Parallel.h"
+
+/**
+ * Bounding volume hierarchy over the world boxes of placed instances
+ * (trees, grass, flowers), built once with binned SAH and refit where an
+ * instance moves. Queries report the items whose box passes and leave exact
+ * shapes to the caller, ray queries through a test callback. They only
+ * read, so any number of threads may query at once, just not during a
+ * refit(); the batch versions spread many agents' queries over the worker
+ * threads.
+ */
+class InstanceBvh {
+public:
+    /** kind picks the caller's array, index the instance in it */
+    struct Item {
+        int kind, index;
+    };
+    struct Box {
+        glm::vec3 min, max;
+    };
+    struct RayHit {
+        bool hit;
+        /** in units of dir, so along a segment the fraction */
+        float t;
+        Item item;
+    };
+
+    InstanceBvh() {}
+
+    void add(int kind, int index, const Box& world);
+    /** Builds the hierarchy over everything added so far */
+    void build();
+    /**
+     * Gives an item built over a new box and refits the nodes above it. The
+     * tree keeps its shape, so it suits small moves such as instances
+     * re-seated on dented ground.
+     */
+    void refit(int kind, int index, const Box& world);
+    void clear();
+    int size() const { return (int)items.size(); }
+
+    /** The world box of local transformed by model */
+    static Box transform(const Box& local, const glm::mat4& model);
+    static Box merge(const Box& a, const Box& b);
+
+    /** Appends the items whose box overlaps the sphere */
+    void overlapSphere(const glm::vec3& center, float radius, std::vector<Item>& out) const;
+    /** Appends the items whose box is not entirely outside the frustum of viewProjection */
+    void frustum(const glm::mat4& viewProjection, std::vector<Item>& out) const;
+
+    /**
+     * Nearest item along origin + t * dir for 0 <= t <= maxT. test(item, t)
+     * gets each item whose box the ray enters at t, and returns whether the
+     * item itself is hit, setting t to where; boxes are visited near to far
+     * and pruned by the nearest hit so far.
+     */
+    template <class Test>
+    bool raycast(const glm::vec3& origin, const glm::vec3& dir, float maxT, RayHit& hit, Test test) const;
+    bool raycast(const glm::vec3& origin, const glm::vec3& dir, float maxT, RayHit& hit) const {
+        return raycast(origin, dir, maxT, hit, [](const Item&, float&) { return true; });
+    }
+    /** Whether any item passing test lies on the segment a -> b */
+    template <class Test>
+    bool segmentBlocked(const glm::vec3& a, const glm::vec3& b, Test test) const;
+
+    /** overlapSphere for each center and radius, out[k] the items of query k */
+    void overlapSphereBatch(const std::vector<glm::vec3>& centers, const std::vector<float>& radii,
+                            std::vector<std::vector<Item>>& out) const;
+    /** raycast of each segment from[k] -> to[k] */
+    template <class Test>
+    void segmentBatch(const std::vector<glm::vec3>& from, const std::vector<glm::vec3>& to,
+                      std::vector<RayHit>& hits, Test test) const;
+
+private:
+    /** children of an inner node are first and first + 1, a leaf holds items [first, first + count) */
+    struct Node {
+        glm::vec3 min;
+        int first;
+        glm::vec3 max;
+        int count;
+    };
+    std::vector<Node> nodes;
+    /** items and their boxes, in leaf order once built */
+    std::vector<Item> items;
+    std::vector<Box> boxes;
+    /** for refit(): the parent of each node (-1 for the root), the leaf of each item slot, the slot of each kind and index */
+    std::vector<int> parents, leaves;
+    std::vector<std::vector<int>> slots;
+
+    void subdivide(int node, std::vector<glm::vec3>& centers);
+    void fit(Node& node) const;
+
+    /** entry t of the ray into the box, or a miss when it leaves before 0 or enters after maxT */
+    static bool enter(const glm::vec3& bmin, const glm::vec3& bmax, const glm::vec3& origin,
+                      const glm::vec3& invDir, float maxT, float& t) {
+        glm::vec3 t0 = (bmin - origin) * invDir, t1 = (bmax - origin) * invDir;
+        glm::vec3 lo = glm::min(t0, t1), hi = glm::max(t0, t1);
+        float tIn = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+        float tOut = std::min(std::min(hi.x, hi.y), std::min(hi.z, maxT));
+        t = tIn;
+        return tIn <= tOut;
+    }
+    static glm::vec3 inverse(const glm::vec3& dir) {
+        // a zero component becomes a huge one of the same slab test
+        return glm::vec3(1.0f / (dir.x != 0.0f ? dir.x : 1e-30f), 1.0f / (dir.y != 0.0f ? dir.y : 1e-30f),
+                         1.0f / (dir.z != 0.0f ? dir.z : 1e-30f));
+    }
+};
+
+template <class Test>
+bool InstanceBvh::raycast(const glm::vec3& origin, const glm::vec3& dir, float maxT, RayHit& hit, Test test) const {
+    hit.hit = false;
+    hit.t = maxT;
+    if (nodes.empty()) return false;
+    glm::vec3 invDir = inverse(dir);
+    float t;
+    if (!enter(nodes[0].min, nodes[0].max, origin, invDir, maxT, t)) return false;
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (!enter(node.min, node.max, origin, invDir, hit.t, t)) continue;
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                if (!enter(boxes[i].min, boxes[i].max, origin, invDir, hit.t, t)) continue;
+                if (test(items[i], t) && t <= hit.t) {
+                    hit.hit = true;
+                    hit.t = t;
+                    hit.item = items[i];
+                }
+            }
+            continue;
+        }
+        // the nearer child goes on top
+        float tA, tB;
+        bool a = enter(nodes[node.first].min, nodes[node.first].max, origin, invDir, hit.t, tA);
+        bool b = enter(nodes[node.first + 1].min, nodes[node.first + 1].max, origin, invDir, hit.t, tB);
+        if (a && b) {
+            stack[top++] = tA <= tB ? node.first + 1 : node.first;
+            stack[top++] = tA <= tB ? node.first : node.first + 1;
+        }
+        else if (a) stack[top++] = node.first;
+        else if (b) stack[top++] = node.first + 1;
+    }
+    return hit.hit;
+}
+
+template <class Test>
+bool InstanceBvh::segmentBlocked(const glm::vec3& a, const glm::vec3& b, Test test) const {
+    if (nodes.empty()) return false;
+    glm::vec3 invDir = inverse(b - a);
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    float t;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (!enter(node.min, node.max, a, invDir, 1.0f, t)) continue;
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; i++) {
+            if (enter(boxes[i].min, boxes[i].max, a, invDir, 1.0f, t) && test(items[i], t)) return true;
+        }
+    }
+    return false;
+}
+
+template <class Test>
+void InstanceBvh::segmentBatch(const std::vector<glm::vec3>& from, const std::vector<glm::vec3>& to,
+                               std::vector<RayHit>& hits, Test test) const {
+    hits.resize(from.size());
+    parallelFor(0, (int)from.size(), [&](int b, int e) {
+        for (int k = b; k < e; k++) raycast(from[k], to[k] - from[k], 1.0f, hits[k], test);
+    }, 256);
+}
+
+#endif
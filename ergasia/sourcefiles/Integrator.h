@@ -0,0 +1,179 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+/**
+ * Explicit integrators over a fixed-size state such as std::array<float, N>.
+ * f(t, y, dydt) writes the derivative of y into dydt. Every temporary is a
+ * State on the stack, so a step never touches the heap. y1 may alias y0.
+ *
+ * The symplectic ones split the state at index split into positions [0,
+ * split) and momenta [split, N) and also take rates(y, dydt), which writes
+ * only the position rates and must not evaluate forces.
+ */
+
+enum IntegratorType {
+    SEMI_IMPLICIT_EULER,
+    VELOCITY_VERLET,
+    RUNGE_KUTTA_4,
+    DORMAND_PRINCE_45
+};
+
+/** Tolerances of the adaptive integrator, error per step is kept below absTol + relTol |y| */
+struct StepControl {
+    float absTol, relTol;
+    /** never subdivide below this, steps at minStep are accepted whatever their error */
+    float minStep;
+    StepControl() : absTol(1e-4f), relTol(1e-4f), minStep(1e-5f) {}
+};
+
+/** What the adaptive integrator did over the last advance */
+struct StepReport {
+    int accepted, rejected;
+    /** largest accepted error, in units of the tolerance (<= 1 unless minStep was hit) */
+    float error;
+    /** step size suggested for the next advance */
+    float nextStep;
+    StepReport() : accepted(0), rejected(0), error(0.0f), nextStep(0.0f) {}
+};
+
+/** Euler method: y(t + h) = y(t) + h dy(t) / dt */
+template <typename State, typename Derivative>
+inline void eulerStep(float t, float h, const State& y0, State& y1, const Derivative& f) {
+    State k;
+    f(t, y0, k);
+    for (std::size_t i = 0; i < y0.size(); i++) {
+        y1[i] = y0[i] + h * k[i];
+    }
+}
+
+/** Runge-Kutta 4th order, error/step ~ O(h^5) */
+template <typename State, typename Derivative>
+inline void rungeKutta4Step(float t, float h, const State& y0, State& y1, const Derivative& f) {
+    State k1, k2, k3, k4, y;
+    f(t, y0, k1);
+    for (std::size_t i = 0; i < y0.size(); i++) y[i] = y0[i] + 0.5f * h * k1[i];
+    f(t + 0.5f * h, y, k2);
+    for (std::size_t i = 0; i < y0.size(); i++) y[i] = y0[i] + 0.5f * h * k2[i];
+    f(t + 0.5f * h, y, k3);
+    for (std::size_t i = 0; i < y0.size(); i++) y[i] = y0[i] + h * k3[i];
+    f(t + h, y, k4);
+    for (std::size_t i = 0; i < y0.size(); i++) {
+        y1[i] = y0[i] + h * (k1[i] + 2.0f * k2[i] + 2.0f * k3[i] + k4[i]) / 6.0f;
+    }
+}
+
+/** Momenta first, then positions from the new momenta; one force evaluation */
+template <typename State, typename Derivative, typename Rates>
+inline void semiImplicitEulerStep(float t, float h, const State& y0, State& y1, std::size_t split,
+                                  const Derivative& f, const Rates& rates) {
+    State k, y = y0;
+    f(t, y0, k);
+    for (std::size_t i = split; i < y0.size(); i++) y[i] = y0[i] + h * k[i];
+    rates(y, k);
+    for (std::size_t i = 0; i < split; i++) y[i] = y0[i] + h * k[i];
+    y1 = y;
+}
+
+/** Kick half a step, drift a whole one, kick again with the forces at the new positions */
+template <typename State, typename Derivative, typename Rates>
+inline void velocityVerletStep(float t, float h, const State& y0, State& y1, std::size_t split,
+                               const Derivative& f, const Rates& rates) {
+    State k, y = y0;
+    f(t, y0, k);
+    for (std::size_t i = split; i < y0.size(); i++) y[i] = y0[i] + 0.5f * h * k[i];
+    rates(y, k);
+    for (std::size_t i = 0; i < split; i++) y[i] = y0[i] + h * k[i];
+    f(t + h, y, k);
+    for (std::size_t i = split; i < y0.size(); i++) y[i] += 0.5f * h * k[i];
+    y1 = y;
+}
+
+/**
+ * Dormand-Prince 5(4): one 5th order step and the difference to the
+ * embedded 4th order one. Returns the RMS of that difference in units of
+ * the tolerance, so a step is acceptable when the result is <= 1.
+ */
+template <typename State, typename Derivative>
+inline float dormandPrinceStep(float t, float h, const State& y0, State& y1, const Derivative& f,
+                               const StepControl& control) {
+    static const float
+        a21 = 1.0f / 5,
+        a31 = 3.0f / 40, a32 = 9.0f / 40,
+        a41 = 44.0f / 45, a42 = -56.0f / 15, a43 = 32.0f / 9,
+        a51 = 19372.0f / 6561, a52 = -25360.0f / 2187, a53 = 64448.0f / 6561, a54 = -212.0f / 729,
+        a61 = 9017.0f / 3168, a62 = -355.0f / 33, a63 = 46732.0f / 5247, a64 = 49.0f / 176, a65 = -5103.0f / 18656,
+        b1 = 35.0f / 384, b3 = 500.0f / 1113, b4 = 125.0f / 192, b5 = -2187.0f / 6784, b6 = 11.0f / 84,
+        // 5th minus 4th order weights
+        e1 = 71.0f / 57600, e3 = -71.0f / 16695, e4 = 71.0f / 1920, e5 = -17253.0f / 339200,
+        e6 = 22.0f / 525, e7 = -1.0f / 40;
+    State k1, k2, k3, k4, k5, k6, k7, y;
+    std::size_t n = y0.size();
+    f(t, y0, k1);
+    for (std::size_t i = 0; i < n; i++) y[i] = y0[i] + h * a21 * k1[i];
+    f(t + h / 5, y, k2);
+    for (std::size_t i = 0; i < n; i++) y[i] = y0[i] + h * (a31 * k1[i] + a32 * k2[i]);
+    f(t + 3 * h / 10, y, k3);
+    for (std::size_t i = 0; i < n; i++) y[i] = y0[i] + h * (a41 * k1[i] + a42 * k2[i] + a43 * k3[i]);
+    f(t + 4 * h / 5, y, k4);
+    for (std::size_t i = 0; i < n; i++) y[i] = y0[i] + h * (a51 * k1[i] + a52 * k2[i] + a53 * k3[i] + a54 * k4[i]);
+    f(t + 8 * h / 9, y, k5);
+    for (std::size_t i = 0; i < n; i++) {
+        y[i] = y0[i] + h * (a61 * k1[i] + a62 * k2[i] + a63 * k3[i] + a64 * k4[i] + a65 * k5[i]);
+    }
+    f(t + h, y, k6);
+    for (std::size_t i = 0; i < n; i++) {
+        y[i] = y0[i] + h * (b1 * k1[i] + b3 * k3[i] + b4 * k4[i] + b5 * k5[i] + b6 * k6[i]);
+    }
+    f(t + h, y, k7);
+
+    float sum = 0.0f;
+    for (std::size_t i = 0; i < n; i++) {
+        float e = h * (e1 * k1[i] + e3 * k3[i] + e4 * k4[i] + e5 * k5[i] + e6 * k6[i] + e7 * k7[i]);
+        float scale = control.absTol + control.relTol * std::max(std::fabs(y0[i]), std::fabs(y[i]));
+        sum += (e / scale) * (e / scale);
+    }
+    y1 = y;
+    return std::sqrt(sum / n);
+}
+
+/**
+ * Advances y from t to t + h with as many Dormand-Prince steps as the
+ * tolerances need, starting from report.nextStep (h when 0) and leaving the
+ * size to try next time there. A smooth trajectory is covered in one step
+ * per call, stiff spots such as contacts are subdivided.
+ */
+template <typename State, typename Derivative>
+inline void adaptiveStep(float t, float h, State& y, const Derivative& f, const StepControl& control,
+                         StepReport& report) {
+    float end = t + h;
+    float step = report.nextStep > 0.0f ? report.nextStep : h;
+    report.accepted = report.rejected = 0;
+    report.error = 0.0f;
+    while (t < end) {
+        float trial = std::min(step, end - t);
+        State y1;
+        float error = dormandPrinceStep(t, trial, y, y1, f, control);
+        // usual safety factor and growth limits, exponent 1/5 for the 4th order estimate
+        float factor = error > 0.0f ? 0.9f * std::pow(error, -0.2f) : 5.0f;
+        factor = std::min(std::max(factor, 0.2f), 5.0f);
+        if (error <= 1.0f || trial <= control.minStep) {
+            y = y1;
+            t = trial < end - t ? t + trial : end;
+            report.accepted++;
+            report.error = std::max(report.error, error);
+            // a step cut short by the end of the interval says nothing about the next one
+            if (trial == step || factor < 1.0f) step = trial * factor;
+        }
+        else {
+            report.rejected++;
+            step = std::max(trial * factor, control.minStep);
+        }
+    }
+    report.nextStep = step;
+}
+
+#endif
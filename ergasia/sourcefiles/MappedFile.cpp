@@ -0,0 +1,59 @@
+#include "MappedFile.h"
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+bool MappedFile::exists(const string& path) {
+    ifstream in(path.c_str(), ios::binary);
+    return in.good();
+}
+
+MappedFile::MappedFile(const string& path) : base(nullptr), length(0) {
+#ifdef _WIN32
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE) throw runtime_error("Could not open file: " + path);
+    LARGE_INTEGER size;
+    GetFileSizeEx(fileHandle, &size);
+    length = (size_t)size.QuadPart;
+    mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle) base = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!base) {
+        if (mappingHandle) CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        throw runtime_error("Could not map file: " + path);
+    }
+#else
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw runtime_error("Could not open file: " + path);
+    struct stat st;
+    fstat(fd, &st);
+    length = (size_t)st.st_size;
+    void* p = length > 0 ? mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (p == MAP_FAILED) {
+        close(fd);
+        throw runtime_error("Could not map file: " + path);
+    }
+    base = static_cast<const char*>(p);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+#else
+    munmap(const_cast<char*>(base), length);
+    close(fd);
+#endif
+}
@@ -0,0 +1,36 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+/**
+ * Read-only memory mapping of a whole file. Pages are loaded by the OS on
+ * first touch, so large files cost nothing until they are read.
+ */
+class MappedFile {
+public:
+    /** throws std::runtime_error when the file cannot be opened or mapped */
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+
+    static bool exists(const std::string& path);
+
+private:
+    const char* base;
+    size_t length;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fd;
+#endif
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "MaterialLayer.h"
+#include "Parallel.h"
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MATERIAL_LAYER_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// out[i] = in[i - 2] + in[i] + in[i + 2] over the interior bytes of one row;
+// neighbours are two bytes away because the channels are interleaved
+static void horizontalPass(const uint8_t* in, int bytes, uint8_t* out) {
+    int i = MATERIAL_CHANNELS;
+    int end = bytes - MATERIAL_CHANNELS;
+#ifdef MATERIAL_LAYER_SSE2
+    for (; i + 16 <= end; i += 16) {
+        __m128i l = _mm_loadu_si128((const __m128i*)(in + i - MATERIAL_CHANNELS));
+        __m128i m = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i r = _mm_loadu_si128((const __m128i*)(in + i + MATERIAL_CHANNELS));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi8(_mm_add_epi8(l, m), r));
+    }
+#endif
+    for (; i < end; i++) {
+        out[i] = (uint8_t)(in[i - MATERIAL_CHANNELS] + in[i] + in[i + MATERIAL_CHANNELS]);
+    }
+}
+
+static void verticalPass(const uint8_t* a, const uint8_t* b, const uint8_t* c, int bytes, uint8_t* out) {
+    int i = 0;
+#ifdef MATERIAL_LAYER_SSE2
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i sum = _mm_add_epi8(_mm_add_epi8(_mm_loadu_si128((const __m128i*)(a + i)),
+                                                _mm_loadu_si128((const __m128i*)(b + i))),
+                                   _mm_loadu_si128((const __m128i*)(c + i)));
+        _mm_storeu_si128((__m128i*)(out + i), sum);
+    }
+#endif
+    for (; i < bytes; i++) {
+        out[i] = (uint8_t)(a[i] + b[i] + c[i]);
+    }
+}
+
+void blurMaterials(const uint8_t* classes, int rows, int cols, uint8_t* out) {
+    int bytes = cols * MATERIAL_CHANNELS;
+    vector<uint8_t> horizontal((size_t)rows * bytes);
+
+    parallelFor(0, rows, [&](int r0, int r1) {
+        for (int r = r0; r < r1; r++) {
+            horizontalPass(classes + (size_t)r * bytes, bytes, &horizontal[(size_t)r * bytes]);
+        }
+    }, 32);
+
+    parallelFor(0, rows, [&](int r0, int r1) {
+        for (int r = r0; r < r1; r++) {
+            const uint8_t* src = classes + (size_t)r * bytes;
+            uint8_t* dst = out + (size_t)r * bytes;
+            if (r == 0 || r == rows - 1) {
+                for (int i = 0; i < bytes; i++) dst[i] = src[i] ? 255 : 0;
+                continue;
+            }
+            verticalPass(&horizontal[(size_t)(r - 1) * bytes], &horizontal[(size_t)r * bytes],
+                         &horizontal[(size_t)(r + 1) * bytes], bytes, dst);
+            for (int i = MATERIAL_CHANNELS; i < bytes - MATERIAL_CHANNELS; i++) dst[i] = MATERIAL_WINDOW_WEIGHT[dst[i]];
+            for (int k = 0; k < MATERIAL_CHANNELS; k++) {
+                dst[k] = src[k] ? 255 : 0;
+                dst[bytes - MATERIAL_CHANNELS + k] = src[bytes - MATERIAL_CHANNELS + k] ? 255 : 0;
+            }
+        }
+    }, 32);
+}
@@ -0,0 +1,29 @@
+#ifndef MATERIAL_LAYER_H
+#define MATERIAL_LAYER_H
+
+#include <cstdint>
+
+/**
+ * Terrain material weights are stored as interleaved byte pairs per sample:
+ * rock in the first byte, bouncy in the second, grass is what is left of 255.
+ * The same bytes are uploaded as the GL_RG8 splat map.
+ */
+static const int MATERIAL_CHANNELS = 2;
+
+/** Weight of a 3x3 window holding count (0..9) flagged samples */
+static const uint8_t MATERIAL_WINDOW_WEIGHT[10] = { 0, 28, 57, 85, 113, 142, 170, 198, 227, 255 };
+
+/** Signed ground type of one sample: +1 all rock, -1 all bouncy, 0 grass */
+inline float materialType(const uint8_t* weights) {
+    return (float)((int)weights[0] - (int)weights[1]) * (1.0f / 255.0f);
+}
+
+/**
+ * 3x3 box filter of per-sample class flags (0 or 1 per channel) into 0..255
+ * weights, done as a horizontal and a vertical 3-tap pass (SSE2 when
+ * available). Border samples keep their unfiltered class like before.
+ * Rows are split across worker threads.
+ */
+void blurMaterials(const uint8_t* classes, int rows, int cols, uint8_t* out);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+/** Number of worker threads to use for data-parallel loops */
+inline int workerCount() {
+    unsigned int n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : (int)n;
+}
+
+/**
+ * Splits [begin, end) into contiguous chunks of at least minChunk items and
+ * calls body(chunkBegin, chunkEnd) for each chunk on its own thread. The
+ * calling thread processes the first chunk. Bodies must only write to the
+ * items of their own chunk.
+ */
+inline void parallelFor(int begin, int end, const std::function<void(int, int)>& body, int minChunk = 1) {
+    int count = end - begin;
+    if (count <= 0) return;
+
+    int chunks = std::min(workerCount(), (count + minChunk - 1) / std::max(minChunk, 1));
+    if (chunks <= 1) {
+        body(begin, end);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(chunks - 1);
+    for (int i = 1; i < chunks; i++) {
+        int b = begin + (int)((long long)count * i / chunks);
+        int e = begin + (int)((long long)count * (i + 1) / chunks);
+        threads.push_back(std::thread(body, b, e));
+    }
+    body(begin, begin + (int)((long long)count / chunks));
+    for (auto& t : threads) t.join();
+}
+
+#endif
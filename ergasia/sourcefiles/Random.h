@@ -0,0 +1,49 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+/**
+ * Integer avalanche hash (lowbias32). Every bit of the input affects every
+ * bit of the output, so consecutive counters give unrelated values.
+ */
+inline uint32_t hash32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+/**
+ * Counter-based random stream. The n-th draw is a pure function of
+ * (seed, stream, n), so a stream gives the same numbers no matter which
+ * thread evaluates it or how the work was partitioned.
+ */
+class CounterRng {
+public:
+    CounterRng(uint32_t seed, uint32_t stream)
+        : key(hash32(seed ^ hash32(stream + 0x9e3779b9U))), counter(0) {
+    }
+
+    uint32_t next() {
+        return hash32(key + hash32(counter++));
+    }
+
+    /** Uniform float in [a, b) with 24 bits of precision */
+    float uniform(float a, float b) {
+        float u = (next() >> 8) * (1.0f / 16777216.0f);
+        return a + (b - a) * u;
+    }
+
+    /** Uniform integer in [a, b] (inclusive, like std::uniform_int_distribution) */
+    int uniformInt(int a, int b) {
+        return a + (int)(next() % (uint32_t)(b - a + 1));
+    }
+
+private:
+    uint32_t key, counter;
+};
+
+#endif
@@ -4,6 +4,7 @@ using namespace glm;
 
 RigidBody::RigidBody() {
     m = 1;
+    integrator = RUNGE_KUTTA_4;
 
     x = v = w = P = L = vec3(0, 0, 0);
 
@@ -13,14 +14,60 @@ RigidBody::RigidBody() {
     R = mat3(1, 0, 0, 0, 1, 0, 0, 0, 1);
 #endif
 
-    I_inv = mat3(1, 0, 0, 0, 1, 0, 0, 0, 1);
+    setInertia(mat3(1, 0, 0, 0, 1, 0, 0, 0, 1));
 }
 
 RigidBody::~RigidBody() {
 }
 
-std::vector<float> RigidBody::getY() {
-    std::vector<float> state(STATES);
+void RigidBody::setInertia(const mat3& inertia) {
+    I_body = inertia;
+    I_body_inv = inverse(inertia);
+    isotropic = I_body[0][0] == I_body[1][1] && I_body[1][1] == I_body[2][2]
+        && I_body[0][1] == 0 && I_body[0][2] == 0 && I_body[1][2] == 0
+        && I_body[1][0] == 0 && I_body[2][0] == 0 && I_body[2][1] == 0;
+    // R * (s * 1) * R^T = s * 1, the world tensors equal the body ones
+    I_inv = I_body_inv;
+    I_world = I_body;
+    inertiaValid = false;
+    updateInertia();
+}
+
+void RigidBody::updateInertia() {
+#ifdef USE_QUATERNIONS
+    if (isotropic || (inertiaValid && inertiaOrientation == q)) return;
+    inertiaOrientation = q;
+    mat3 R = mat3_cast(q);
+#else
+    if (isotropic || (inertiaValid && inertiaOrientation == R)) return;
+    inertiaOrientation = R;
+#endif
+    // always from the body-space tensors, never from the previous world one
+    inertiaValid = true;
+    mat3 RT = transpose(R);
+    I_inv = R * I_body_inv * RT;
+    I_world = R * I_body * RT;
+}
+
+mat3 RigidBody::worldInverseInertia(const State& y) const {
+#ifdef USE_QUATERNIONS
+    quat qy = normalize(quat(y[6], y[3], y[4], y[5]));
+    if (inertiaValid && qy == inertiaOrientation) return I_inv;
+    mat3 Ry = mat3_cast(qy);
+#else
+    mat3 Ry;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            Ry[i][j] = y[3 + i * 3 + j];
+        }
+    }
+    if (inertiaValid && Ry == inertiaOrientation) return I_inv;
+#endif
+    return Ry * I_body_inv * transpose(Ry);
+}
+
+RigidBody::State RigidBody::getY() const {
+    State state;
     int k = 0;
 
     state[k++] = x.x;
@@ -51,7 +98,7 @@ std::vector<float> RigidBody::getY() {
     return state;
 }
 
-void RigidBody::setY(const std::vector<float>& y) {
+void RigidBody::setY(const State& y) {
     int k = 0;
     x.x = y[k++];
     x.y = y[k++];
@@ -84,23 +131,36 @@ void RigidBody::setY(const std::vector<float>& y) {
     // update inertia matrix
 #ifdef USE_QUATERNIONS
     q = normalize(q);
-    mat3 R = mat3_cast(q);
-    I_inv = R * I_inv * transpose(R);
 #else
     // must ensure that |R| = 1
-    I_inv = R * I_inv * transpose(R);
 #endif
+    updateInertia();
 
     // angular momentum
     w = I_inv * L;
 }
 
-std::vector<float> RigidBody::dydt(float t, const std::vector<float>& y) {
-    // store initial state and override state
-    std::vector<float> y0 = getY();
-    setY(y);
+void RigidBody::dydt(float t, const State& y, State& yDot) const {
+    kinematics(y, yDot);
+
+    Wrench wrench;
+    wrench.force = wrench.torque = vec3(0.0f);
+    forcing(t, y, wrench);
+    //P_dot = f
+    yDot[P_INDEX] = wrench.force.x;
+    yDot[P_INDEX + 1] = wrench.force.y;
+    yDot[P_INDEX + 2] = wrench.force.z;
+
+    //L_dot = tau
+    yDot[L_INDEX] = wrench.torque.x;
+    yDot[L_INDEX + 1] = wrench.torque.y;
+    yDot[L_INDEX + 2] = wrench.torque.z;
+}
 
-    std::vector<float> yDot(STATES);
+void RigidBody::kinematics(const State& y, State& yDot) const {
+    // velocities of y, the body itself is left alone
+    vec3 v = velocity(y);
+    vec3 w = angularVelocity(y);
     int k = 0;
 
     //yDot = u
@@ -110,6 +170,7 @@ std::vector<float> RigidBody::dydt(float t, const std::vector<float>& y) {
 
 #ifdef USE_QUATERNIONS
     //q_dot = 1 / 2 * w * q;
+    quat q = normalize(quat(y[6], y[3], y[4], y[5]));
     quat w_hat = quat(0, w);
     quat q_dot = (w_hat * q) / 2.0f;
 
@@ -118,6 +179,12 @@ std::vector<float> RigidBody::dydt(float t, const std::vector<float>& y) {
     yDot[k++] = q_dot.z;
     yDot[k++] = q_dot.w;
 #else
+    mat3 R;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            R[i][j] = y[3 + i * 3 + j];
+        }
+    }
     mat3 w_hat = mat3(
         0, -w.z, w.y,
         w.z, 0, -w.x,
@@ -130,76 +197,47 @@ std::vector<float> RigidBody::dydt(float t, const std::vector<float>& y) {
         }
     }
 #endif
-
-    auto forces = forcing(t, y);
-    //P_dot = f
-    yDot[k++] = forces[0];
-    yDot[k++] = forces[1];
-    yDot[k++] = forces[2];
-
-    //L_dot = tau
-    yDot[k++] = forces[3];
-    yDot[k++] = forces[4];
-    yDot[k++] = forces[5];
-
-    // restore initial state
-    setY(y0);
-
-    return yDot;
 }
 
 float RigidBody::calcKinecticEnergy() {
-    return 0.5f * m * dot(v, v) + 0.5f * dot(w, glm::inverse(I_inv) * w);
+    updateInertia();
+    return 0.5f * m * dot(v, v) + 0.5f * dot(w, I_world * w);
 }
 
 float RigidBody::calcPEnergy() {
     return -x.y *9.80665f * m;
 }
 
-std::vector<float> RigidBody::euler(float t, float h, const std::vector<float>& y0) {
-    std::vector<float> y1(STATES);
-    std::vector<float> dydt0 = dydt(t, y0);
-    for (int i = 0; i < STATES; i++) {
-        y1[i] = y0[i] + h * dydt0[i];
-    }
+RigidBody::State RigidBody::euler(float t, float h, const State& y0) const {
+    State y1;
+    eulerStep(t, h, y0, y1, [this](float t, const State& y, State& yDot) { dydt(t, y, yDot); });
     return y1;
 }
 
-std::vector<float> RigidBody::rungeKuta4th(float t, float h, const std::vector<float>& y0) {
-    // dydt0 = dydt(x0)
-    std::vector<float> dydt0 = dydt(t, y0);
-
-    // y1 = y0 + h * dydt0 / 2
-    std::vector<float> y1(STATES);
-    for (int i = 0; i < STATES; i++) {
-        y1[i] = y0[i] + h * dydt0[i] / 2.0f;
-    }
-    std::vector<float> dydt1 = dydt(t + h / 2.0f, y1);
-
-    // y2 = y0 + h * dydt1 / 2
-    std::vector<float> y2(STATES);
-    for (int i = 0; i < STATES; i++) {
-        y2[i] = y0[i] + h * dydt1[i] / 2.0f;
-    }
-    std::vector<float> dydt2 = dydt(t + h / 2.0f, y2);
-
-    // y2 = y0 + h * dydt1 / 2
-    std::vector<float> y3(STATES);
-    for (int i = 0; i < STATES; i++) {
-        y3[i] = y0[i] + h * dydt2[i];
-    }
-    std::vector<float> dydt3 = dydt(t + h, y3);
-
-    // combine them to estimate the solution.
-    std::vector<float> y4(STATES);
-    for (int i = 0; i < STATES; i++) {
-        y4[i] = y0[i] + h * (dydt0[i] + 2.0f * dydt1[i]
-                             + 2.0f * dydt2[i] + dydt3[i]) / 6.0f;
-    }
-    return y4;
+RigidBody::State RigidBody::rungeKuta4th(float t, float h, const State& y0) const {
+    State y1;
+    rungeKutta4Step(t, h, y0, y1, [this](float t, const State& y, State& yDot) { dydt(t, y, yDot); });
+    return y1;
 }
+
 void RigidBody::advanceState(float t, float h) {
-    // Task 2e:
-    //setY(euler(t, h, getY()));
-    setY(rungeKuta4th(t, h, getY()));
+    // Task 2e: euler() is kept for comparison, the symplectic ones are the cheap choice
+    State y = getY();
+    auto f = [this](float t, const State& y, State& yDot) { dydt(t, y, yDot); };
+    auto rates = [this](const State& y, State& yDot) { kinematics(y, yDot); };
+    switch (integrator) {
+    case SEMI_IMPLICIT_EULER:
+        semiImplicitEulerStep(t, h, y, y, P_INDEX, f, rates);
+        break;
+    case VELOCITY_VERLET:
+        velocityVerletStep(t, h, y, y, P_INDEX, f, rates);
+        break;
+    case DORMAND_PRINCE_45:
+        adaptiveStep(t, h, y, f, stepControl, stepReport);
+        break;
+    default:
+        rungeKutta4Step(t, h, y, y, f);
+        break;
+    }
+    setY(y);
 }
\ No newline at end of file
@@ -1,11 +1,12 @@
 #ifndef RIGID_BODY_H
 #define RIGID_BODY_H
 
-#include <vector>
+#include <array>
 #include <functional>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include "Integrator.h"
 
 /**
  * Task 1b: use rotation matrix to encode the orientation of a rigid body
@@ -24,11 +25,24 @@ public:
 #else
     static const int STATES = 18;
 #endif
+    /** y = [x, q (or R), P, L] */
+    typedef std::array<float, STATES> State;
+    static const int P_INDEX = STATES - 6;
+    static const int L_INDEX = STATES - 3;
+
+    /** applied force and torque, both in world space */
+    struct Wrench {
+        glm::vec3 force, torque;
+    };
+
     /** m: mass */
     float m;
     /** x: position, v: velocity, w: angular velocity */
     glm::vec3 x, v, w;
-    /** I_inv: inverse inertia matrix */
+    /**
+     * I_inv: world-space inverse inertia, derived from the body-space tensor
+     * whenever the orientation changes; set the tensor with setInertia()
+     */
     glm::mat3 I_inv;
     /** the orientation of a rigid body can be encoded by a 3D rotation matrix
     or by a quaternion */
@@ -40,34 +54,67 @@ public:
     /** P: momentum, L: angular momentum */
     glm::vec3 P, L;
     /**
-     * The forcing function accepts t, y and returns a vector of 6 floats
-     * [fx, fy, fz, taux, tauy, tauz] corresponding to the values of the
-     * applied forces. By default zero forces are applied, otherwise the user
-     * must specify the forcing function.
+     * The forcing function receives t and the state y being evaluated, which
+     * during a Runge-Kutta step is not the body's own state (read it with
+     * position(), velocity() and angularVelocity()), and writes the applied
+     * force and torque into the wrench, which starts zeroed. By default no
+     * forces are applied.
      */
-    std::function<std::vector<float>(float t, const std::vector<float>& y)> forcing =
-        [](float t, const std::vector<float>& y)->std::vector<float> {
-        std::vector<float> f(6, 0.0f);
-        return f;
-    };
+    std::function<void(float t, const State& y, Wrench& wrench)> forcing =
+        [](float, const State&, Wrench&) {};
+    /** how advanceState() steps, RUNGE_KUTTA_4 by default */
+    IntegratorType integrator;
+    /** tolerances of DORMAND_PRINCE_45 and what it did in the last advanceState() */
+    StepControl stepControl;
+    StepReport stepReport;
 
     RigidBody();
     ~RigidBody();
+    /** Sets the body-space inertia tensor, stored once with its inverse */
+    void setInertia(const glm::mat3& I_body);
     /** Get state vector y */
-    std::vector<float> getY();
-    /** Get state vector y */
-    void setY(const std::vector<float>& y);
-    /** Get state derivative vector dy / dt */
-    std::vector<float> dydt(float t, const std::vector<float>& y);
+    State getY() const;
+    /** Set state vector y */
+    void setY(const State& y);
+    /** Writes the state derivative dy / dt without changing the body */
+    void dydt(float t, const State& y, State& yDot) const;
+    /** Writes only the position and orientation rates of y, no forces are evaluated */
+    void kinematics(const State& y, State& yDot) const;
+    /** Quantities of a state y with this body's mass and inertia */
+    static glm::vec3 position(const State& y) { return glm::vec3(y[0], y[1], y[2]); }
+    glm::vec3 velocity(const State& y) const { return glm::vec3(y[P_INDEX], y[P_INDEX + 1], y[P_INDEX + 2]) / m; }
+    glm::vec3 angularVelocity(const State& y) const {
+        glm::vec3 L(y[L_INDEX], y[L_INDEX + 1], y[L_INDEX + 2]);
+        return isotropic ? I_body_inv * L : worldInverseInertia(y) * L;
+    }
     /** Calculate the kinetic energy of the rigid body KE = 1/2 m u^T u + 1/2 w^T I w */
     float calcKinecticEnergy();
     float calcPEnergy();
     /** Euler method for advancing the state y(t + h) = y(t) + h dy(t) / dt */
-    std::vector<float> euler(float t, float h, const std::vector<float>& y0);
+    State euler(float t, float h, const State& y0) const;
     /** Runge-Kutta 4th order for advancing the state (error/step ~ O(h^5) */
-    std::vector<float> rungeKuta4th(float t, float h, const std::vector<float>& y0);
-    /** Advances the state from t to t + h using Euler or RunkeKutta */
+    State rungeKuta4th(float t, float h, const State& y0) const;
+    /** Advances the state from t to t + h with the selected integrator */
     void advanceState(float t, float h);
+
+private:
+    /** body-space inertia and its inverse, isotropic ones never need rotating */
+    glm::mat3 I_body, I_body_inv;
+    bool isotropic;
+    /** world-space inertia for calcKinecticEnergy, valid with I_inv */
+    glm::mat3 I_world;
+    /** orientation I_inv and I_world were derived for, if inertiaValid */
+    bool inertiaValid;
+#ifdef USE_QUATERNIONS
+    glm::quat inertiaOrientation;
+#else
+    glm::mat3 inertiaOrientation;
+#endif
+
+    /** Re-derives I_inv and I_world if the orientation moved since the last call */
+    void updateInertia();
+    /** R I_body^-1 R^T for the orientation of y, I_inv when it is the cached one */
+    glm::mat3 worldInverseInertia(const State& y) const;
 };
 
 #endif
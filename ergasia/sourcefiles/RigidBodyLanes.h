@@ -0,0 +1,234 @@
+#ifndef RIGID_BODY_LANES_H
+#define RIGID_BODY_LANES_H
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RIGID_BODY_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+/**
+ * Private to RigidBodyWorld: the body kernel written once against a small
+ * lane type, then instantiated for plain floats, SSE2 and AVX. The AVX
+ * instantiation lives in a translation unit built with AVX enabled, so
+ * everything here has internal linkage and no copy compiled for one
+ * instruction set can be picked by the linker for another. Only the plain
+ * structs below are shared between the two.
+ */
+
+/** Pointers to the first element of each structure-of-arrays field */
+struct BodyArrays {
+    float *x, *y, *z;
+    float *qw, *qx, *qy, *qz;
+    float *px, *py, *pz;
+    float *lx, *ly, *lz;
+    const float *mass, *invMass, *invIx, *invIy, *invIz;
+    const float *radius, *restitution, *friction;
+    /** ground height and normal under each body, sampled before the step */
+    const float *groundY, *nx, *ny, *nz;
+    /** 1 for awake bodies, 0 for sleeping ones, which the step leaves alone */
+    const float *awake;
+    /** 1 where the step pushes a body out of the ground, 0 where the contact solver already did */
+    const float *pushOut;
+};
+
+struct StepParameters {
+    float dt, gx, gy, gz;
+    /** share of the step's gravity applied before the drift, the rest after it */
+    float kick;
+    /** deceleration of touching bodies from rolling resistance */
+    float rollingDecel;
+};
+
+namespace {
+
+struct Lanes1 {
+    static const int WIDTH = 1;
+    typedef bool Mask;
+    float v;
+    Lanes1() {}
+    Lanes1(float s) : v(s) {}
+    static Lanes1 load(const float* p) { return Lanes1(*p); }
+    void store(float* p) const { *p = v; }
+};
+inline Lanes1 operator+(Lanes1 a, Lanes1 b) { return Lanes1(a.v + b.v); }
+inline Lanes1 operator-(Lanes1 a, Lanes1 b) { return Lanes1(a.v - b.v); }
+inline Lanes1 operator*(Lanes1 a, Lanes1 b) { return Lanes1(a.v * b.v); }
+inline Lanes1 operator/(Lanes1 a, Lanes1 b) { return Lanes1(a.v / b.v); }
+inline bool operator<(Lanes1 a, Lanes1 b) { return a.v < b.v; }
+inline Lanes1 min(Lanes1 a, Lanes1 b) { return Lanes1(std::min(a.v, b.v)); }
+inline Lanes1 max(Lanes1 a, Lanes1 b) { return Lanes1(std::max(a.v, b.v)); }
+inline Lanes1 sqrt(Lanes1 a) { return Lanes1(std::sqrt(a.v)); }
+inline Lanes1 select(bool m, Lanes1 a, Lanes1 b) { return m ? a : b; }
+inline bool both(bool a, bool b) { return a && b; }
+
+#ifdef RIGID_BODY_SSE2
+struct Lanes4 {
+    static const int WIDTH = 4;
+    struct Mask { __m128 v; };
+    __m128 v;
+    Lanes4() {}
+    Lanes4(__m128 v) : v(v) {}
+    Lanes4(float s) : v(_mm_set1_ps(s)) {}
+    static Lanes4 load(const float* p) { return Lanes4(_mm_loadu_ps(p)); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+inline Lanes4 operator+(Lanes4 a, Lanes4 b) { return Lanes4(_mm_add_ps(a.v, b.v)); }
+inline Lanes4 operator-(Lanes4 a, Lanes4 b) { return Lanes4(_mm_sub_ps(a.v, b.v)); }
+inline Lanes4 operator*(Lanes4 a, Lanes4 b) { return Lanes4(_mm_mul_ps(a.v, b.v)); }
+inline Lanes4 operator/(Lanes4 a, Lanes4 b) { return Lanes4(_mm_div_ps(a.v, b.v)); }
+inline Lanes4::Mask operator<(Lanes4 a, Lanes4 b) { Lanes4::Mask m = { _mm_cmplt_ps(a.v, b.v) }; return m; }
+inline Lanes4 min(Lanes4 a, Lanes4 b) { return Lanes4(_mm_min_ps(a.v, b.v)); }
+inline Lanes4 max(Lanes4 a, Lanes4 b) { return Lanes4(_mm_max_ps(a.v, b.v)); }
+inline Lanes4 sqrt(Lanes4 a) { return Lanes4(_mm_sqrt_ps(a.v)); }
+inline Lanes4 select(Lanes4::Mask m, Lanes4 a, Lanes4 b) {
+    return Lanes4(_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)));
+}
+inline Lanes4::Mask both(Lanes4::Mask a, Lanes4::Mask b) { Lanes4::Mask m = { _mm_and_ps(a.v, b.v) }; return m; }
+#endif
+
+#ifdef __AVX__
+struct Lanes8 {
+    static const int WIDTH = 8;
+    struct Mask { __m256 v; };
+    __m256 v;
+    Lanes8() {}
+    Lanes8(__m256 v) : v(v) {}
+    Lanes8(float s) : v(_mm256_set1_ps(s)) {}
+    static Lanes8 load(const float* p) { return Lanes8(_mm256_loadu_ps(p)); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+inline Lanes8 operator+(Lanes8 a, Lanes8 b) { return Lanes8(_mm256_add_ps(a.v, b.v)); }
+inline Lanes8 operator-(Lanes8 a, Lanes8 b) { return Lanes8(_mm256_sub_ps(a.v, b.v)); }
+inline Lanes8 operator*(Lanes8 a, Lanes8 b) { return Lanes8(_mm256_mul_ps(a.v, b.v)); }
+inline Lanes8 operator/(Lanes8 a, Lanes8 b) { return Lanes8(_mm256_div_ps(a.v, b.v)); }
+inline Lanes8::Mask operator<(Lanes8 a, Lanes8 b) { Lanes8::Mask m = { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; return m; }
+inline Lanes8 min(Lanes8 a, Lanes8 b) { return Lanes8(_mm256_min_ps(a.v, b.v)); }
+inline Lanes8 max(Lanes8 a, Lanes8 b) { return Lanes8(_mm256_max_ps(a.v, b.v)); }
+inline Lanes8 sqrt(Lanes8 a) { return Lanes8(_mm256_sqrt_ps(a.v)); }
+inline Lanes8 select(Lanes8::Mask m, Lanes8 a, Lanes8 b) { return Lanes8(_mm256_blendv_ps(b.v, a.v, m.v)); }
+inline Lanes8::Mask both(Lanes8::Mask a, Lanes8::Mask b) { Lanes8::Mask m = { _mm256_and_ps(a.v, b.v) }; return m; }
+#endif
+
+/** out = R diag(invI) R^T in, R given row by row */
+template <typename V>
+inline void mulInverseInertia(const V R[9], const V& ix, const V& iy, const V& iz,
+                              const V& ax, const V& ay, const V& az, V& ox, V& oy, V& oz) {
+    V bx = (R[0] * ax + R[3] * ay + R[6] * az) * ix;
+    V by = (R[1] * ax + R[4] * ay + R[7] * az) * iy;
+    V bz = (R[2] * ax + R[5] * ay + R[8] * az) * iz;
+    ox = R[0] * bx + R[1] * by + R[2] * bz;
+    oy = R[3] * bx + R[4] * by + R[5] * bz;
+    oz = R[6] * bx + R[7] * by + R[8] * bz;
+}
+
+/**
+ * One semi-implicit Euler or velocity Verlet step (p.kick 1 or 1/2) of
+ * bodies [begin, end), a multiple of V::WIDTH: gravity, a sphere-against-ground-plane contact impulse with
+ * restitution and Coulomb friction at the contact point (which is what
+ * makes bodies roll), rolling resistance, drift, push-out and the
+ * orientation update. Lanes with b.awake 0 are left as they are.
+ */
+template <typename V>
+void integrateBodies(const BodyArrays& b, int begin, int end, const StepParameters& p) {
+    const V zero(0.0f), one(1.0f), half(0.5f), two(2.0f);
+    for (int i = begin; i < end; i += V::WIDTH) {
+        // sleeping bodies have no momentum, a zero step leaves them where they are
+        V awake = V::load(b.awake + i);
+        V dt = V(p.dt) * awake;
+        V x = V::load(b.x + i), y = V::load(b.y + i), z = V::load(b.z + i);
+        V qw = V::load(b.qw + i), qx = V::load(b.qx + i), qy = V::load(b.qy + i), qz = V::load(b.qz + i);
+        V mass = V::load(b.mass + i), invMass = V::load(b.invMass + i);
+        V ix = V::load(b.invIx + i), iy = V::load(b.invIy + i), iz = V::load(b.invIz + i);
+        V radius = V::load(b.radius + i);
+        V nx = V::load(b.nx + i), ny = V::load(b.ny + i), nz = V::load(b.nz + i);
+
+        // gravity, the first kick
+        V kick = mass * dt * V(p.kick), afterKick = mass * dt * V(1.0f - p.kick);
+        V px = V::load(b.px + i) + V(p.gx) * kick;
+        V py = V::load(b.py + i) + V(p.gy) * kick;
+        V pz = V::load(b.pz + i) + V(p.gz) * kick;
+        V lx = V::load(b.lx + i), ly = V::load(b.ly + i), lz = V::load(b.lz + i);
+
+        V R[9] = {
+            one - two * (qy * qy + qz * qz), two * (qx * qy - qw * qz), two * (qx * qz + qw * qy),
+            two * (qx * qy + qw * qz), one - two * (qx * qx + qz * qz), two * (qy * qz - qw * qx),
+            two * (qx * qz - qw * qy), two * (qy * qz + qw * qx), one - two * (qx * qx + qy * qy)
+        };
+        V wx, wy, wz;
+        mulInverseInertia(R, ix, iy, iz, lx, ly, lz, wx, wy, wz);
+
+        // the ground is the plane through the sample under the body
+        V penetration = radius - (y - V::load(b.groundY + i)) * ny;
+        typename V::Mask touching = zero < penetration;
+
+        // velocity of the contact point r = -radius n
+        V rx = zero - radius * nx, ry = zero - radius * ny, rz = zero - radius * nz;
+        V cx = px * invMass + (wy * rz - wz * ry);
+        V cy = py * invMass + (wz * rx - wx * rz);
+        V cz = pz * invMass + (wx * ry - wy * rx);
+        V vn = cx * nx + cy * ny + cz * nz;
+
+        // normal impulse through the center, slow contacts do not bounce
+        V bounce = select(vn < V(-1.0f), V::load(b.restitution + i), zero);
+        V jn = select(both(touching, vn < zero), zero - (one + bounce) * vn * mass, zero);
+
+        // friction impulse against the sliding velocity, capped by Coulomb
+        V tx = cx - vn * nx, ty = cy - vn * ny, tz = cz - vn * nz;
+        V slide = sqrt(tx * tx + ty * ty + tz * tz);
+        V invSlide = one / max(slide, V(1e-6f));
+        tx = tx * invSlide; ty = ty * invSlide; tz = tz * invSlide;
+        V ax, ay, az;
+        mulInverseInertia(R, ix, iy, iz, ry * tz - rz * ty, rz * tx - rx * tz, rx * ty - ry * tx, ax, ay, az);
+        V k = invMass + tx * (ay * rz - az * ry) + ty * (az * rx - ax * rz) + tz * (ax * ry - ay * rx);
+        V jt = select(touching, max(zero - slide / k, zero - V::load(b.friction + i) * jn), zero);
+
+        px = px + nx * jn + tx * jt;
+        py = py + ny * jn + ty * jt;
+        pz = pz + nz * jn + tz * jt;
+        lx = lx + (ry * tz - rz * ty) * jt;
+        ly = ly + (rz * tx - rx * tz) * jt;
+        lz = lz + (rx * ty - ry * tx) * jt;
+
+        // rolling resistance slows touching bodies by a fixed amount, so
+        // they come to rest on gentle slopes instead of rolling forever
+        V speed = sqrt(px * px + py * py + pz * pz) * invMass;
+        V keep = select(touching, max(speed - V(p.rollingDecel) * dt, zero) / max(speed, V(1e-6f)), one);
+        px = px * keep; py = py * keep; pz = pz * keep;
+        lx = lx * keep; ly = ly * keep; lz = lz * keep;
+        mulInverseInertia(R, ix, iy, iz, lx, ly, lz, wx, wy, wz);
+
+        // drift, then out of the ground along its normal
+        V push = max(penetration, zero) * awake * V::load(b.pushOut + i);
+        x = x + px * invMass * dt + nx * push;
+        y = y + py * invMass * dt + ny * push;
+        z = z + pz * invMass * dt + nz * push;
+        px = px + V(p.gx) * afterKick;
+        py = py + V(p.gy) * afterKick;
+        pz = pz + V(p.gz) * afterKick;
+
+        // dq = 1/2 (0, w) q, renormalized
+        V hdt = half * dt;
+        V dw = zero - (wx * qx + wy * qy + wz * qz);
+        V dx = qw * wx + (wy * qz - wz * qy);
+        V dy = qw * wy + (wz * qx - wx * qz);
+        V dz = qw * wz + (wx * qy - wy * qx);
+        qw = qw + hdt * dw; qx = qx + hdt * dx; qy = qy + hdt * dy; qz = qz + hdt * dz;
+        V invLen = one / sqrt(qw * qw + qx * qx + qy * qy + qz * qz);
+
+        x.store(b.x + i); y.store(b.y + i); z.store(b.z + i);
+        (qw * invLen).store(b.qw + i); (qx * invLen).store(b.qx + i);
+        (qy * invLen).store(b.qy + i); (qz * invLen).store(b.qz + i);
+        px.store(b.px + i); py.store(b.py + i); pz.store(b.pz + i);
+        lx.store(b.lx + i); ly.store(b.ly + i); lz.store(b.lz + i);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,463 @@
+#include "RigidBodyWorld.h"
+#include "RigidBodyLanes.h"
+#include "HeightField.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <functional>
+#include <glm/gtc/matrix_transform.hpp>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+// defined in RigidBodyWorldAvx.cpp
+bool rigidBodyAvxBuilt();
+void integrateBodiesAvx(const BodyArrays& bodies, int begin, int end, const StepParameters& p);
+
+// every field is padded to this many bodies so the widest path never reads past the end
+static const int MAX_LANES = 8;
+// bodies per thread below which a step stays on the calling thread
+static const int MIN_BODIES_PER_THREAD = 1024;
+// ground height that never touches, for padding and when there is no ground
+static const float NO_GROUND = -1e30f;
+// bodies closer than this beyond touching still count as touching for islands
+static const float CONTACT_MARGIN = 0.05f;
+
+static bool cpuHasAvx() {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_cpu_supports("avx") != 0;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    // AVX and OSXSAVE, then the OS must save the ymm registers
+    bool avx = (info[2] & (1 << 28)) && (info[2] & (1 << 27));
+    return avx && (_xgetbv(0) & 6) == 6;
+#else
+    return false;
+#endif
+}
+
+RigidBodyWorld::RigidBodyWorld(HeightField* ground)
+    : gravity(0.0f, -9.80665f, 0.0f), ground(ground), lanes(1), integrator(SEMI_IMPLICIT_EULER), rollingResistance(0.1f), solverIterations(8), allowSleep(true),
+      sleepVelocity(0.1f), sleepAngularVelocity(0.5f), sleepTime(0.5f), count(0), maxRadius(0.0f), staleSleepers(0) {
+#ifdef RIGID_BODY_SSE2
+    lanes = 4;
+#endif
+    if (rigidBodyAvxBuilt() && cpuHasAvx()) lanes = 8;
+}
+
+int RigidBodyWorld::addBody(const vec3& position, float mass, float radius, float restitution, float friction) {
+    int i = count++;
+    if (i >= (int)fields[X].size()) {
+        // padding bodies sit at rest far above a ground they never touch
+        static const float padding[FIELD_COUNT] = {
+            0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 1, 0, 0,
+            NO_GROUND, 0, 1, 0,
+            0, 1,
+            0, 0, 0, 1, 0, 0, 0
+        };
+        size_t size = fields[X].size() * 2 + MAX_LANES;
+        for (int f = 0; f < FIELD_COUNT; f++) fields[f].resize(size, padding[f]);
+    }
+    float inertia = 0.4f * mass * radius * radius;
+    float values[] = { position.x, position.y, position.z, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                       mass, 1.0f / mass, 1.0f / inertia, 1.0f / inertia, 1.0f / inertia,
+                       radius, restitution, friction };
+    for (int f = X; f <= FRICTION; f++) fields[f][i] = values[f];
+    fields[PREV_X][i] = position.x;
+    fields[PREV_Y][i] = position.y;
+    fields[PREV_Z][i] = position.z;
+    fields[PREV_QW][i] = 1.0f;
+    fields[AWAKE][i] = 1.0f;
+    restTime.push_back(0.0f);
+    nextInIsland.push_back(i);
+    awakeBodies.push_back(i);
+    maxRadius = std::max(maxRadius, radius);
+    return i;
+}
+
+void RigidBodyWorld::setInertia(int i, const vec3& principal) {
+    fields[INV_IX][i] = 1.0f / principal.x;
+    fields[INV_IY][i] = 1.0f / principal.y;
+    fields[INV_IZ][i] = 1.0f / principal.z;
+}
+
+void RigidBodyWorld::setVelocity(int i, const vec3& velocity) {
+    wake(i);
+    fields[PX][i] = fields[MASS][i] * velocity.x;
+    fields[PY][i] = fields[MASS][i] * velocity.y;
+    fields[PZ][i] = fields[MASS][i] * velocity.z;
+}
+
+void RigidBodyWorld::applyImpulse(int i, const vec3& impulse) {
+    wake(i);
+    fields[PX][i] += impulse.x;
+    fields[PY][i] += impulse.y;
+    fields[PZ][i] += impulse.z;
+}
+
+vec3 RigidBodyWorld::position(int i) const {
+    return vec3(fields[X][i], fields[Y][i], fields[Z][i]);
+}
+
+quat RigidBodyWorld::orientation(int i) const {
+    return quat(fields[QW][i], fields[QX][i], fields[QY][i], fields[QZ][i]);
+}
+
+vec3 RigidBodyWorld::velocity(int i) const {
+    return vec3(fields[PX][i], fields[PY][i], fields[PZ][i]) * fields[INV_MASS][i];
+}
+
+void RigidBodyWorld::wake(int i) {
+    restTime[i] = 0.0f;
+    if (isAwake(i)) return;
+    // unlink the whole ring
+    int j = i;
+    do {
+        int next = nextInIsland[j];
+        fields[AWAKE][j] = 1.0f;
+        restTime[j] = 0.0f;
+        nextInIsland[j] = j;
+        awakeBodies.push_back(j);
+        staleSleepers++;
+        j = next;
+    } while (j != i);
+}
+
+void RigidBodyWorld::wakeInside(const vec3& center, float radius) {
+    for (int i = 0; i < count; i++) {
+        float reach = radius + fields[RADIUS][i];
+        vec3 d = position(i) - center;
+        if (!isAwake(i) && dot(d, d) < reach * reach) wake(i);
+    }
+}
+
+void RigidBodyWorld::bodiesNear(const vec3& center, float radius, vector<int>& out) const {
+    out.clear();
+    for (int i = 0; i < count; i++) {
+        float reach = radius + fields[RADIUS][i];
+        vec3 d = position(i) - center;
+        if (dot(d, d) < reach * reach) out.push_back(i);
+    }
+}
+
+int RigidBodyWorld::addToSolver(int i, ContactSolver& solver, const vec3& dv) const {
+    mat3 R = mat3_cast(orientation(i));
+    mat3 inverse(0.0f);
+    inverse[0][0] = fields[INV_IX][i];
+    inverse[1][1] = fields[INV_IY][i];
+    inverse[2][2] = fields[INV_IZ][i];
+    mat3 invI = R * inverse * transpose(R);
+    float invMass = fields[INV_MASS][i];
+    return solver.addBody(vec3(fields[PX][i], fields[PY][i], fields[PZ][i]) * invMass + dv,
+                          invI * vec3(fields[LX][i], fields[LY][i], fields[LZ][i]), invI, invMass);
+}
+
+void RigidBodyWorld::applySolved(int i, const ContactSolver& solver, int slot) {
+    const ContactSolver::Body& body = solver.body(slot);
+    if (body.dP == vec3(0.0f) && body.dL == vec3(0.0f)) return;
+    wake(i);
+    fields[PX][i] += body.dP.x; fields[PY][i] += body.dP.y; fields[PZ][i] += body.dP.z;
+    fields[LX][i] += body.dL.x; fields[LY][i] += body.dL.y; fields[LZ][i] += body.dL.z;
+}
+
+int RigidBodyWorld::awakeCount() const {
+    return (int)awakeBodies.size();
+}
+
+void RigidBodyWorld::sampleGround(int begin, int end) {
+    float* groundY = field(GROUND_Y);
+    float* nx = field(NX);
+    float* ny = field(NY);
+    float* nz = field(NZ);
+    const float* x = field(X);
+    const float* z = field(Z);
+    const float* awake = field(AWAKE);
+    end = std::min(end, count);
+    for (int i = begin; i < end; i++) {
+        if (awake[i] == 0.0f) continue;
+        if (!ground) {
+            groundY[i] = NO_GROUND;
+            continue;
+        }
+        groundY[i] = ground->getHeightAt(x[i], z[i]);
+        vec3 n = ground->getNormalAt(x[i], z[i]);
+        nx[i] = n.x; ny[i] = n.y; nz[i] = n.z;
+    }
+}
+
+void RigidBodyWorld::ContactGrid::build(const RigidBodyWorld& world, const vector<int>& ids, float minCell) {
+    const float* x = world.field(X);
+    const float* y = world.field(Y);
+    const float* z = world.field(Z);
+    const float* radius = world.field(RADIUS);
+    int n = (int)ids.size();
+    bodies.resize(n);
+    points.resize(n);
+    if (n == 0) {
+        columns = rows = 0;
+        cellStart.assign(1, 0);
+        return;
+    }
+
+    float maxX = minX = x[ids[0]], maxZ = minZ = z[ids[0]];
+    for (int i : ids) {
+        minX = std::min(minX, x[i]); maxX = std::max(maxX, x[i]);
+        minZ = std::min(minZ, z[i]); maxZ = std::max(maxZ, z[i]);
+    }
+    // cells grow when the bodies are spread too thin for a grid that size
+    cell = minCell;
+    float spread = (maxX - minX + cell) * (maxZ - minZ + cell);
+    if (spread > 4.0f * n * cell * cell) cell = sqrt(spread / (4.0f * n));
+    columns = (int)((maxX - minX) / cell) + 1;
+    rows = (int)((maxZ - minZ) / cell) + 1;
+
+    // counting sort by cell
+    cellStart.assign(columns * rows + 1, 0);
+    for (int i : ids) cellStart[cellOf(x[i], z[i]) + 1]++;
+    for (int c = 0; c < columns * rows; c++) cellStart[c + 1] += cellStart[c];
+    cellFill.assign(cellStart.begin(), cellStart.end() - 1);
+    for (int i : ids) {
+        int k = cellFill[cellOf(x[i], z[i])]++;
+        bodies[k] = i;
+        points[k] = vec4(x[i], y[i], z[i], radius[i]);
+    }
+}
+
+void RigidBodyWorld::findContacts() {
+    contactPairs.clear();
+    const float* awake = field(AWAKE);
+    float minCell = 2.0f * maxRadius + CONTACT_MARGIN;
+    // the sleeping grid is rebuilt only once enough bodies fell asleep or
+    // woke since the last time; until then new sleepers ride along with the
+    // awake ones and woken bodies are skipped in it
+    size_t kept = 0;
+    for (int i : recentSleepers) {
+        if (awake[i] == 0.0f) recentSleepers[kept++] = i;
+    }
+    recentSleepers.resize(kept);
+    size_t limit = sleepingBodies.size() / 4 + 64;
+    if (recentSleepers.size() > limit || staleSleepers > limit) {
+        sleepingBodies.clear();
+        for (int i = 0; i < count; i++) {
+            if (awake[i] == 0.0f) sleepingBodies.push_back(i);
+        }
+        sleepingGrid.build(*this, sleepingBodies, minCell);
+        recentSleepers.clear();
+        staleSleepers = 0;
+    }
+    gridded.assign(awakeBodies.begin(), awakeBodies.end());
+    gridded.insert(gridded.end(), recentSleepers.begin(), recentSleepers.end());
+    awakeGrid.build(*this, gridded, minCell);
+
+    // awake pairs are found from both ends and kept from the lower index;
+    // resting piles never look for each other
+    vector<int> woken;
+    int awakeNow = (int)awakeBodies.size();
+    for (int a = 0; a < awakeNow; a++) {
+        int i = awakeBodies[a];
+        vec4 self(position(i), fields[RADIUS][i] + CONTACT_MARGIN);
+        auto touch = [&](int j) {
+            if (awake[j] != 0.0f) {
+                if (j > i) contactPairs.push_back(make_pair(i, j));
+                return;
+            }
+            contactPairs.push_back(make_pair(std::min(i, j), std::max(i, j)));
+            woken.push_back(j);
+        };
+        awakeGrid.forEachNear(self, touch);
+        // awake bodies left in the sleeping grid are in the awake one too
+        sleepingGrid.forEachNear(self, [&](int j) { if (awake[j] == 0.0f) touch(j); });
+    }
+    // a body that woke and fell asleep again since the sleeping grid was
+    // built is in both grids, its pairs are found twice
+    sort(contactPairs.begin(), contactPairs.end());
+    contactPairs.erase(unique(contactPairs.begin(), contactPairs.end()), contactPairs.end());
+    for (int j : woken) wake(j);
+}
+
+int RigidBodyWorld::findIsland(int i) {
+    while (islandParent[i] != i) {
+        islandParent[i] = islandParent[islandParent[i]];
+        i = islandParent[i];
+    }
+    return i;
+}
+
+void RigidBodyWorld::updateSleep(float dt) {
+    if (!allowSleep) return;
+    float* awake = field(AWAKE);
+    const float* invMass = field(INV_MASS);
+    islandParent.resize(count);
+    islandRest.resize(count);
+    for (int i : awakeBodies) {
+        islandParent[i] = i;
+        islandRest[i] = 1e30f;
+        // |w| <= |L| times the largest inverse moment
+        float invI = std::max(fields[INV_IX][i], std::max(fields[INV_IY][i], fields[INV_IZ][i]));
+        vec3 P(fields[PX][i], fields[PY][i], fields[PZ][i]), L(fields[LX][i], fields[LY][i], fields[LZ][i]);
+        bool resting = length(P) * invMass[i] < sleepVelocity && length(L) * invI < sleepAngularVelocity;
+        restTime[i] = resting ? restTime[i] + dt : 0.0f;
+    }
+    for (const auto& pair : contactPairs) {
+        int a = findIsland(pair.first), b = findIsland(pair.second);
+        if (a != b) islandParent[std::max(a, b)] = std::min(a, b);
+    }
+    // an island rests as long as its most restless body
+    for (int i : awakeBodies) {
+        int root = findIsland(i);
+        islandRest[root] = std::min(islandRest[root], restTime[i]);
+    }
+    // every member's ring starts as itself, each joins its root's
+    size_t kept = 0;
+    for (size_t a = 0; a < awakeBodies.size(); a++) {
+        int i = awakeBodies[a];
+        int root = findIsland(i);
+        if (islandRest[root] < sleepTime) {
+            awakeBodies[kept++] = i;
+            continue;
+        }
+        awake[i] = 0.0f;
+        fields[PX][i] = fields[PY][i] = fields[PZ][i] = 0.0f;
+        fields[LX][i] = fields[LY][i] = fields[LZ][i] = 0.0f;
+        if (i != root) {
+            nextInIsland[i] = nextInIsland[root];
+            nextInIsland[root] = i;
+        }
+        recentSleepers.push_back(i);
+    }
+    awakeBodies.resize(kept);
+}
+
+void RigidBodyWorld::solveContacts(float dt, float kick) {
+    for (int i : solved) fields[PUSH_OUT][i] = 1.0f;
+    solved.clear();
+    solver.clear();
+    if (contactPairs.empty()) {
+        solver.solve();
+        return;
+    }
+
+    // the velocities the kernel will see, gravity's first kick included
+    solverSlot.resize(count, -1);
+    auto slot = [&](int i) {
+        if (solverSlot[i] >= 0) return;
+        solverSlot[i] = addToSolver(i, solver, gravity * dt * kick);
+        solved.push_back(i);
+    };
+    for (const auto& pair : contactPairs) {
+        slot(pair.first);
+        slot(pair.second);
+    }
+
+    solver.iterations = solverIterations;
+    for (const auto& pair : contactPairs) {
+        int a = pair.first, b = pair.second;
+        vec3 d = position(b) - position(a);
+        float distance = length(d);
+        vec3 n = distance > 1e-6f ? d / distance : vec3(0.0f, 1.0f, 0.0f);
+        solver.addContact(a, b, solverSlot[a], solverSlot[b], n, n * fields[RADIUS][a], -n * fields[RADIUS][b],
+                          fields[RADIUS][a] + fields[RADIUS][b] - distance,
+                          std::max(fields[RESTITUTION][a], fields[RESTITUTION][b]), sqrt(fields[FRICTION][a] * fields[FRICTION][b]), dt);
+    }
+    // the ground under a touching body is solved with its other contacts
+    for (int i : solved) {
+        if (fields[GROUND_Y][i] == NO_GROUND) continue;
+        vec3 n(fields[NX][i], fields[NY][i], fields[NZ][i]);
+        float penetration = fields[RADIUS][i] - (fields[Y][i] - fields[GROUND_Y][i]) * n.y;
+        if (penetration > -CONTACT_MARGIN)
+            solver.addContact(i, -1, solverSlot[i], -1, -n, -n * fields[RADIUS][i], vec3(0.0f), penetration,
+                              fields[RESTITUTION][i], fields[FRICTION][i], dt);
+    }
+    solver.solve();
+
+    for (int i : solved) {
+        const ContactSolver::Body& body = solver.body(solverSlot[i]);
+        fields[PX][i] += body.dP.x; fields[PY][i] += body.dP.y; fields[PZ][i] += body.dP.z;
+        fields[LX][i] += body.dL.x; fields[LY][i] += body.dL.y; fields[LZ][i] += body.dL.z;
+        // the bias above already moves it out of the ground, the kernel must not again
+        fields[PUSH_OUT][i] = 0.0f;
+        solverSlot[i] = -1;
+    }
+}
+
+void RigidBodyWorld::step(float dt) {
+    findContacts();
+    if (awakeBodies.empty()) return;
+
+    BodyArrays bodies = {
+        field(X), field(Y), field(Z), field(QW), field(QX), field(QY), field(QZ),
+        field(PX), field(PY), field(PZ), field(LX), field(LY), field(LZ),
+        field(MASS), field(INV_MASS), field(INV_IX), field(INV_IY), field(INV_IZ),
+        field(RADIUS), field(RESTITUTION), field(FRICTION),
+        field(GROUND_Y), field(NX), field(NY), field(NZ),
+        field(AWAKE), field(PUSH_OUT)
+    };
+    StepParameters p = { dt, gravity.x, gravity.y, gravity.z, integrator == SEMI_IMPLICIT_EULER ? 1.0f : 0.5f,
+                         rollingResistance * length(gravity) };
+
+    // whole blocks of MAX_LANES bodies, so every chunk suits every path;
+    // blocks where every body sleeps are skipped
+    activeBlocks.clear();
+    for (int i : awakeBodies) activeBlocks.push_back(i / MAX_LANES);
+    sort(activeBlocks.begin(), activeBlocks.end());
+    activeBlocks.erase(unique(activeBlocks.begin(), activeBlocks.end()), activeBlocks.end());
+    // runs of consecutive blocks go through the kernel in one call
+    auto forRuns = [this](int first, int last, const function<void(int, int)>& body) {
+        for (int k = first; k < last;) {
+            int begin = activeBlocks[k] * MAX_LANES;
+            int end = begin + MAX_LANES;
+            for (k++; k < last && activeBlocks[k] * MAX_LANES == end; k++) end += MAX_LANES;
+            body(begin, end);
+        }
+    };
+    int blocks = (int)activeBlocks.size();
+    parallelFor(0, blocks, [&](int first, int last) {
+        forRuns(first, last, [this](int begin, int end) { sampleGround(begin, end); });
+    }, MIN_BODIES_PER_THREAD / MAX_LANES);
+    solveContacts(dt, p.kick);
+    parallelFor(0, blocks, [&](int first, int last) {
+        forRuns(first, last, [&](int begin, int end) {
+            if (lanes == 8) integrateBodiesAvx(bodies, begin, end, p);
+#ifdef RIGID_BODY_SSE2
+            else if (lanes == 4) integrateBodies<Lanes4>(bodies, begin, end, p);
+#endif
+            else integrateBodies<Lanes1>(bodies, begin, end, p);
+        });
+    }, MIN_BODIES_PER_THREAD / MAX_LANES);
+
+    updateSleep(dt);
+}
+
+void RigidBodyWorld::savePrevious() {
+    for (int f = 0; f < 7; f++) {
+        std::copy(fields[X + f].begin(), fields[X + f].begin() + count, fields[PREV_X + f].begin());
+    }
+}
+
+void RigidBodyWorld::snapshot(Snapshot& out) const {
+    out.previous.resize(count);
+    out.current.resize(count);
+    out.previousQ.resize(count);
+    out.currentQ.resize(count);
+    out.radius.assign(fields[RADIUS].begin(), fields[RADIUS].begin() + count);
+    for (int i = 0; i < count; i++) {
+        out.previous[i] = vec3(fields[PREV_X][i], fields[PREV_Y][i], fields[PREV_Z][i]);
+        out.current[i] = position(i);
+        out.previousQ[i] = quat(fields[PREV_QW][i], fields[PREV_QX][i], fields[PREV_QY][i], fields[PREV_QZ][i]);
+        out.currentQ[i] = orientation(i);
+    }
+}
+
+void RigidBodyWorld::instanceMatrices(const Snapshot& snapshot, float alpha, float scale, vector<mat4>& out) {
+    int n = (int)snapshot.current.size();
+    out.resize(n);
+    for (int i = 0; i < n; i++) {
+        mat4 model = translate(mat4(), mix(snapshot.previous[i], snapshot.current[i], alpha));
+        model = model * mat4_cast(slerp(snapshot.previousQ[i], snapshot.currentQ[i], alpha));
+        out[i] = glm::scale(model, vec3(scale * snapshot.radius[i]));
+    }
+}
@@ -0,0 +1,191 @@
+#ifndef RIGID_BODY_WORLD_H
+#define RIGID_BODY_WORLD_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "Integrator.h"
+#include "ContactSolver.h"
+
+class HeightField;
+
+/**
+ * Many small rigid spheres (shells, pebbles, debris) stepped together.
+ * Unlike RigidBody, which owns its state and a forcing function, the world
+ * keeps every field in its own array (structure of arrays) and integrates
+ * 4 or 8 bodies per instruction with SSE2 or AVX, picked at runtime. The
+ * only forces are gravity and contact, so there is nothing per body to call
+ * back into. Large worlds are split across threads.
+ *
+ * A lone body's ground contact is resolved inside the integration kernel.
+ * Bodies touching each other go through a sequential-impulse solver first,
+ * together with their ground contacts. It is warm started from the impulses
+ * of the step before, so stacks and piles settle instead of jittering.
+ *
+ * Bodies that stay slow for sleepTime fall asleep and are neither sampled
+ * against the ground nor integrated until something wakes them: an impulse,
+ * a new velocity, an awake body touching them or wakeInside(). Touching
+ * bodies form an island that only sleeps as a whole and wakes as a whole,
+ * so a resting pile costs nothing until it is disturbed.
+ */
+class RigidBodyWorld {
+public:
+    glm::vec3 gravity;
+    /** ground the bodies collide with, no contact when null */
+    HeightField* ground;
+    /** bodies per instruction: 8 (AVX), 4 (SSE2) or 1, lower it to compare paths */
+    int lanes;
+    /**
+     * SEMI_IMPLICIT_EULER (default) or VELOCITY_VERLET, which puts bodies on
+     * the exact ballistic arc; gravity is the only force, so the Runge-Kutta
+     * integrators would buy nothing here and step as VELOCITY_VERLET
+     */
+    IntegratorType integrator;
+    /** rolling resistance coefficient, touching bodies slow down by this times gravity */
+    float rollingResistance;
+    /** passes of the contact solver over touching bodies per step */
+    int solverIterations;
+    /** false keeps every body awake */
+    bool allowSleep;
+    /** speeds below which a body counts as resting, and how long it must rest to sleep */
+    float sleepVelocity, sleepAngularVelocity, sleepTime;
+
+    /** Poses before and after the last step, copied out so another thread can draw them */
+    struct Snapshot {
+        std::vector<glm::vec3> previous, current;
+        std::vector<glm::quat> previousQ, currentQ;
+        std::vector<float> radius;
+    };
+
+    explicit RigidBodyWorld(HeightField* ground = nullptr);
+
+    /** Adds a solid sphere at rest and returns its index */
+    int addBody(const glm::vec3& position, float mass, float radius,
+                float restitution = 0.3f, float friction = 0.6f);
+    /** Sets the principal moments of inertia of body i, body axes along its local x, y, z */
+    void setInertia(int i, const glm::vec3& principal);
+    /** both wake the body */
+    void setVelocity(int i, const glm::vec3& velocity);
+    void applyImpulse(int i, const glm::vec3& impulse);
+    int size() const { return count; }
+
+    bool isAwake(int i) const { return fields[AWAKE][i] != 0.0f; }
+    /** Wakes body i and the island it fell asleep with */
+    void wake(int i);
+    /** Wakes every body within radius of center, for when the ground there changes */
+    void wakeInside(const glm::vec3& center, float radius);
+    int awakeCount() const;
+
+    glm::vec3 position(int i) const;
+    glm::quat orientation(int i) const;
+    glm::vec3 velocity(int i) const;
+    float radius(int i) const { return fields[RADIUS][i]; }
+    float restitution(int i) const { return fields[RESTITUTION][i]; }
+    float friction(int i) const { return fields[FRICTION][i]; }
+    /** Fills out with the bodies reaching within radius of center, in index order */
+    void bodiesNear(const glm::vec3& center, float radius, std::vector<int>& out) const;
+
+    /** Adds body i to a contact solver, dv added to its velocity, and returns its slot */
+    int addToSolver(int i, ContactSolver& solver, const glm::vec3& dv = glm::vec3(0.0f)) const;
+    /** Gives body i what it gained in slot of solver, waking it if that was anything */
+    void applySolved(int i, const ContactSolver& solver, int slot);
+
+    /** Advances every body by dt */
+    void step(float dt);
+    /** Call before each fixed physics step */
+    void savePrevious();
+    /** Fills out, reusing its storage */
+    void snapshot(Snapshot& out) const;
+    /** Model matrices alpha of the way through the snapshot's step, radius scaled by scale */
+    static void instanceMatrices(const Snapshot& snapshot, float alpha, float scale, std::vector<glm::mat4>& out);
+
+private:
+    enum Field {
+        X, Y, Z, QW, QX, QY, QZ, PX, PY, PZ, LX, LY, LZ,
+        MASS, INV_MASS, INV_IX, INV_IY, INV_IZ, RADIUS, RESTITUTION, FRICTION,
+        GROUND_Y, NX, NY, NZ,
+        AWAKE, PUSH_OUT,
+        PREV_X, PREV_Y, PREV_Z, PREV_QW, PREV_QX, PREV_QY, PREV_QZ,
+        FIELD_COUNT
+    };
+    /** every field is padded to a whole number of the widest lane count */
+    std::vector<float> fields[FIELD_COUNT];
+    int count;
+    float maxRadius;
+
+    /** seconds each body has been resting */
+    std::vector<float> restTime;
+    /** the bodies a sleeping body fell asleep with, as a ring through nextInIsland */
+    std::vector<int> nextInIsland;
+    /** touching pairs with at least one awake body, found at the start of a step */
+    std::vector<std::pair<int, int>> contactPairs;
+    /** scratch: union-find parents and rest times, blocks with an awake body */
+    std::vector<int> islandParent, activeBlocks;
+    std::vector<float> islandRest;
+
+    /** Bodies in a dense x/z grid, sorted by cell */
+    struct ContactGrid {
+        float minX, minZ, cell;
+        int columns, rows;
+        /** bodies of cell c are [cellStart[c], cellStart[c + 1]) */
+        std::vector<int> cellStart, cellFill, bodies;
+        /** x, y, z and radius in bodies order */
+        std::vector<glm::vec4> points;
+
+        ContactGrid() : minX(0.0f), minZ(0.0f), cell(1.0f), columns(0), rows(0), cellStart(1, 0) {}
+        void build(const RigidBodyWorld& world, const std::vector<int>& ids, float minCell);
+        int cellOf(float x, float z) const {
+            return (int)((z - minZ) / cell) * columns + (int)((x - minX) / cell);
+        }
+        /** Calls visit with every body overlapping the sphere (x, y, z, w) grown by its radius */
+        template <class Visit>
+        void forEachNear(const glm::vec4& sphere, Visit visit) const {
+            if (columns == 0) return;
+            // cells are at least a diameter wide, so 3x3 around the centre covers it
+            int cx = (int)floor((sphere.x - minX) / cell), cz = (int)floor((sphere.z - minZ) / cell);
+            int x0 = std::max(cx - 1, 0), x1 = std::min(cx + 1, columns - 1);
+            for (int z = std::max(cz - 1, 0); z <= std::min(cz + 1, rows - 1); z++) {
+                if (x0 > x1) break;
+                // the three cells of a row are contiguous
+                for (int k = cellStart[z * columns + x0]; k < cellStart[z * columns + x1 + 1]; k++) {
+                    glm::vec3 d = glm::vec3(points[k]) - glm::vec3(sphere);
+                    float reach = sphere.w + points[k].w;
+                    if (glm::dot(d, d) < reach * reach) visit(bodies[k]);
+                }
+            }
+        }
+    };
+    /**
+     * Awake bodies are regridded every step, sleeping ones in batches:
+     * sleepingGrid holds sleepingBodies as of its last build, bodies that
+     * fell asleep since are in recentSleepers and gridded with the awake
+     * ones, staleSleepers counts those that woke since.
+     */
+    std::vector<int> awakeBodies, sleepingBodies, recentSleepers, gridded;
+    ContactGrid awakeGrid, sleepingGrid;
+    size_t staleSleepers;
+
+    /** the contacts of contactPairs and of their bodies with the ground, warm started step to step */
+    ContactSolver solver;
+    /** slot in solver of each body, -1 for bodies without contact */
+    std::vector<int> solverSlot;
+    /** the bodies of this step's solve, their PUSH_OUT is 0 until the next */
+    std::vector<int> solved;
+
+    float* field(Field f) { return &fields[f][0]; }
+    const float* field(Field f) const { return &fields[f][0]; }
+    /** Samples the ground under the awake bodies of [begin, end) */
+    void sampleGround(int begin, int end);
+    /** Fills contactPairs and wakes sleeping bodies an awake one touches */
+    void findContacts();
+    /** Groups awake bodies through contactPairs and puts islands that have rested long enough to sleep */
+    void updateSleep(float dt);
+    /** Sequential impulses over contactPairs and their bodies' ground contacts, before integration */
+    void solveContacts(float dt, float kick);
+    int findIsland(int i);
+};
+
+#endif
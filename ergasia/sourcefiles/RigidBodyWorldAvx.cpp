@@ -0,0 +1,17 @@
+// Built with AVX enabled (see CMakeLists.txt); RigidBodyWorld only calls
+// into it after checking the CPU supports AVX.
+#include "RigidBodyLanes.h"
+
+bool rigidBodyAvxBuilt() {
+#ifdef __AVX__
+    return true;
+#else
+    return false;
+#endif
+}
+
+void integrateBodiesAvx(const BodyArrays& bodies, int begin, int end, const StepParameters& p) {
+#ifdef __AVX__
+    integrateBodies<Lanes8>(bodies, begin, end, p);
+#endif
+}
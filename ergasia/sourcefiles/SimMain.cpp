@@ -0,0 +1,260 @@
+// supersnail_sim: steps the game without a window, driven by a fixed input
+// script or a recorded session, and reports how long the steps took. With
+// --bench-integrators it instead compares the rigid-body integrators.
+// Everything it touches is in the supersnail_core library.
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <stdexcept>
+#include "SimulationWorld.h"
+#include "RigidBodyWorld.h"
+#include "Random.h"
+#include "Parallel.h"
+#include "InputRecording.h"
+#include "InputScript.h"
+#include "RigidBody.h"
+
+using namespace std;
+using namespace glm;
+
+static double millisecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// explicit Euler has no IntegratorType, RigidBody keeps it for comparison
+static const int EXPLICIT_EULER = -1;
+
+static const char* integratorName(int integrator) {
+    switch (integrator) {
+    case EXPLICIT_EULER: return "euler";
+    case SEMI_IMPLICIT_EULER: return "semi-implicit";
+    case VELOCITY_VERLET: return "verlet";
+    case RUNGE_KUTTA_4: return "rk4";
+    default: return "rk45";
+    }
+}
+
+static void advance(RigidBody& body, int integrator, float t, float h) {
+    if (integrator == EXPLICIT_EULER) body.setY(body.euler(t, h, body.getY()));
+    else {
+        body.integrator = (IntegratorType)integrator;
+        body.advanceState(t, h);
+    }
+}
+
+/**
+ * What each integrator costs and how well it keeps energy, at the fixed step h:
+ * steps per second of a body under a spring force and a constant torque,
+ * restarted every 10 s so its spin and the time stay in range, and
+ * the energy of a ball dropped from 2 m onto a stiff penalty floor after 3 s
+ * (it should stay m g h = 19.62).
+ */
+static void benchIntegrators(float h, int steps) {
+    const int integrators[] = { EXPLICIT_EULER, SEMI_IMPLICIT_EULER, VELOCITY_VERLET, RUNGE_KUTTA_4, DORMAND_PRINCE_45 };
+    const float g = 9.81f, floorStiffness = 1e4f;
+    cout << fixed << setprecision(2);
+    cout << "integrator     steps/s   evals/step | drop energy   evals/step   rejected" << endl;
+    for (int integrator : integrators) {
+        // cost: smooth forces, the adaptive one takes one step per tick
+        RigidBody spun;
+        spun.setInertia(mat3(1.0f, 0.0f, 0.0f, 0.0f, 2.0f, 0.0f, 0.0f, 0.0f, 3.0f));
+        RigidBody::State rest = spun.getY();
+        rest[0] = 1.0f;
+        long evaluations = 0;
+        spun.forcing = [&evaluations](float, const RigidBody::State& y, RigidBody::Wrench& wrench) {
+            evaluations++;
+            wrench.force = -10.0f * RigidBody::position(y);
+            wrench.torque = vec3(0.1f, 0.2f, 0.3f);
+        };
+        int episode = (int)(10.0f / h + 0.5f);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < steps; i++) {
+            if (i % episode == 0) spun.setY(rest);
+            advance(spun, integrator, (i % episode) * h, h);
+        }
+        double ms = millisecondsSince(start);
+        double costEvaluations = (double)evaluations / steps;
+
+        // accuracy: the floor contact is stiff, the adaptive one subdivides it
+        RigidBody ball;
+        ball.x = vec3(0.0f, 2.0f, 0.0f);
+        evaluations = 0;
+        ball.forcing = [&](float, const RigidBody::State& y, RigidBody::Wrench& wrench) {
+            evaluations++;
+            float height = RigidBody::position(y).y;
+            wrench.force = vec3(0.0f, -ball.m * g + (height < 0.0f ? -floorStiffness * height : 0.0f), 0.0f);
+        };
+        int ticks = (int)(3.0f / h + 0.5f), rejected = 0;
+        for (int i = 0; i < ticks; i++) {
+            advance(ball, integrator, i * h, h);
+            if (integrator == DORMAND_PRINCE_45) rejected += ball.stepReport.rejected;
+        }
+        float y = ball.x.y;
+        float energy = 0.5f * ball.m * dot(ball.v, ball.v) + ball.m * g * y + (y < 0.0f ? 0.5f * floorStiffness * y * y : 0.0f);
+
+        cout << setw(14) << left << integratorName(integrator) << right << setw(9) << (ms > 0.0 ? steps / ms / 1000.0 : 0.0) << "M"
+             << setw(12) << costEvaluations << " | " << setw(11) << energy << setw(13) << (double)evaluations / ticks
+             << setw(11) << rejected << endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    float seconds = 60.0f;
+    float physicsStep = 1.0f / 120.0f;
+    unsigned int seed = 1;
+    int treeCount = 700, flowerCount = 100, shellCount = 0;
+    IntegratorType integrator = RUNGE_KUTTA_4;
+    string recordPath, replayPath;
+    int hashInterval = 120;
+    bool benchmark = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--seconds" && i + 1 < argc) seconds = stof(argv[++i]);
+        else if (arg == "--physics-hz" && i + 1 < argc) physicsStep = 1.0f / stof(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc) seed = (unsigned int)stoul(argv[++i]);
+        else if (arg == "--trees" && i + 1 < argc) treeCount = stoi(argv[++i]);
+        else if (arg == "--flowers" && i + 1 < argc) flowerCount = stoi(argv[++i]);
+        else if (arg == "--shells" && i + 1 < argc) shellCount = stoi(argv[++i]);
+        else if (arg == "--integrator" && i + 1 < argc) {
+            string name = argv[++i];
+            if (name == "euler") integrator = SEMI_IMPLICIT_EULER;
+            else if (name == "verlet") integrator = VELOCITY_VERLET;
+            else if (name == "rk45") integrator = DORMAND_PRINCE_45;
+            else integrator = RUNGE_KUTTA_4;
+        }
+        else if (arg == "--record" && i + 1 < argc) recordPath = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replayPath = argv[++i];
+        else if (arg == "--hash-interval" && i + 1 < argc) hashInterval = stoi(argv[++i]);
+        else if (arg == "--bench-integrators") benchmark = true;
+        else {
+            cout << "usage: supersnail_sim [--seconds S] [--physics-hz HZ] [--seed N] [--trees N] [--flowers N]"
+                    " [--shells N] [--integrator euler|verlet|rk4|rk45] [--record FILE] [--replay FILE]"
+                    " [--hash-interval STEPS] [--bench-integrators]" << endl;
+            return 1;
+        }
+    }
+    if (benchmark) {
+        benchIntegrators(physicsStep, 2000000);
+        return 0;
+    }
+
+    try {
+        // a replay rebuilds the recorded world and runs for as long as the recording
+        InputRecording* replay = nullptr;
+        if (!replayPath.empty()) {
+            replay = new InputRecording(replayPath);
+            const InputRecording::Header& h = replay->header();
+            seed = h.seed;
+            physicsStep = h.physicsStep;
+            treeCount = h.treeCount;
+            flowerCount = h.flowerCount;
+            shellCount = h.shellCount;
+            integrator = (IntegratorType)h.integrator;
+            replay->check(InputRecording::GENERATED_TERRAIN);
+        }
+        InputRecording::Writer* recorder = nullptr;
+        if (!recordPath.empty()) {
+            InputRecording::Header h;
+            h.seed = seed;
+            h.physicsStep = physicsStep;
+            h.treeCount = treeCount;
+            h.flowerCount = flowerCount;
+            h.shellCount = shellCount;
+            h.integrator = integrator;
+            h.hashInterval = (uint32_t)std::max(hashInterval, 0);
+            h.terrainSource = InputRecording::GENERATED_TERRAIN;
+            h.producer = InputRecording::SIM_PRODUCER;
+            recorder = new InputRecording::Writer(recordPath, h);
+        }
+
+        auto setupStart = chrono::steady_clock::now();
+        WorldLayout layout(seed, treeCount, flowerCount);
+        HeightGrid& terrain = layout.terrain;
+        SimulationWorld world(&layout);
+        world.snail.integrator = integrator;
+
+        RigidBodyWorld* debris = nullptr;
+        if (shellCount > 0) {
+            debris = new RigidBodyWorld(&terrain);
+            CounterRng rng(seed, 0x5e115U);
+            for (int i = 0; i < shellCount; i++) {
+                float x = rng.uniform(-60.0f, 60.0f), z = rng.uniform(-60.0f, 60.0f);
+                float radius = rng.uniform(0.3f, 0.8f);
+                int body = debris->addBody(vec3(x, terrain.getHeightAt(x, z) + rng.uniform(2.0f, 20.0f), z),
+                                           radius * radius * radius, radius);
+                debris->setVelocity(body, vec3(rng.uniform(-3.0f, 3.0f), 0.0f, rng.uniform(-3.0f, 3.0f)));
+            }
+        }
+
+        Simulation& simulation = world.simulation;
+        simulation.debris = debris;
+        // the layout is this run's alone, so landings may dent it
+        simulation.onDent = [&world, &terrain](const vec3& center, float reach, float depth) {
+            world.dents++;
+            terrain.deform(center, reach, [depth](float t) { return -depth * (1.0f - t * t); });
+        };
+        double setupMs = millisecondsSince(setupStart);
+
+        int steps = replay ? 0 : (int)ceil(seconds / physicsStep);
+        vector<double> stepUs;
+        stepUs.reserve(steps);
+        int hashesChecked = 0, divergedAt = -1;
+        auto runStart = chrono::steady_clock::now();
+        for (int i = 0; replay || i < steps; i++) {
+            InputState input;
+            bool hashed = false;
+            uint64_t recordedHash = 0;
+            if (!replay) input = scriptedInput(i * physicsStep);
+            else if (!replay->next(input, hashed, recordedHash)) break;
+
+            auto stepStart = chrono::steady_clock::now();
+            simulation.step(physicsStep, input);
+            stepUs.push_back(millisecondsSince(stepStart) * 1000.0);
+
+            if (hashed) {
+                hashesChecked++;
+                if (divergedAt < 0 && simulation.stateHash() != recordedHash) divergedAt = i;
+            }
+            if (recorder) recorder->record(input, recorder->hashDue() ? simulation.stateHash() : 0);
+        }
+        double runMs = millisecondsSince(runStart);
+        steps = (int)stepUs.size();
+
+        vector<double> sorted(stepUs);
+        sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](double p) { return sorted.empty() ? 0.0 : sorted[(size_t)(p * (sorted.size() - 1))]; };
+        double mean = 0.0;
+        for (double us : stepUs) mean += us;
+        if (steps > 0) mean /= steps;
+
+        cout << fixed << setprecision(2);
+        cout << "setup          " << setupMs << " ms (seed " << seed << ", " << workerCount() << " threads)" << endl;
+        cout << "simulated      " << steps * physicsStep << " s in " << steps << " steps of " << physicsStep * 1000.0f << " ms" << endl;
+        cout << "wall           " << runMs << " ms, " << (runMs > 0.0 ? steps * physicsStep * 1000.0 / runMs : 0.0) << "x real time" << endl;
+        cout << "step us        mean " << mean << ", p50 " << percentile(0.5) << ", p99 " << percentile(0.99)
+             << ", max " << percentile(1.0) << endl;
+        const SnailBody& snail = world.snail;
+        cout << "snail          " << snail.x.x << " " << snail.x.y << " " << snail.x.z
+             << ", " << world.eaten << " eaten, " << world.dents << " dents" << endl;
+        if (replay) {
+            cout << "replay         " << replayPath << " by " << InputRecording::producerName(replay->header().producer)
+                 << ", " << hashesChecked << " state hashes checked, ";
+            if (divergedAt < 0) cout << "no divergence" << endl;
+            else cout << "diverged by step " << divergedAt << endl;
+        }
+        if (recorder) cout << "recorded       " << recorder->steps() << " steps to " << recordPath << endl;
+        delete recorder;
+        delete replay;
+        delete debris;
+    }
+    catch (exception& ex) {
+        cout << ex.what() << endl;
+        return 1;
+    }
+    return 0;
+}
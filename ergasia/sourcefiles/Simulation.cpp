@@ -0,0 +1,259 @@
+#include "Simulation.h"
+#include "SnailBody.h"
+#include "EagleAI.h"
+#include "FlowerField.h"
+#include "HeightGrid.h"
+#include "Collision.h"
+#include "RigidBodyWorld.h"
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+// the W/S velocity kicks were tuned as one per 60 Hz frame
+static const float KICK_RATE = 60.0f;
+// the snail bounces off the bouncy ground material with this restitution, off trunks elastically
+static const float BOUNCY_RESTITUTION = 1.2f;
+static const float TREE_RESTITUTION = 1.0f;
+// debris this far beyond touching the snail is solved with it
+static const float DEBRIS_MARGIN = 0.05f;
+// warm start names of the snail's static contacts, debris keeps its body index
+static const int SNAIL_CONTACT = 0;
+static const int GROUND_CONTACT = -1;
+static int treeContact(int tree) { return -2 - tree; }
+
+Simulation::Simulation(HeightField* ground, HeightGrid* terrain, SnailBody* snail, EagleAI* eagle)
+    : ground(ground), terrain(terrain), snail(snail), eagle(eagle), debris(nullptr), trees(nullptr),
+      treeGrid(&::treeGrid), flowerGrid(&::flowerGrid), gravity(9.80665f), muK(2.0f), muS(5.0f), time(0.0f),
+      forcing(*snail), grounded(false), onTree(false), retractHeld(false) {
+    for (int k = 0; k < FLOWER_KINDS; k++) flowers[k] = nullptr;
+    // reads only the environment captured at the start of each step
+    snail->forcing = std::ref(forcing);
+}
+
+void Simulation::step(float dt, const InputState& input) {
+    snail->savePrevious();
+    eagle->savePrevious();
+    if (debris) {
+        debris->savePrevious();
+        debris->step(dt);
+    }
+
+    eagle->update(dt, snail, terrain);
+    bool controlPressed = (input.keys & KEY_RETRACT) != 0;
+
+    if (controlPressed && !retractHeld){
+
+        if (snail->retractTarget == 0.0f) {
+            snail->retractTarget = 1.0f;
+            snail->isSprinting = false;
+        }
+        else if (snail->x.y < ground->getHeightAt(snail->x.x,snail->x.z) + 4 * snail->radius ){
+            snail->retractTarget = 0.0f;
+        }
+
+
+    }
+    retractHeld = controlPressed;
+    if (snail->retractCurrent < snail->retractTarget) {
+        snail->retractCurrent += snail->retractSpeed * dt;
+    }
+    else if (snail->retractCurrent > snail->retractTarget) {
+        snail->retractCurrent -= snail->retractSpeed * dt;
+    }
+    snail->retractCurrent = clamp(snail->retractCurrent, 0.0f, 1.0f);
+
+    if (snail->retractTarget == 0.0f) {
+        snail->isRetracted = false;
+    }
+    else if (snail->retractCurrent > 0.0f) {
+        snail->isRetracted = true;
+    }
+
+    if (snail->retractCurrent > 0.0f)applyFlowerPhysics();
+    int tree = -1;
+    onTree = trees && handleSnailTreeCollision(snail, *trees, *treeGrid, &tree);
+    // the one terrain query of the step, collision only moves the snail vertically
+    GroundSample under = ground->sample(snail->x.x, snail->x.z);
+    grounded = handleSnailTerrainCollision(snail, under, onTree);
+    if (grounded) {
+        float impactSpeed = dot(snail->v, under.normal);
+        // hard landings on the bouncy material leave a dent
+        if (under.type < -0.5f && impactSpeed < -20.0f) {
+            float depth = std::min(-impactSpeed * 0.02f, 1.0f) * snail->radius;
+            float reach = 3.0f * snail->radius;
+            // shells resting on the dented ground have to notice it
+            if (debris) debris->wakeInside(snail->x, reach);
+            if (onDent) onDent(snail->x, reach, depth);
+            else if (terrain) terrain->deform(snail->x, reach, [depth](float t) { return -depth * (1.0f - t * t); });
+        }
+    }
+    vec3 snailForward = snail->q * vec3(0, 0, -1); //-Z is forward
+
+    if (grounded && snail->retractCurrent == 0.0f) {
+        snail->isSprinting = false;
+        snail->isMoving = false;
+        float turnSpeed = radians(100.0f) * dt;
+        float moveSpeed;
+        if ((input.keys & KEY_SPRINT) && snail->stamina > 0){
+            moveSpeed = snail->maxSpeed;
+            snail->isSprinting = true;
+        }
+        else  moveSpeed = snail->moveSpeed;
+        if (input.keys & KEY_FORWARD) {
+            snail->v -= snailForward * moveSpeed * dt * KICK_RATE;
+            snail->isMoving = true;
+        }
+        else if (input.keys & KEY_BACK) {
+            snail->v += snailForward * moveSpeed / 10.0f * dt * KICK_RATE;
+            snail->isMoving = true;
+        }
+        if (input.keys & KEY_RIGHT) {
+            quat turn = angleAxis(-turnSpeed, vec3(0, 1, 0));
+            snail->q = normalize(snail->q * turn);
+        }
+        if (input.keys & KEY_LEFT) {
+            quat turn = angleAxis(turnSpeed, vec3(0, 1, 0));
+            snail->q = normalize(snail->q * turn);
+        }
+
+        snail->P = snail->v * snail->m;
+
+        //eating events
+        if (input.keys & KEY_EAT) {
+            tryEatFlowers();
+        }
+
+    }
+    // the streamed world has no fence
+    if (terrain) handleBoxSnailCollision(terrain, snail);
+    solveSnailContacts(dt, under, tree);
+
+    forcing.environment = captureEnvironment(*snail, input, under, grounded, eagle->state == GRABBING, gravity, muK, muS);
+    vec3 start = snail->x;
+    snail->update(time, dt);
+    if (snail->isRetracted) sweepSnail(start);
+    time += dt;
+}
+
+void Simulation::sweepSnail(const vec3& from) {
+    vec3 to = snail->x;
+    float t = trees ? sweepSnailTrees(from, to, snail->radius, *trees, *treeGrid) : 1.0f;
+    vec3 end = mix(from, to, t);
+    float tGround = sweepSnailTerrain(ground, from, end, snail->radius, ground->maxSlope());
+    if (tGround < 1.0f) {
+        end = mix(from, end, tGround);
+        // just under the surface, so the next ground test sees the landing
+        end.y = ground->getHeightAt(end.x, end.z) + snail->radius - 0.001f;
+    }
+    snail->x = end;
+}
+
+void Simulation::solveSnailContacts(float dt, const GroundSample& under, int tree) {
+    contacts.clear();
+    int self = contacts.addBody(snail->v, snail->I_inv * snail->L, snail->I_inv, 1.0f / snail->m);
+    // collision already lifted the retracted snail out of the ground and off
+    // the trunk, so both touch it without a gap; the ground's friction is
+    // SnailForcing's
+    if (snail->isRetracted && grounded) {
+        vec3 n = -under.normal;
+        float restitution = under.type < -0.5f ? BOUNCY_RESTITUTION : 0.0f;
+        contacts.addContact(SNAIL_CONTACT, GROUND_CONTACT, self, -1, n, n * snail->radius, vec3(0.0f), 0.0f, restitution, 0.0f, dt);
+    }
+    if (snail->isRetracted && tree >= 0) {
+        vec3 axis = vec3((*trees)[tree][3]);
+        vec3 n = vec3(axis.x - snail->x.x, 0.0f, axis.z - snail->x.z);
+        n = length(n) > 1e-6f ? normalize(n) : vec3(1.0f, 0.0f, 0.0f);
+        contacts.addContact(SNAIL_CONTACT, treeContact(tree), self, -1, n, n * snail->radius, vec3(0.0f), 0.0f,
+                            TREE_RESTITUTION, 0.0f, dt);
+    }
+    nearDebris.clear();
+    if (debris) debris->bodiesNear(snail->x, snail->radius + DEBRIS_MARGIN, nearDebris);
+    for (int i : nearDebris) {
+        int slot = debris->addToSolver(i, contacts);
+        vec3 d = debris->position(i) - snail->x;
+        float distance = length(d);
+        vec3 n = distance > 1e-6f ? d / distance : vec3(0.0f, 1.0f, 0.0f);
+        float radius = debris->radius(i);
+        contacts.addContact(SNAIL_CONTACT, i, self, slot, n, n * snail->radius, -n * radius, snail->radius + radius - distance,
+                            debris->restitution(i), debris->friction(i), dt);
+    }
+    contacts.solve();
+
+    const ContactSolver::Body& body = contacts.body(self);
+    snail->P += body.dP;
+    snail->L += body.dL;
+    snail->v = snail->P / snail->m;
+    snail->w = snail->I_inv * snail->L;
+    for (size_t k = 0; k < nearDebris.size(); k++) debris->applySolved(nearDebris[k], contacts, (int)k + 1);
+}
+
+// FNV-1a over raw bytes
+static void hashBytes(uint64_t& h, const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+}
+
+template <class T>
+static void hashValue(uint64_t& h, const T& value) {
+    hashBytes(h, &value, sizeof(T));
+}
+
+uint64_t Simulation::stateHash() const {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    hashValue(h, snail->x);
+    hashValue(h, snail->q);
+    hashValue(h, snail->P);
+    hashValue(h, snail->L);
+    hashValue(h, snail->s);
+    hashValue(h, snail->retractCurrent);
+    hashValue(h, snail->stamina);
+    hashValue(h, eagle->position);
+    hashValue(h, eagle->velocity);
+    hashValue(h, eagle->state);
+    if (debris) {
+        for (int i = 0; i < debris->size(); i++) hashValue(h, debris->position(i));
+    }
+    return h;
+}
+
+void Simulation::tryEatFlowers() {
+    int snailGridX = gridCell(snail->x.x);
+    int snailGridZ = gridCell(snail->x.z);
+
+    // Check 3x3 area
+    for (int x = -1; x <= 1; x++) {
+        for (const auto& handle : flowerGrid->column(snailGridX + x, snailGridZ - 1, snailGridZ + 1)) {
+            // Pass 'false' for isRetracted to trigger Eating Logic
+            bool ate = handle.type->checkCollisionByIndex(handle.index, snail, false);
+
+            if (ate) {
+                int kind = (int)(find(flowers, flowers + FLOWER_KINDS, handle.type) - flowers);
+                if (onEaten) onEaten(kind, handle.index);
+                if (kind == RED_FLOWER) { snail->maxSpeed += 10.0f; snail->moveSpeed += 2.0f; }
+                else if (kind == BELL_FLOWER) { snail->staminaMax += 100.0f; snail->staminaDepletionRate -= 10.0f; }
+                else if (kind == MUSHROOM) {
+                    if (snail->s <5.0f) { snail->s *= 2; snail->radius *= 2; snail->m *= 2; }
+                }
+                else if (kind == SMALL_MUSHROOM) { snail->s /= 2; snail->radius /= 2; snail->m /= 2; }
+                else if (kind == PIZZA) { snail->abilityUnlocked = true; }
+                return;
+            }
+        }
+    }
+}
+
+void Simulation::applyFlowerPhysics() {
+    int snailGridX = gridCell(snail->x.x);
+    int snailGridZ = gridCell(snail->x.z);
+
+    for (int x = -1; x <= 1; x++) {
+        for (const auto& handle : flowerGrid->column(snailGridX + x, snailGridZ - 1, snailGridZ + 1)) {
+            // Pass 'true' for isRetracted to trigger Physics Logic
+            handle.type->checkCollisionByIndex(handle.index, snail, true);
+        }
+    }
+}
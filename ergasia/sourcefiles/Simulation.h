@@ -0,0 +1,99 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "SnailForcing.h"
+#include "Collision.h"
+#include "ContactSolver.h"
+
+class HeightGrid;
+class SnailBody;
+class EagleAI;
+class FlowerField;
+class RigidBodyWorld;
+
+/** Flower kinds in the order of Simulation::flowers and the world file */
+enum FlowerKind { RED_FLOWER, BELL_FLOWER, MUSHROOM, SMALL_MUSHROOM, PIZZA, FLOWER_KINDS };
+
+/**
+ * One fixed step of the game: the snail's controls and retraction, eating,
+ * collision with trees, flowers and the ground, the eagle and the debris.
+ * Nothing here needs a window or GL, the game drives it from its simulation
+ * thread and supersnail_sim without a display. Pointers are not owned.
+ * Everything a run changes is reached through these members, so separate
+ * Simulations with their own snail, eagle and flowers can step on separate
+ * threads while sharing terrain and trees (as long as nothing dents it).
+ */
+class Simulation {
+public:
+    /** what the snail stands on */
+    HeightField* ground;
+    /** the single-map terrain: fence and eagle line of sight, null when streamed */
+    HeightGrid* terrain;
+    SnailBody* snail;
+    EagleAI* eagle;
+    /** optional */
+    RigidBodyWorld* debris;
+    /** tree instance matrices, indexed by treeGrid */
+    const std::vector<glm::mat4>* trees;
+    /** indexed by FlowerKind, entries may be null */
+    FlowerField* flowers[FLOWER_KINDS];
+    /** trees and flowers per cell, the globals of Collision.h by default */
+    const TreeGrid* treeGrid;
+    FlowerGrid* flowerGrid;
+    float gravity;
+    /** kinetic and static friction of the ground per unit of roughness */
+    float muK, muS;
+    /** simulated time */
+    float time;
+
+    /**
+     * A hard landing dents the terrain by depth at center, fading out at
+     * reach. When set the callback owns the edit, which must be done before
+     * it returns for replays to see it at the same step (the game posts
+     * only the GL side to its render thread); otherwise the step deforms
+     * terrain itself.
+     */
+    std::function<void(const glm::vec3& center, float reach, float depth)> onDent;
+    /** the snail ate flower index of kind */
+    std::function<void(int kind, int index)> onEaten;
+
+    Simulation(HeightField* ground, HeightGrid* terrain, SnailBody* snail, EagleAI* eagle);
+
+    /** Advances everything by dt with the controls held during the step */
+    void step(float dt, const InputState& input);
+    /**
+     * Hash of the snail, eagle and debris state, bit for bit. Two runs of the
+     * same build agree on it exactly as long as they have not diverged.
+     */
+    uint64_t stateHash() const;
+
+private:
+    SnailForcing forcing;
+    bool grounded, onTree, retractHeld;
+    /** the snail's contacts with the ground, trees and debris, warm started step to step */
+    ContactSolver contacts;
+    /** scratch: the debris within reach of the snail */
+    std::vector<int> nearDebris;
+
+    void tryEatFlowers();
+    void applyFlowerPhysics();
+    /**
+     * The retracted snail can cross a trunk or a ridge within one step. Stops
+     * it at the first contact along its move from the start of the step and
+     * keeps its velocity, so the next step's collision tests bounce it with
+     * the full speed it arrived at.
+     */
+    void sweepSnail(const glm::vec3& from);
+    /**
+     * Sequential impulses between the snail and what it touches before it
+     * integrates: the ground under it and the trunk it was pushed off of
+     * (tree, -1 for none) while retracted, and the debris around it always.
+     */
+    void solveSnailContacts(float dt, const GroundSample& under, int tree);
+};
+
+#endif
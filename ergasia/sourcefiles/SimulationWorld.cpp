@@ -0,0 +1,61 @@
+#include "SimulationWorld.h"
+#include <cstdlib>
+
+using namespace std;
+using namespace glm;
+
+// the game's terrain, quietly: a batch builds many
+static HeightGrid::HillAlgorithmParameters layoutTerrain(unsigned int seed, int mapSize) {
+    HeightGrid::HillAlgorithmParameters params(400, 400, 100, 10, 40, -2.0f, 5.0f, mapSize * 2, 50, seed);
+    params.verbose = false;
+    return params;
+}
+
+WorldLayout::WorldLayout(unsigned int seed, int treeCount, int flowerCount, int mapSize)
+    : seed(seed), terrain(layoutTerrain(seed, mapSize)) {
+    srand(seed);
+    trees = placeTrees(&terrain, treeCount / 2, 4.0f, mapSize);
+    vector<mat4> pines = placeTrees(&terrain, treeCount / 2, 0.1f, mapSize);
+    trees.insert(trees.end(), pines.begin(), pines.end());
+    buildTreeGrid(trees, treeGrid);
+
+    // same kinds, counts and scales as the game, which places its grass
+    // from a stream of its own in between
+    flowers[RED_FLOWER] = FlowerField(&terrain, flowerCount, 5.0f, mapSize).instanceMatrices;
+    flowers[BELL_FLOWER] = FlowerField(&terrain, flowerCount, 4.0f, mapSize).instanceMatrices;
+    flowers[MUSHROOM] = FlowerField(&terrain, flowerCount / 2, 0.3f, mapSize).instanceMatrices;
+    flowers[SMALL_MUSHROOM] = FlowerField(&terrain, flowerCount / 2, 0.3f, mapSize).instanceMatrices;
+    flowers[PIZZA] = FlowerField(&terrain, 1, 1.0f, 40).instanceMatrices;
+
+    for (size_t i = 0; i < trees.size(); i++) instances.add(TREE_INSTANCES, (int)i, treeCollisionBox(trees[i]));
+    instances.build();
+}
+
+static vec3 spawnPoint(HeightGrid& terrain) {
+    return vec3(0.0f, terrain.getHeightAt(0.0f, 0.0f) + 1.0f, 0.0f);
+}
+
+SimulationWorld::SimulationWorld(WorldLayout* layout)
+    : layout(layout), snail(spawnPoint(layout->terrain), 1.0f, 1.2f), eagle(vec3(0, 300, 0)),
+      simulation(&layout->terrain, &layout->terrain, &snail, &eagle), eaten(0), dents(0) {
+    vector<FlowerField*> kinds;
+    for (int k = 0; k < FLOWER_KINDS; k++) {
+        const vector<mat4>& placed = layout->flowers[k];
+        flowers[k] = new FlowerField(placed.empty() ? nullptr : &placed[0], (int)placed.size());
+        kinds.push_back(flowers[k]);
+    }
+    buildFlowerGrid(kinds, flowerGrid);
+
+    simulation.trees = &layout->trees;
+    const WorldLayout* shared = layout;
+    eagle.cover = [shared](const vec3& a, const vec3& b) { return treesBlock(shared->instances, shared->trees, a, b); };
+    simulation.treeGrid = &layout->treeGrid;
+    simulation.flowerGrid = &flowerGrid;
+    for (int k = 0; k < FLOWER_KINDS; k++) simulation.flowers[k] = flowers[k];
+    simulation.onEaten = [this](int, int) { eaten++; };
+    simulation.onDent = [this](const vec3&, float, float) { dents++; };
+}
+
+SimulationWorld::~SimulationWorld() {
+    for (int k = 0; k < FLOWER_KINDS; k++) delete flowers[k];
+}
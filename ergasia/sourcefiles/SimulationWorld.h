@@ -0,0 +1,59 @@
+#ifndef SIMULATION_WORLD_H
+#define SIMULATION_WORLD_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "HeightGrid.h"
+#include "Collision.h"
+#include "SnailBody.h"
+#include "EagleAI.h"
+#include "FlowerField.h"
+#include "Simulation.h"
+
+/**
+ * The part of a headless world that runs on the same seed can share: the
+ * terrain, the trees and their grid, where each kind of flower grows and
+ * the hierarchy over all of them.
+ * Placement draws from rand() after srand(seed), so build layouts on one
+ * thread; afterwards runs only read it.
+ */
+class WorldLayout {
+public:
+    unsigned int seed;
+    HeightGrid terrain;
+    std::vector<glm::mat4> trees;
+    TreeGrid treeGrid;
+    /** instance matrices per FlowerKind */
+    std::vector<glm::mat4> flowers[FLOWER_KINDS];
+    /** the trees' collision cylinders, for the eagle's line of sight */
+    InstanceBvh instances;
+
+    /** the map supersnail_sim and supersnail_batch play on, 2 * mapSize across */
+    WorldLayout(unsigned int seed, int treeCount, int flowerCount, int mapSize = 2000);
+};
+
+/**
+ * One self-contained run on a shared layout: its own snail, eagle, flowers
+ * and flower grid, wired into a Simulation. Dents are only counted, the
+ * shared terrain is never edited unless simulation.onDent is replaced.
+ */
+class SimulationWorld {
+public:
+    WorldLayout* layout;
+    SnailBody snail;
+    EagleAI eagle;
+    /** indexed by FlowerKind, owned */
+    FlowerField* flowers[FLOWER_KINDS];
+    FlowerGrid flowerGrid;
+    Simulation simulation;
+    int eaten, dents;
+
+    explicit SimulationWorld(WorldLayout* layout);
+    ~SimulationWorld();
+
+private:
+    SimulationWorld(const SimulationWorld&);
+    SimulationWorld& operator=(const SimulationWorld&);
+};
+
+#endif
@@ -6,28 +6,10 @@
 using namespace glm;
 
 Snail::Snail(
-    vec3 pos, float scalar, float mass){
+    vec3 pos, float scalar, float mass) : SnailBody(pos, scalar, mass) {
     mesh = new Drawable("models/Mesh_Snail.obj");
     mesh_retracted = new Drawable("models/Mesh_Snail_Retracted.obj");
-	isMoving = false;
-    isSprinting = false;
-    isRetracted = false;
-	abilityUnlocked = false;
-    retractTarget = 0.0f; // Target for retracting (1.0 = fully retracted)
-    retractCurrent = 0.0f; // Current animation progress (0.0 to 1.0)
-    s = scalar;
-	radius = 1.73f * s; 
-    m = mass;
-    x = pos;
-    P = m * v;
-	moveSpeed = 5.0f;
-	maxSpeed = 25.0f;
-    staminaMax = 100.0f;
-    stamina = 50.0f;
-    staminaDepletionRate = 20.0f; 
-    staminaRepletionRate = 15.0f;
-
-    I_inv = mat3(1.0f / (0.4f * m * radius * radius));
+    interpolate(snapshot(), 1.0f);
 }
 
 Snail::~Snail() {
@@ -36,7 +18,7 @@ Snail::~Snail() {
 }
 
 void Snail::draw() {
-    if (retractCurrent == 1.0f) {
+    if (shown.retractCurrent == 1.0f) {
         mesh_retracted->bind();
         mesh_retracted->draw();
     }
@@ -48,30 +30,13 @@ void Snail::draw() {
     
 }
 
-void Snail::update(float t, float dt) {
-    
-    advanceState(t, dt);
-    if (length(this->w) < 0.05f) {
-        this->w = vec3(0, 0, 0);
-        this->L = vec3(0, 0, 0);
-    }
-    if (this->isSprinting && this->isMoving) {
-        float staminaChange = staminaDepletionRate * dt;
-        stamina = clamp(stamina - staminaChange, 0.0f, staminaMax);
-    }
-    else {
-        float staminaChange = staminaRepletionRate * dt;
-        stamina = clamp(stamina + staminaChange, 0.0f, staminaMax);
-	}
+void Snail::interpolate(const SnailSnapshot& snapshot, float alpha) {
+    shown = snapshot;
+    renderPosition = mix(snapshot.previousX, snapshot.x, alpha);
     // compute model matrix
+    float s = snapshot.s;
     mat4 scale = glm::scale(mat4(), vec3(s, s, s));
-    mat4 tranlation = translate(mat4(), vec3(x.x, x.y, x.z));
-#ifdef USE_QUATERNIONS
-    mat4 rotation = mat4_cast(q);
-#else
-    mat4 rotation = mat4(R);
-#endif
+    mat4 tranlation = translate(mat4(), renderPosition);
+    mat4 rotation = mat4_cast(slerp(snapshot.previousQ, snapshot.q, alpha));
     snailModelMatrix = tranlation * rotation  * scale;
 }
-
-
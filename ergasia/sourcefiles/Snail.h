@@ -1,25 +1,22 @@
 #ifndef SNAIL_H
 #define SNAIL_H
 
-#include "RigidBody.h"
+#include "SnailBody.h"
 
 class Drawable;
 
-class Snail : public RigidBody {
+class Snail : public SnailBody {
 public:
     Drawable *mesh,*mesh_retracted;
-    float s;
     glm::mat4 snailModelMatrix;
-	bool isRetracted, isSprinting, isMoving, abilityUnlocked;
-    float retractTarget , retractCurrent; 
-    const float retractSpeed = 2.0f ; 
-    float radius;
-	float moveSpeed, maxSpeed;
-	float stamina, staminaMax , staminaDepletionRate, staminaRepletionRate;
+    /** what is drawn, only written by interpolate() on the render thread */
+    SnailSnapshot shown;
+    glm::vec3 renderPosition;
     Snail(glm::vec3 pos, float scalar, float mass);
     ~Snail();
     void draw();
-    void update(float t = 0, float dt = 0);
+    /** Shows snapshot with renderPosition and snailModelMatrix alpha of the way through its step */
+    void interpolate(const SnailSnapshot& snapshot, float alpha);
 };
 
-#endif
\ No newline at end of file
+#endif
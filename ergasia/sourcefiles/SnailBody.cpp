@@ -0,0 +1,70 @@
+#include "SnailBody.h"
+
+using namespace glm;
+
+SnailBody::SnailBody(
+    vec3 pos, float scalar, float mass){
+	isMoving = false;
+    isSprinting = false;
+    isRetracted = false;
+	abilityUnlocked = false;
+    retractTarget = 0.0f; // Target for retracting (1.0 = fully retracted)
+    retractCurrent = 0.0f; // Current animation progress (0.0 to 1.0)
+    s = scalar;
+	radius = 1.73f * s; 
+    m = mass;
+    x = pos;
+    P = m * v;
+	moveSpeed = 5.0f;
+	maxSpeed = 25.0f;
+    staminaMax = 100.0f;
+    stamina = 50.0f;
+    staminaDepletionRate = 20.0f; 
+    staminaRepletionRate = 15.0f;
+
+    setInertia(mat3(0.4f * m * radius * radius));
+    savePrevious();
+}
+
+void SnailBody::update(float t, float dt) {
+    
+    advanceState(t, dt);
+    if (length(this->w) < 0.05f) {
+        this->w = vec3(0, 0, 0);
+        this->L = vec3(0, 0, 0);
+    }
+    if (this->isSprinting && this->isMoving) {
+        float staminaChange = staminaDepletionRate * dt;
+        stamina = clamp(stamina - staminaChange, 0.0f, staminaMax);
+    }
+    else {
+        float staminaChange = staminaRepletionRate * dt;
+        stamina = clamp(stamina + staminaChange, 0.0f, staminaMax);
+	}
+}
+
+void SnailBody::savePrevious() {
+    previousX = x;
+#ifdef USE_QUATERNIONS
+    previousQ = q;
+#endif
+}
+
+SnailSnapshot SnailBody::snapshot() const {
+    SnailSnapshot snapshot;
+    snapshot.previousX = previousX;
+    snapshot.x = x;
+    snapshot.v = v;
+#ifdef USE_QUATERNIONS
+    snapshot.previousQ = previousQ;
+    snapshot.q = q;
+#else
+    snapshot.previousQ = snapshot.q = quat_cast(R);
+#endif
+    snapshot.s = s;
+    snapshot.radius = radius;
+    snapshot.retractCurrent = retractCurrent;
+    snapshot.stamina = stamina;
+    snapshot.staminaMax = staminaMax;
+    return snapshot;
+}
@@ -0,0 +1,33 @@
+#ifndef SNAIL_BODY_H
+#define SNAIL_BODY_H
+
+#include "RigidBody.h"
+
+/** What drawing needs from one physics step, copied out so another thread can draw it */
+struct SnailSnapshot {
+    glm::vec3 previousX, x, v;
+    glm::quat previousQ, q;
+    float s, radius, retractCurrent, stamina, staminaMax;
+};
+
+/** The snail as the simulation sees it, Snail adds the meshes */
+class SnailBody : public RigidBody {
+public:
+    float s;
+	bool isRetracted, isSprinting, isMoving, abilityUnlocked;
+    float retractTarget , retractCurrent; 
+    const float retractSpeed = 2.0f ; 
+    float radius;
+    /** state before the last physics step */
+    glm::vec3 previousX;
+    glm::quat previousQ;
+	float moveSpeed, maxSpeed;
+	float stamina, staminaMax , staminaDepletionRate, staminaRepletionRate;
+    SnailBody(glm::vec3 pos, float scalar, float mass);
+    void update(float t = 0, float dt = 0);
+    /** Call before each fixed physics step */
+    void savePrevious();
+    SnailSnapshot snapshot() const;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "SnailForcing.h"
+#include "SnailBody.h"
+
+using namespace glm;
+
+SnailEnvironment captureEnvironment(const SnailBody& snail, const InputState& input, const GroundSample& ground,
+                                    bool grounded, bool grabbed, float gravity, float muK, float muS) {
+    SnailEnvironment e;
+    e.keys = input.keys;
+    e.cameraAngle = input.cameraAngle;
+    e.retracted = snail.isRetracted;
+    e.grounded = grounded;
+    e.canFly = snail.abilityUnlocked;
+    e.grabbed = grabbed;
+    e.mass = snail.m;
+    e.radius = snail.radius;
+    e.gravity = gravity;
+    e.normal = ground.normal;
+    e.groundType = ground.type;
+
+    float roughness = abs(ground.type) + 0.2f;
+    e.muK = muK * roughness;
+    e.muS = muS * roughness;
+    e.rollingResistance = mix(5.5f, 2.5f, roughness);
+    return e;
+}
+
+SnailForcing::SnailForcing(const RigidBody& body) : body(&body) {
+    environment = SnailEnvironment();
+}
+
+void SnailForcing::operator()(float, const RigidBody::State& y, RigidBody::Wrench& f) const {
+    const SnailEnvironment& e = environment;
+    vec3 v = body->velocity(y);
+    vec3 w = body->angularVelocity(y);
+    if (!e.retracted) {
+        float stopDamping = 7.0f; // Very strong braking
+
+        // Linear Braking
+        f.force = -v * stopDamping * e.mass;
+
+        // Angular Braking (Stop spinning)
+        f.torque = -w * stopDamping;
+
+        return;
+    }
+
+    vec3 gravity(0.0f, -e.mass * e.gravity, 0.0f);
+    vec3 totalForce(0.0f);
+    if (!e.grabbed)
+        totalForce = gravity;
+    vec3 totalTorque(0.0f);
+
+    if (e.grounded)
+    {
+        const float inputForce = 800.0f;
+        const float BIAS = 1e-4f;
+
+        vec3 n = e.normal;
+        vec3 up(0, 1, 0);
+
+        // ---- Cancel normal gravity
+        vec3 gN = dot(gravity, n) * n;
+        vec3 gT = gravity - gN;
+        totalForce -= gN;
+
+        vec3 camForwardFlat = normalize(vec3(sin(e.cameraAngle), 0, cos(e.cameraAngle)));
+
+        // 2. Project camera forward onto the slope
+        vec3 slopeForward = camForwardFlat - dot(camForwardFlat, n) * n;
+        if (length(slopeForward) < BIAS) {
+            // Fallback if looking straight down/up a cliff
+            slopeForward = vec3(0, 0, -1) - dot(vec3(0, 0, -1), n) * n;
+        }
+        slopeForward = normalize(slopeForward);
+
+        vec3 slopeRight = normalize(cross(slopeForward, n));
+
+        vec3 vT = v - dot(v, n) * n;
+
+        float N = e.mass * e.gravity * clamp(dot(n, up), 0.0f, 1.0f);
+
+        vec3 drive(0.0f);
+        if (e.keys & KEY_FORWARD) drive -= slopeForward;
+        if (e.keys & KEY_BACK) drive += slopeForward;
+        if (e.keys & KEY_RIGHT) drive -= slopeRight;
+        if (e.keys & KEY_LEFT) drive += slopeRight;
+
+        if (length(drive) > BIAS)
+            drive = normalize(drive) * inputForce;
+        if ((e.keys & KEY_FLY) && e.canFly) totalForce += 50.0f * -gravity;
+        vec3 friction(0.0f);
+        if (length(vT) < 0.05f && length(drive + gT) < e.muS * N)
+        {
+            // STATIC friction  cancel the desire to move
+            friction = -(0.5f * drive + gT);
+        }
+        else if (length(vT) > BIAS)
+        {
+            // KINETIC friction  slide
+            friction = -normalize(vT) * e.muK * N;
+        }
+
+        vec3 tangentForce = gT + drive + friction;
+
+        float maxT = e.muK * N;
+        if (length(tangentForce) > maxT && length(vT) > 0.1f)
+            tangentForce = normalize(tangentForce) * maxT;
+
+        totalForce += tangentForce;
+        float speed = length(vT);
+
+        if (speed > 0.01f) {
+            vec3 rollAxis = normalize(cross(n, vT));
+            vec3 idealOmega = rollAxis * (speed / e.radius);
+            vec3 torque = (idealOmega - w) * 10.0f;
+            totalTorque += torque;
+        }
+
+        totalTorque -= w * e.rollingResistance;
+    }
+
+    f.force = totalForce;
+    f.torque = totalTorque;
+}
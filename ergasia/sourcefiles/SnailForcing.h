@@ -0,0 +1,64 @@
+#ifndef SNAIL_FORCING_H
+#define SNAIL_FORCING_H
+
+#include <glm/glm.hpp>
+#include "RigidBody.h"
+#include "HeightField.h"
+
+class SnailBody;
+
+/** Controls as bits of InputState::keys */
+enum InputKey {
+    KEY_FORWARD = 1 << 0, KEY_BACK = 1 << 1, KEY_LEFT = 1 << 2, KEY_RIGHT = 1 << 3,
+    KEY_SPRINT = 1 << 4, KEY_RETRACT = 1 << 5, KEY_FLY = 1 << 6, KEY_EAT = 1 << 7
+};
+
+/** What the player asks for during one physics step */
+struct InputState {
+    unsigned int keys;
+    /** camera heading, the snail is driven relative to it */
+    float cameraAngle;
+};
+
+/**
+ * Everything the snail's forces depend on besides its own state, captured
+ * once at the start of a physics step. The ground is sampled where the step
+ * starts and stays fixed across the Runge-Kutta stages, so the same
+ * environment always produces the same step.
+ */
+struct SnailEnvironment {
+    unsigned int keys;
+    float cameraAngle;
+    bool retracted, grounded, canFly, grabbed;
+    float mass, radius, gravity;
+    /** unit ground normal and material, 1 rock, 0 grass, -1 bouncy */
+    glm::vec3 normal;
+    float groundType;
+    /** kinetic and static friction coefficients and the rolling resistance of the material */
+    float muK, muS, rollingResistance;
+};
+
+/** muK and muS are the friction coefficients per unit of ground roughness */
+SnailEnvironment captureEnvironment(const SnailBody& snail, const InputState& input, const GroundSample& ground,
+                                    bool grounded, bool grabbed, float gravity, float muK = 2.0f, float muS = 5.0f);
+
+/**
+ * The snail's forcing function. It only reads the environment and the state
+ * it is handed, so it can be evaluated any number of times per step. Keep
+ * one alive and point RigidBody::forcing at it with std::ref, then replace
+ * environment before each step; copying it into the std::function would
+ * allocate.
+ */
+class SnailForcing {
+public:
+    SnailEnvironment environment;
+
+    explicit SnailForcing(const RigidBody& body);
+    void operator()(float t, const RigidBody::State& y, RigidBody::Wrench& f) const;
+
+private:
+    /** only its mass and inertia are used, to turn y into velocities */
+    const RigidBody* body;
+};
+
+#endif
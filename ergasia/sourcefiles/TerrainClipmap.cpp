@@ -0,0 +1,147 @@
+#include "TerrainClipmap.h"
+#include "heightmap.h"
+#include <common/shader.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+using namespace glm;
+
+// same units as the terrain pass, which rebinds them in drawTerrain()
+static const int BAKE_GRASS_UNIT = 0;
+static const int BAKE_ROCK_UNIT = 1;
+static const int BAKE_SPLAT_UNIT = 3;
+static const int BAKE_BOUNCY_UNIT = 4;
+
+static inline int positiveMod(int a, int b) {
+    int m = a % b;
+    return m < 0 ? m + b : m;
+}
+
+TerrainClipmap::TerrainClipmap(Heightmap* heightmap, GLuint grassTexture, GLuint rockTexture, GLuint bouncyTexture,
+                               int levels, int resolution, float texelSize)
+    : heightmap(heightmap), grassTexture(grassTexture), rockTexture(rockTexture), bouncyTexture(bouncyTexture),
+      levels(levels), resolution(resolution), texelSize(texelSize), center(0.0f), baked(false),
+      origins(levels, ivec2(0)) {
+    program = loadShaders("shaders/clipmapBake.vertexshader", "shaders/clipmapBake.fragmentshader");
+
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, resolution, resolution, levels, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    // toroidal addressing: filtering across the wrap reads the true neighbour
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glGenFramebuffers(1, &FBO);
+    // the bake draws one full-screen triangle from gl_VertexID, core profile still wants a VAO
+    glGenVertexArrays(1, &VAO);
+}
+
+TerrainClipmap::~TerrainClipmap() {
+    glDeleteFramebuffers(1, &FBO);
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteTextures(1, &textureID);
+    glDeleteProgram(program);
+}
+
+void TerrainClipmap::invalidate(const vec2& lo, const vec2& hi) {
+    invalid.push_back(vec4(lo.x, lo.y, hi.x, hi.y));
+}
+
+void TerrainClipmap::update(const vec3& position) {
+    center = vec2(position.x, position.z);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glViewport(0, 0, resolution, resolution);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_SCISSOR_TEST);
+    glUseProgram(program);
+    glBindVertexArray(VAO);
+
+    glActiveTexture(GL_TEXTURE0 + BAKE_GRASS_UNIT);
+    glBindTexture(GL_TEXTURE_2D, grassTexture);
+    glActiveTexture(GL_TEXTURE0 + BAKE_ROCK_UNIT);
+    glBindTexture(GL_TEXTURE_2D, rockTexture);
+    glActiveTexture(GL_TEXTURE0 + BAKE_SPLAT_UNIT);
+    glBindTexture(GL_TEXTURE_2D, heightmap->splatTextureID);
+    glActiveTexture(GL_TEXTURE0 + BAKE_BOUNCY_UNIT);
+    glBindTexture(GL_TEXTURE_2D, bouncyTexture);
+    glUniform1i(glGetUniformLocation(program, "grassSampler"), BAKE_GRASS_UNIT);
+    glUniform1i(glGetUniformLocation(program, "rockSampler"), BAKE_ROCK_UNIT);
+    glUniform1i(glGetUniformLocation(program, "splatMapSampler"), BAKE_SPLAT_UNIT);
+    glUniform1i(glGetUniformLocation(program, "bouncySampler"), BAKE_BOUNCY_UNIT);
+    glUniform2f(glGetUniformLocation(program, "terrainOrigin"),
+                heightmap->position.x - 0.5f * heightmap->scalar, heightmap->position.z - 0.5f * heightmap->scalar);
+    glUniform1f(glGetUniformLocation(program, "terrainSize"), heightmap->scalar);
+    glUniform1i(glGetUniformLocation(program, "resolution"), resolution);
+
+    for (int level = 0; level < levels; level++) {
+        float size = levelTexelSize(level);
+        ivec2 origin((int)floor(center.x / size) - resolution / 2, (int)floor(center.y / size) - resolution / 2);
+        ivec2 old = origins[level];
+        origins[level] = origin;
+
+        if (!baked || abs(origin.x - old.x) >= resolution || abs(origin.y - old.y) >= resolution) {
+            bake(level, { origin.x, origin.y, origin.x + resolution, origin.y + resolution });
+        } else {
+            // columns that scrolled in over the whole new window, then the
+            // rows that scrolled in over the columns both windows share
+            if (origin.x > old.x) bake(level, { old.x + resolution, origin.y, origin.x + resolution, origin.y + resolution });
+            if (origin.x < old.x) bake(level, { origin.x, origin.y, old.x, origin.y + resolution });
+            int x0 = std::max(origin.x, old.x), x1 = std::min(origin.x, old.x) + resolution;
+            if (origin.y > old.y) bake(level, { x0, old.y + resolution, x1, origin.y + resolution });
+            if (origin.y < old.y) bake(level, { x0, origin.y, x1, old.y });
+        }
+
+        for (const vec4& edit : invalid) {
+            bake(level, { (int)floor(edit.x / size) - 1, (int)floor(edit.y / size) - 1,
+                          (int)floor(edit.z / size) + 2, (int)floor(edit.w / size) + 2 });
+        }
+    }
+    invalid.clear();
+    baked = true;
+
+    glBindVertexArray(0);
+    glDisable(GL_SCISSOR_TEST);
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void TerrainClipmap::bake(int level, Rect rect) {
+    // clip to the level's window, then split where the slots wrap around
+    const ivec2& origin = origins[level];
+    rect.x0 = std::max(rect.x0, origin.x); rect.x1 = std::min(rect.x1, origin.x + resolution);
+    rect.z0 = std::max(rect.z0, origin.y); rect.z1 = std::min(rect.z1, origin.y + resolution);
+    if (rect.x0 >= rect.x1 || rect.z0 >= rect.z1) return;
+
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureID, 0, level);
+    glUniform2i(glGetUniformLocation(program, "origin"), origin.x, origin.y);
+    glUniform2i(glGetUniformLocation(program, "originSlot"), positiveMod(origin.x, resolution), positiveMod(origin.y, resolution));
+    glUniform1f(glGetUniformLocation(program, "texelSize"), levelTexelSize(level));
+
+    int sx = positiveMod(rect.x0, resolution), sz = positiveMod(rect.z0, resolution);
+    int w = rect.x1 - rect.x0, h = rect.z1 - rect.z0;
+    int spansX[2][2] = { { sx, std::min(w, resolution - sx) }, { 0, w - std::min(w, resolution - sx) } };
+    int spansZ[2][2] = { { sz, std::min(h, resolution - sz) }, { 0, h - std::min(h, resolution - sz) } };
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            if (spansX[i][1] <= 0 || spansZ[j][1] <= 0) continue;
+            glScissor(spansX[i][0], spansZ[j][0], spansX[i][1], spansZ[j][1]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    }
+}
+
+void TerrainClipmap::bind(GLuint target, int unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    glUniform1i(glGetUniformLocation(target, "clipmapSampler"), unit);
+    glUniform1i(glGetUniformLocation(target, "clipmapMode"), 1);
+    glUniform2f(glGetUniformLocation(target, "clipmapCenter"), center.x, center.y);
+    glUniform1f(glGetUniformLocation(target, "clipmapTexelSize"), texelSize);
+    glUniform1i(glGetUniformLocation(target, "clipmapResolution"), resolution);
+    glUniform1i(glGetUniformLocation(target, "clipmapLevels"), levels);
+}
@@ -0,0 +1,57 @@
+#ifndef TERRAIN_CLIPMAP_H
+#define TERRAIN_CLIPMAP_H
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+class Heightmap;
+
+/**
+ * Pre-blended terrain albedo around the camera. Each level of a texture
+ * array covers a square window of resolution^2 texels, twice as wide as the
+ * level before, and is addressed toroidally (world texel w lives in slot
+ * w mod resolution), so when the camera moves only the rows and columns that
+ * scrolled into a window are re-baked. The terrain shader then fetches one
+ * texel instead of blending grass, rock and bouncy by the splat map.
+ *
+ * Baking renders into the array through a framebuffer, it leaves framebuffer
+ * 0 bound and depth testing enabled.
+ */
+class TerrainClipmap {
+public:
+    /** texelSize is the world size of a level 0 texel */
+    TerrainClipmap(Heightmap* heightmap, GLuint grassTexture, GLuint rockTexture, GLuint bouncyTexture,
+                   int levels = 6, int resolution = 512, float texelSize = 0.5f);
+    ~TerrainClipmap();
+
+    /** Re-centers every level on center and bakes what scrolled in or was invalidated */
+    void update(const glm::vec3& center);
+    /** Re-bakes the world rectangle lo..hi (x, z) on the next update, after splat edits */
+    void invalidate(const glm::vec2& lo, const glm::vec2& hi);
+    /** Binds the array to unit and sets the clipmap uniforms of the ShadowMapping program */
+    void bind(GLuint target, int unit);
+
+    GLuint textureID;
+
+private:
+    /** world texel rectangle [x0, x1) x [z0, z1) of one level */
+    struct Rect { int x0, z0, x1, z1; };
+
+    Heightmap* heightmap;
+    GLuint grassTexture, rockTexture, bouncyTexture;
+    GLuint program, FBO, VAO;
+    int levels, resolution;
+    float texelSize;
+    glm::vec2 center;
+    bool baked;
+    /** world texel (x, z) of the lower corner of each level's window */
+    std::vector<glm::ivec2> origins;
+    /** world x0, z0, x1, z1 of edits waiting for the next update */
+    std::vector<glm::vec4> invalid;
+
+    float levelTexelSize(int level) const { return texelSize * (float)(1 << level); }
+    void bake(int level, Rect rect);
+};
+
+#endif
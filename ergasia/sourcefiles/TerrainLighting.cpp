@@ -0,0 +1,83 @@
+#include "TerrainLighting.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+static inline uint8_t unitToByte(float v) {
+    int b = (int)floor((v * 0.5f + 0.5f) * 255.0f + 0.5f);
+    return (uint8_t)std::min(std::max(b, 0), 255);
+}
+
+// bilinear grid height at fractional sample (r, c), clamped to the grid
+static inline float heightAt(const vector<vector<float>>& grid, int rows, int cols, float r, float c) {
+    r = std::min(std::max(r, 0.0f), (float)(rows - 1));
+    c = std::min(std::max(c, 0.0f), (float)(cols - 1));
+    int r0 = std::min((int)r, rows - 2), c0 = std::min((int)c, cols - 2);
+    float fr = r - r0, fc = c - c0;
+    float top = grid[r0][c0] + (grid[r0][c0 + 1] - grid[r0][c0]) * fc;
+    float bot = grid[r0 + 1][c0] + (grid[r0 + 1][c0 + 1] - grid[r0 + 1][c0]) * fc;
+    return top + (bot - top) * fr;
+}
+
+void bakeTerrainLighting(const vector<vector<float>>& grid, float stepX, float stepZ, float scaleY,
+                         int r0, int c0, int r1, int c1, uint8_t* out) {
+    int rows = (int)grid.size();
+    int cols = rows > 0 ? (int)grid[0].size() : 0;
+    if (rows < 2 || cols < 2) return;
+
+    // sample offsets of every horizon step and their world distances; steps
+    // are packed near the center where small features occlude the most
+    float dirR[HORIZON_DIRECTIONS], dirC[HORIZON_DIRECTIONS], dirX[HORIZON_DIRECTIONS], dirZ[HORIZON_DIRECTIONS];
+    float stepDist[HORIZON_DIRECTIONS], stepLength[HORIZON_STEPS];
+    for (int d = 0; d < HORIZON_DIRECTIONS; d++) {
+        float a = 6.2831853f * d / HORIZON_DIRECTIONS;
+        dirC[d] = cos(a);
+        dirR[d] = sin(a);
+        float wx = dirC[d] * stepX, wz = dirR[d] * stepZ;
+        stepDist[d] = sqrt(wx * wx + wz * wz);
+        dirX[d] = wx / stepDist[d];
+        dirZ[d] = wz / stepDist[d];
+    }
+    for (int s = 0; s < HORIZON_STEPS; s++) {
+        float t = (float)s / (HORIZON_STEPS - 1);
+        stepLength[s] = 1.0f + (HORIZON_RADIUS - 1.0f) * t * t;
+    }
+
+    parallelFor(r0, r1, [&](int b, int e) {
+        for (int r = b; r < e; r++) {
+            int rD = std::max(r - 1, 0), rU = std::min(r + 1, rows - 1);
+            for (int c = c0; c < c1; c++) {
+                int cL = std::max(c - 1, 0), cR = std::min(c + 1, cols - 1);
+                // world-space slopes from central differences, one-sided at the border
+                float slopeX = (grid[r][cR] - grid[r][cL]) * scaleY / ((cR - cL) * stepX);
+                float slopeZ = (grid[rU][c] - grid[rD][c]) * scaleY / ((rU - rD) * stepZ);
+                float invLen = 1.0f / sqrt(slopeX * slopeX + slopeZ * slopeZ + 1.0f);
+
+                // horizon angles are measured above the tangent plane, so a
+                // plain slope stays unoccluded
+                float h = grid[r][c] * scaleY;
+                float occlusion = 0.0f;
+                for (int d = 0; d < HORIZON_DIRECTIONS; d++) {
+                    float tangent = slopeX * dirX[d] + slopeZ * dirZ[d];
+                    float horizon = tangent;
+                    for (int s = 0; s < HORIZON_STEPS; s++) {
+                        float sr = r + dirR[d] * stepLength[s], sc = c + dirC[d] * stepLength[s];
+                        float rise = heightAt(grid, rows, cols, sr, sc) * scaleY - h;
+                        horizon = std::max(horizon, rise / (stepLength[s] * stepDist[d]));
+                    }
+                    // sine of the elevation from its tangent
+                    occlusion += horizon / sqrt(1.0f + horizon * horizon) - tangent / sqrt(1.0f + tangent * tangent);
+                }
+                float ao = 1.0f - occlusion / HORIZON_DIRECTIONS;
+
+                uint8_t* texel = out + ((size_t)r * cols + c) * LIGHTING_CHANNELS;
+                texel[0] = unitToByte(-slopeX * invLen);
+                texel[1] = unitToByte(-slopeZ * invLen);
+                texel[2] = unitToByte(invLen);
+                texel[3] = (uint8_t)std::min(std::max((int)(ao * 255.0f + 0.5f), 0), 255);
+            }
+        }
+    }, 16);
+}
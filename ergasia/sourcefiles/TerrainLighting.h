@@ -0,0 +1,31 @@
+#ifndef TERRAIN_LIGHTING_H
+#define TERRAIN_LIGHTING_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Per-sample shading data baked from a height grid, stored as RGBA bytes and
+ * uploaded as one GL_RGBA8 texture. rgb holds the surface normal in the
+ * terrain's tangent frame (tangent +x, bitangent +z, normal +y), mapped from
+ * [-1, 1] to 0..255; alpha holds horizon-based ambient occlusion (255 = open
+ * sky). Fragments read their normal from it, so lighting keeps the detail of
+ * the full grid however coarse the mesh underneath is.
+ */
+static const int LIGHTING_CHANNELS = 4;
+
+/** Horizon search per sample: directions, steps per direction and reach in samples */
+static const int HORIZON_DIRECTIONS = 8;
+static const int HORIZON_STEPS = 8;
+static const int HORIZON_RADIUS = 16;
+
+/**
+ * Bakes samples rows [r0, r1), columns [c0, c1) of out, which holds
+ * rows * cols * LIGHTING_CHANNELS bytes. stepX and stepZ are the world
+ * distances between neighbouring samples, scaleY turns grid heights into
+ * world units. Rows are split across worker threads.
+ */
+void bakeTerrainLighting(const std::vector<std::vector<float>>& grid, float stepX, float stepZ, float scaleY,
+                         int r0, int c0, int r1, int c1, uint8_t* out);
+
+#endif
@@ -0,0 +1,159 @@
+#include "TerrainNoise.h"
+#include "Random.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_NOISE_SSE2
+#include <emmintrin.h>
+#endif
+
+static const uint32_t HASH_X = 0x8da6b343U;
+static const uint32_t HASH_Z = 0xd8163841U;
+static const uint32_t OCTAVE_SEED = 0x9e3779b9U;
+static const float INV_2_24 = 1.0f / 16777216.0f;
+
+static inline float latticeValue(int ix, int iz, uint32_t seed) {
+    uint32_t h = hash32(((uint32_t)ix * HASH_X) ^ ((uint32_t)iz * HASH_Z) ^ seed);
+    return (float)(h >> 8) * INV_2_24;
+}
+
+float valueNoise(float x, float z, uint32_t seed) {
+    float fx = std::floor(x);
+    float fz = std::floor(z);
+    int ix = (int)fx;
+    int iz = (int)fz;
+    float tx = x - fx;
+    float tz = z - fz;
+    tx = tx * tx * (3.0f - 2.0f * tx);
+    tz = tz * tz * (3.0f - 2.0f * tz);
+
+    float a = latticeValue(ix, iz, seed);
+    float b = latticeValue(ix + 1, iz, seed);
+    float c = latticeValue(ix, iz + 1, seed);
+    float d = latticeValue(ix + 1, iz + 1, seed);
+
+    float top = a + (b - a) * tx;
+    float bot = c + (d - c) * tx;
+    return top + (bot - top) * tz;
+}
+
+float fbm(float x, float z, uint32_t seed, const NoiseParameters& p) {
+    float sum = 0.0f;
+    float amp = 1.0f;
+    float freq = p.frequency;
+    for (int o = 0; o < p.octaves; o++) {
+        float n = valueNoise(x * freq, z * freq, seed + o * OCTAVE_SEED) * 2.0f - 1.0f;
+        if (p.ridged) {
+            n = 1.0f - std::fabs(n);
+            n = n * n;
+        }
+        sum += n * amp;
+        amp *= p.gain;
+        freq *= p.lacunarity;
+    }
+    return sum * p.amplitude;
+}
+
+#ifdef TERRAIN_NOISE_SSE2
+
+// SSE2 has no 32-bit low multiply, build it from two 32x32->64 multiplies
+static inline __m128i mullo32(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128i hash32x4(__m128i x) {
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    x = mullo32(x, _mm_set1_epi32((int)0x7feb352dU));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+    x = mullo32(x, _mm_set1_epi32((int)0x846ca68bU));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    return x;
+}
+
+static inline __m128 latticeValue4(__m128i hx, __m128i hz, __m128i seed) {
+    __m128i h = hash32x4(_mm_xor_si128(_mm_xor_si128(hx, hz), seed));
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(h, 8)), _mm_set1_ps(INV_2_24));
+}
+
+static inline __m128 valueNoise4(__m128 x, __m128 z, uint32_t seed) {
+    // floor: truncate, then step down where truncation rounded up
+    __m128i ix = _mm_cvttps_epi32(x);
+    __m128i iz = _mm_cvttps_epi32(z);
+    __m128 fx = _mm_cvtepi32_ps(ix);
+    __m128 fz = _mm_cvtepi32_ps(iz);
+    __m128 gx = _mm_cmpgt_ps(fx, x);
+    __m128 gz = _mm_cmpgt_ps(fz, z);
+    ix = _mm_add_epi32(ix, _mm_castps_si128(gx));
+    iz = _mm_add_epi32(iz, _mm_castps_si128(gz));
+    fx = _mm_cvtepi32_ps(ix);
+    fz = _mm_cvtepi32_ps(iz);
+
+    const __m128 three = _mm_set1_ps(3.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    __m128 tx = _mm_sub_ps(x, fx);
+    __m128 tz = _mm_sub_ps(z, fz);
+    tx = _mm_mul_ps(_mm_mul_ps(tx, tx), _mm_sub_ps(three, _mm_mul_ps(two, tx)));
+    tz = _mm_mul_ps(_mm_mul_ps(tz, tz), _mm_sub_ps(three, _mm_mul_ps(two, tz)));
+
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i kx = _mm_set1_epi32((int)HASH_X);
+    const __m128i kz = _mm_set1_epi32((int)HASH_Z);
+    __m128i hx0 = mullo32(ix, kx);
+    __m128i hx1 = mullo32(_mm_add_epi32(ix, one), kx);
+    __m128i hz0 = mullo32(iz, kz);
+    __m128i hz1 = mullo32(_mm_add_epi32(iz, one), kz);
+    __m128i s = _mm_set1_epi32((int)seed);
+
+    __m128 a = latticeValue4(hx0, hz0, s);
+    __m128 b = latticeValue4(hx1, hz0, s);
+    __m128 c = latticeValue4(hx0, hz1, s);
+    __m128 d = latticeValue4(hx1, hz1, s);
+
+    __m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), tx));
+    __m128 bot = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), tx));
+    return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bot, top), tz));
+}
+
+static inline __m128 fbm4(__m128 x, __m128 z, uint32_t seed, const NoiseParameters& p) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 sum = _mm_setzero_ps();
+    float amp = 1.0f;
+    float freq = p.frequency;
+    for (int o = 0; o < p.octaves; o++) {
+        __m128 f = _mm_set1_ps(freq);
+        __m128 n = valueNoise4(_mm_mul_ps(x, f), _mm_mul_ps(z, f), seed + o * OCTAVE_SEED);
+        n = _mm_sub_ps(_mm_mul_ps(n, two), one);
+        if (p.ridged) {
+            n = _mm_sub_ps(one, _mm_and_ps(n, absMask));
+            n = _mm_mul_ps(n, n);
+        }
+        sum = _mm_add_ps(sum, _mm_mul_ps(n, _mm_set1_ps(amp)));
+        amp *= p.gain;
+        freq *= p.lacunarity;
+    }
+    return _mm_mul_ps(sum, _mm_set1_ps(p.amplitude));
+}
+
+#endif
+
+void fbmRow(float x0, float dx, float z, int count, uint32_t seed, const NoiseParameters& p, float* out) {
+    int i = 0;
+#ifdef TERRAIN_NOISE_SSE2
+    const __m128 vx0 = _mm_set1_ps(x0);
+    const __m128 vdx = _mm_set1_ps(dx);
+    const __m128 vz = _mm_set1_ps(z);
+    for (; i + 4 <= count; i += 4) {
+        __m128 lane = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i), _mm_set_epi32(3, 2, 1, 0)));
+        __m128 x = _mm_add_ps(vx0, _mm_mul_ps(lane, vdx));
+        _mm_storeu_ps(out + i, fbm4(x, vz, seed, p));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = fbm(x0 + (float)i * dx, z, seed, p);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef TERRAIN_NOISE_H
+#define TERRAIN_NOISE_H
+
+#include <cstdint>
+
+/**
+ * Lattice value noise summed over octaves (fBm), optionally folded into
+ * ridges. The lattice values come from an integer hash of the cell and the
+ * seed, so the field is reproducible and can be evaluated in any order.
+ */
+struct NoiseParameters {
+    NoiseParameters()
+        : amplitude(0.0f), frequency(0.02f), lacunarity(2.0f), gain(0.5f), octaves(5), ridged(false) {
+    }
+    /** amplitude 0 disables the noise layer */
+    float amplitude, frequency, lacunarity, gain;
+    int octaves;
+    bool ridged;
+};
+
+/** Single octave of value noise in [0, 1) */
+float valueNoise(float x, float z, uint32_t seed);
+
+/** fBm (or ridged fBm) in roughly [-1, 1], scaled by p.amplitude */
+float fbm(float x, float z, uint32_t seed, const NoiseParameters& p);
+
+/**
+ * Evaluates fbm() at count points (x0 + i * dx, z). Uses SSE2 four lanes at a
+ * time when available and gives bit-identical results to the scalar path.
+ */
+void fbmRow(float x0, float dx, float z, int count, uint32_t seed, const NoiseParameters& p, float* out);
+
+#endif
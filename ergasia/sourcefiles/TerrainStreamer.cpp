@@ -0,0 +1,449 @@
+#include "TerrainStreamer.h"
+#include "ThreadPool.h"
+#include "Random.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+static const int FLOATS_PER_VERTEX = 8;
+
+static inline int floorDiv(int a, int b) {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+static inline float classify(float height) {
+    if (height < 0.0f) return -1.0f;  // bouncy
+    if (height < 0.07f) return 1.0f;  // rock
+    return 0.0f;                      // grass
+}
+
+TerrainStreamer::TerrainStreamer(const Parameters& p, int threads)
+    : params(p), indexBuffer(0), indexCount(0), frame(0), maxGradient(0.0f) {
+    centerTile.x = centerTile.z = 0;
+
+    // tiles only look at the hills of their 3x3 neighbourhood, so a hill must
+    // not reach further than one tile minus the normal apron
+    float cell = params.tileSize / params.tileResolution;
+    params.hillRadiusMax = std::min(params.hillRadiusMax, params.tileSize - 2.0f * cell);
+    params.hillRadiusMin = std::min(params.hillRadiusMin, params.hillRadiusMax);
+
+    int res = params.tileResolution;
+    vector<unsigned int> indices;
+    indices.reserve(res * res * 6);
+    for (int i = 0; i < res; i++) {
+        for (int j = 0; j < res; j++) {
+            unsigned int v00 = i * (res + 1) + j;
+            unsigned int v10 = (i + 1) * (res + 1) + j;
+            indices.push_back(v00); indices.push_back(v10); indices.push_back(v00 + 1);
+            indices.push_back(v10); indices.push_back(v10 + 1); indices.push_back(v00 + 1);
+        }
+    }
+    indexCount = (int)indices.size();
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+
+    pool.reset(new ThreadPool(threads));
+}
+
+TerrainStreamer::~TerrainStreamer() {
+    // stop the workers before the queues they write to go away
+    pool.reset();
+    for (auto& slot : slots) {
+        glDeleteBuffers(1, &slot.VBO);
+        glDeleteVertexArrays(1, &slot.VAO);
+        glDeleteTextures(1, &slot.splatTextureID);
+    }
+    glDeleteBuffers(1, &indexBuffer);
+}
+
+TerrainStreamer::TileKey TerrainStreamer::tileOf(float worldX, float worldZ) const {
+    TileKey key;
+    key.x = (int)floor(worldX / params.tileSize);
+    key.z = (int)floor(worldZ / params.tileSize);
+    return key;
+}
+
+bool TerrainStreamer::inRing(const TileKey& key) const {
+    return abs(key.x - centerTile.x) <= params.radius && abs(key.z - centerTile.z) <= params.radius;
+}
+
+void TerrainStreamer::tileHills(const TileKey& key, vector<Hill>& hills) const {
+    hills.clear();
+    // fixed absolute order, so tiles sharing a border sum the same hills in the same order
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            int tx = key.x + dx;
+            int tz = key.z + dz;
+            CounterRng rng(params.seed, hash32((uint32_t)tx * 73856093U ^ (uint32_t)tz * 19349663U));
+            for (int i = 0; i < params.hillsPerTile; i++) {
+                Hill hill;
+                hill.x = (tx + rng.uniform(0.0f, 1.0f)) * params.tileSize;
+                hill.z = (tz + rng.uniform(0.0f, 1.0f)) * params.tileSize;
+                hill.rad = rng.uniform(params.hillRadiusMin, params.hillRadiusMax);
+                hill.h = rng.uniform(params.hillMinHeight, params.hillMaxHeight);
+                hills.push_back(hill);
+            }
+        }
+    }
+}
+
+// The noise is evaluated in sample units (global sample indices as floats),
+// so fbmRow() in buildTile() and fbm() in queries see identical coordinates.
+float TerrainStreamer::addHills(float base, int gc, int gr, const vector<Hill>& hills) const {
+    float cell = params.tileSize / params.tileResolution;
+    float x = gc * cell;
+    float z = gr * cell;
+    float h = base;
+    for (const Hill& hill : hills) {
+        float dx = hill.x - x;
+        float dz = hill.z - z;
+        float r2 = hill.rad * hill.rad;
+        float hVal = (r2 - dx * dx - dz * dz) / 5;
+        if (hVal > 0.0f) {
+            h += hill.h * (hVal / r2);
+            if (h > 1.0f) h = 1.0f;
+        }
+    }
+    return h;
+}
+
+float TerrainStreamer::sampleHeight(int gc, int gr, const vector<Hill>& hills) const {
+    float base = params.noise.amplitude != 0.0f ? fbm((float)gc, (float)gr, params.seed, params.noise) : 0.0f;
+    return addHills(base, gc, gr, hills);
+}
+
+shared_ptr<TerrainStreamer::TileData> TerrainStreamer::buildTile(const TileKey& key) const {
+    shared_ptr<TileData> data(new TileData());
+    data->key = key;
+
+    int res = params.tileResolution;
+    int n = res + 3; // one sample of apron on every side for normals and blur
+    float cell = params.tileSize / res;
+    int gc0 = key.x * res - 1;
+    int gr0 = key.z * res - 1;
+
+    vector<Hill> hills;
+    tileHills(key, hills);
+
+    data->heights.assign(n * n, 0.0f);
+    for (int r = 0; r < n; r++) {
+        float* row = &data->heights[r * n];
+        if (params.noise.amplitude != 0.0f) {
+            fbmRow((float)gc0, 1.0f, (float)(gr0 + r), n, params.seed, params.noise, row);
+        }
+        for (int c = 0; c < n; c++) {
+            row[c] = addHills(row[c], gc0 + c, gr0 + r, hills);
+        }
+    }
+
+    // queries interpolate these samples bilinearly, so their steepest
+    // differences bound the slope anywhere on the tile
+    float riseX = 0.0f, riseZ = 0.0f;
+    for (int r = 0; r < n; r++) {
+        for (int c = 0; c < n; c++) {
+            float h = data->heights[r * n + c];
+            if (c + 1 < n) riseX = std::max(riseX, fabs(data->heights[r * n + c + 1] - h));
+            if (r + 1 < n) riseZ = std::max(riseZ, fabs(data->heights[(r + 1) * n + c] - h));
+        }
+    }
+    data->gradient = vec2(riseX, riseZ) * (params.scalarY / cell);
+
+    // ground type, blurred over 3x3 like the Heightmap; the apron makes it seamless
+    vector<float> classes(n * n);
+    for (int i = 0; i < n * n; i++) classes[i] = classify(data->heights[i]);
+    data->types.resize((res + 1) * (res + 1));
+    for (int r = 0; r <= res; r++) {
+        for (int c = 0; c <= res; c++) {
+            float sum = 0.0f;
+            for (int ir = 0; ir <= 2; ir++)
+                for (int ic = 0; ic <= 2; ic++)
+                    sum += classes[(r + ir) * n + c + ic];
+            data->types[r * (res + 1) + c] = sum / 9.0f;
+        }
+    }
+
+    data->vertices.resize((res + 1) * (res + 1) * FLOATS_PER_VERTEX);
+    data->splat.resize((res + 1) * (res + 1) * 3);
+    for (int r = 0; r <= res; r++) {
+        for (int c = 0; c <= res; c++) {
+            const float* h = &data->heights[(r + 1) * n + c + 1];
+            float hL = h[-1], hR = h[1], hD = h[-n], hU = h[n];
+            vec3 tangentX(2.0f * cell, (hR - hL) * params.scalarY, 0.0f);
+            vec3 tangentZ(0.0f, (hU - hD) * params.scalarY, 2.0f * cell);
+            vec3 normal = normalize(cross(tangentZ, tangentX));
+
+            int k = r * (res + 1) + c;
+            float* v = &data->vertices[k * FLOATS_PER_VERTEX];
+            v[0] = (gc0 + 1 + c) * cell;
+            v[1] = h[0] * params.scalarY;
+            v[2] = (gr0 + 1 + r) * cell;
+            v[3] = normal.x; v[4] = normal.y; v[5] = normal.z;
+            v[6] = (float)c / res;
+            v[7] = (float)r / res;
+
+            float type = data->types[k];
+            data->splat[k * 3 + 0] = type > 0.5f ? 255 : 0;
+            data->splat[k * 3 + 1] = type < -0.5f ? 255 : 0;
+            data->splat[k * 3 + 2] = 0;
+        }
+    }
+    return data;
+}
+
+int TerrainStreamer::acquireSlot() {
+    int ring = 2 * params.radius + 1;
+    int maxSlots = ring * ring + params.cachedTiles;
+    if ((int)slots.size() < maxSlots) {
+        int res = params.tileResolution;
+        GpuSlot slot;
+        slot.lastUsed = 0;
+
+        glGenVertexArrays(1, &slot.VAO);
+        glBindVertexArray(slot.VAO);
+        glGenBuffers(1, &slot.VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, slot.VBO);
+        glBufferData(GL_ARRAY_BUFFER, (res + 1) * (res + 1) * FLOATS_PER_VERTEX * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+        GLsizei stride = FLOATS_PER_VERTEX * sizeof(float);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBindVertexArray(0);
+
+        glGenTextures(1, &slot.splatTextureID);
+        glBindTexture(GL_TEXTURE_2D, slot.splatTextureID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, res + 1, res + 1, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        slots.push_back(slot);
+        return (int)slots.size() - 1;
+    }
+
+    // recycle the least recently used slot that is not part of the ring
+    int best = -1;
+    for (int i = 0; i < (int)slots.size(); i++) {
+        if (slots[i].data && inRing(slots[i].data->key)) continue;
+        if (best < 0 || slots[i].lastUsed < slots[best].lastUsed) best = i;
+    }
+    if (slots[best].data) {
+        tileSlots.erase(slots[best].data->key);
+        slots[best].data.reset();
+    }
+    return best;
+}
+
+void TerrainStreamer::upload(const shared_ptr<TileData>& data) {
+    int index = acquireSlot();
+    GpuSlot& slot = slots[index];
+    int res = params.tileResolution;
+
+    glBindBuffer(GL_ARRAY_BUFFER, slot.VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, data->vertices.size() * sizeof(float), &data->vertices[0]);
+    glBindTexture(GL_TEXTURE_2D, slot.splatTextureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, res + 1, res + 1, GL_RGB, GL_UNSIGNED_BYTE, &data->splat[0]);
+
+    // the mesh lives on the GPU now, the CPU copy only serves queries
+    data->vertices.clear();
+    data->vertices.shrink_to_fit();
+    data->splat.clear();
+    data->splat.shrink_to_fit();
+
+    slot.data = data;
+    slot.lastUsed = frame;
+    tileSlots[data->key] = index;
+}
+
+void TerrainStreamer::update(const vec3& center) {
+    frame++;
+    centerTile = tileOf(center.x, center.z);
+
+    // upload finished tiles, nearest ones were requested first
+    deque<shared_ptr<TileData>> finished;
+    {
+        lock_guard<mutex> lock(readyMutex);
+        finished.swap(ready);
+    }
+    int uploads = 0;
+    while (!finished.empty()) {
+        shared_ptr<TileData> data = finished.front();
+        finished.pop_front();
+        maxGradient = glm::max(maxGradient, data->gradient);
+        if (!inRing(data->key)) {
+            pending.erase(data->key);
+        }
+        else if (uploads < params.maxUploadsPerFrame) {
+            pending.erase(data->key);
+            upload(data);
+            uploads++;
+        }
+        else {
+            lock_guard<mutex> lock(readyMutex);
+            ready.push_back(data);
+        }
+    }
+
+    // request missing tiles ring by ring, touch resident ones
+    for (int d = 0; d <= params.radius; d++) {
+        for (int dz = -d; dz <= d; dz++) {
+            for (int dx = -d; dx <= d; dx++) {
+                if (std::max(abs(dx), abs(dz)) != d) continue;
+                TileKey key = { centerTile.x + dx, centerTile.z + dz };
+                auto it = tileSlots.find(key);
+                if (it != tileSlots.end()) {
+                    slots[it->second].lastUsed = frame;
+                }
+                else if (pending.insert(key).second) {
+                    pool->submit([this, key]() {
+                        shared_ptr<TileData> data = buildTile(key);
+                        lock_guard<mutex> lock(readyMutex);
+                        ready.push_back(data);
+                    });
+                }
+            }
+        }
+    }
+}
+
+void TerrainStreamer::preload(const vec3& center) {
+    update(center);
+    pool->wait();
+    int maxUploads = params.maxUploadsPerFrame;
+    params.maxUploadsPerFrame = (2 * params.radius + 1) * (2 * params.radius + 1);
+    update(center);
+    params.maxUploadsPerFrame = maxUploads;
+}
+
+void TerrainStreamer::draw() {
+    glActiveTexture(GL_TEXTURE3);
+    for (auto& slot : slots) {
+        if (!slot.data || !inRing(slot.data->key)) continue;
+        glBindTexture(GL_TEXTURE_2D, slot.splatTextureID);
+        glBindVertexArray(slot.VAO);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, NULL);
+    }
+    glBindVertexArray(0);
+}
+
+const TerrainStreamer::TileData* TerrainStreamer::residentData(int gc, int gr, TileKey& key, int& lc, int& lr) const {
+    int res = params.tileResolution;
+    key.x = floorDiv(gc, res);
+    key.z = floorDiv(gr, res);
+    lc = gc - key.x * res;
+    lr = gr - key.z * res;
+    auto it = tileSlots.find(key);
+    if (it == tileSlots.end()) return NULL;
+    return slots[it->second].data.get();
+}
+
+float TerrainStreamer::heightAtSample(int gc, int gr) {
+    TileKey key;
+    int lc, lr;
+    const TileData* data = residentData(gc, gr, key, lc, lr);
+    if (data) {
+        int n = params.tileResolution + 3;
+        return data->heights[(lr + 1) * n + lc + 1];
+    }
+    vector<Hill> hills;
+    tileHills(key, hills);
+    return sampleHeight(gc, gr, hills);
+}
+
+float TerrainStreamer::getHeightAt(float worldX, float worldZ) {
+    float cell = params.tileSize / params.tileResolution;
+    float fc = worldX / cell;
+    float fr = worldZ / cell;
+    int c = (int)floor(fc);
+    int r = (int)floor(fr);
+    float percentU = fc - c;
+    float percentV = fr - r;
+
+    float h00, h01, h10, h11;
+    TileKey key;
+    int lc, lr;
+    const TileData* data = residentData(c, r, key, lc, lr);
+    if (data) {
+        // the apron holds the +1 neighbours of the last row and column
+        int n = params.tileResolution + 3;
+        const float* h = &data->heights[(lr + 1) * n + lc + 1];
+        h00 = h[0]; h01 = h[1]; h10 = h[n]; h11 = h[n + 1];
+    }
+    else {
+        vector<Hill> hills;
+        tileHills(key, hills);
+        h00 = sampleHeight(c, r, hills);
+        h01 = sampleHeight(c + 1, r, hills);
+        h10 = sampleHeight(c, r + 1, hills);
+        h11 = sampleHeight(c + 1, r + 1, hills);
+    }
+    float hTop = h00 * (1.0f - percentU) + h01 * percentU;
+    float hBot = h10 * (1.0f - percentU) + h11 * percentU;
+    return (hTop * (1.0f - percentV) + hBot * percentV) * params.scalarY;
+}
+
+vec3 TerrainStreamer::getNormalAt(float worldX, float worldZ) {
+    float cell = params.tileSize / params.tileResolution;
+    int c = (int)floor(worldX / cell);
+    int r = (int)floor(worldZ / cell);
+
+    float hL, hR, hD, hU;
+    TileKey key;
+    int lc, lr;
+    const TileData* data = residentData(c, r, key, lc, lr);
+    if (data) {
+        int n = params.tileResolution + 3;
+        const float* h = &data->heights[(lr + 1) * n + lc + 1];
+        hL = h[-1]; hR = h[1]; hD = h[-n]; hU = h[n];
+    }
+    else {
+        hL = heightAtSample(c - 1, r); hR = heightAtSample(c + 1, r);
+        hD = heightAtSample(c, r - 1); hU = heightAtSample(c, r + 1);
+    }
+    vec3 tangentX(2.0f * cell, (hR - hL) * params.scalarY, 0.0f);
+    vec3 tangentZ(0.0f, (hU - hD) * params.scalarY, 2.0f * cell);
+    return normalize(cross(tangentZ, tangentX));
+}
+
+float TerrainStreamer::getGroundTypeAt(float worldX, float worldZ) {
+    float cell = params.tileSize / params.tileResolution;
+    float fc = worldX / cell;
+    float fr = worldZ / cell;
+    int c = (int)floor(fc);
+    int r = (int)floor(fr);
+    float percentU = fc - c;
+    float percentV = fr - r;
+
+    TileKey key;
+    int lc, lr;
+    const TileData* data = residentData(c, r, key, lc, lr);
+    float t00, t01, t10, t11;
+    if (data) {
+        int w = params.tileResolution + 1;
+        const float* t = &data->types[lr * w + lc];
+        t00 = t[0]; t01 = t[1]; t10 = t[w]; t11 = t[w + 1];
+    }
+    else {
+        // unblurred class is close enough for tiles nobody has streamed in yet
+        t00 = classify(heightAtSample(c, r));
+        t01 = classify(heightAtSample(c + 1, r));
+        t10 = classify(heightAtSample(c, r + 1));
+        t11 = classify(heightAtSample(c + 1, r + 1));
+    }
+    float tTop = t00 * (1.0f - percentU) + t01 * percentU;
+    float tBot = t10 * (1.0f - percentU) + t11 * percentU;
+    return tTop * (1.0f - percentV) + tBot * percentV;
+}
+
+float TerrainStreamer::maxSlope() {
+    return length(maxGradient);
+}
@@ -0,0 +1,132 @@
+#ifndef TERRAIN_STREAMER_H
+#define TERRAIN_STREAMER_H
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <unordered_set>
+#include <unordered_map>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "HeightField.h"
+#include "TerrainNoise.h"
+
+class ThreadPool;
+
+/**
+ * Unbounded terrain made of square tiles that are generated and meshed on
+ * worker threads around a moving center. Tiles inside the ring are drawn,
+ * tiles that leave it keep their GPU buffers in an LRU pool until the slot is
+ * needed again, so memory stays constant however far the snail travels.
+ *
+ * Heights are a pure function of world position (hills seeded per tile plus
+ * an optional fBm layer), so neighbouring tiles share their border samples
+ * exactly and queries outside the resident ring can be answered procedurally.
+ */
+class TerrainStreamer : public HeightField {
+public:
+    struct Parameters {
+        Parameters()
+            : tileSize(256.0f), tileResolution(32), radius(4), cachedTiles(24), maxUploadsPerFrame(2),
+              hillsPerTile(1), hillRadiusMin(100.0f), hillRadiusMax(250.0f), hillMinHeight(-2.0f), hillMaxHeight(5.0f),
+              scalarY(50.0f), seed(1) {
+        }
+        /** world units per tile side and quads per tile side */
+        float tileSize;
+        int tileResolution;
+        /** tiles kept around the center in every direction */
+        int radius;
+        /** extra GPU slots for tiles that left the ring */
+        int cachedTiles;
+        int maxUploadsPerFrame;
+        /** hills are stamped in world units and must fit in one tile of reach */
+        int hillsPerTile;
+        float hillRadiusMin, hillRadiusMax, hillMinHeight, hillMaxHeight;
+        float scalarY;
+        unsigned int seed;
+        NoiseParameters noise;
+    };
+
+    TerrainStreamer(const Parameters& params, int threads = 0);
+    ~TerrainStreamer();
+
+    /** Requests missing tiles around center and uploads finished ones. GL thread only. */
+    void update(const glm::vec3& center);
+    /** Blocks until the whole ring around center is resident, for startup */
+    void preload(const glm::vec3& center);
+    /** Draws the resident ring; binds each tile's splat map to texture unit 3 */
+    void draw();
+
+    float getHeightAt(float worldX, float worldZ);
+    glm::vec3 getNormalAt(float worldX, float worldZ);
+    float getGroundTypeAt(float worldX, float worldZ);
+    /** The steepest slope of the tiles built so far, the ring around the snail among them */
+    float maxSlope();
+
+    int residentTiles() const { return (int)tileSlots.size(); }
+    int pendingTiles() const { return (int)pending.size(); }
+
+private:
+    struct TileKey {
+        int x, z;
+        bool operator==(const TileKey& other) const { return x == other.x && z == other.z; }
+    };
+    struct TileKeyHash {
+        std::size_t operator()(const TileKey& k) const {
+            return std::hash<long long>()(((long long)k.x << 32) ^ (unsigned int)k.z);
+        }
+    };
+    struct Hill { float x, z, rad, h; };
+
+    /** CPU side of a tile, produced by the workers */
+    struct TileData {
+        TileKey key;
+        /** (res + 3)^2 normalized heights including a one-sample apron */
+        std::vector<float> heights;
+        /** (res + 1)^2 blurred ground types */
+        std::vector<float> types;
+        /** interleaved position, normal, uv per sample */
+        std::vector<float> vertices;
+        std::vector<unsigned char> splat;
+        /** steepest rise per world unit along x and z between neighbouring samples */
+        glm::vec2 gradient;
+    };
+    struct GpuSlot {
+        GLuint VAO, VBO, splatTextureID;
+        std::shared_ptr<TileData> data;
+        unsigned long lastUsed;
+    };
+
+    Parameters params;
+    std::vector<GpuSlot> slots;
+    std::unordered_map<TileKey, int, TileKeyHash> tileSlots;
+    std::unordered_set<TileKey, TileKeyHash> pending;
+    GLuint indexBuffer;
+    int indexCount;
+    unsigned long frame;
+    TileKey centerTile;
+    /** the largest gradient of any tile built */
+    glm::vec2 maxGradient;
+
+    std::mutex readyMutex;
+    std::deque<std::shared_ptr<TileData>> ready;
+    std::unique_ptr<ThreadPool> pool;
+
+    TileKey tileOf(float worldX, float worldZ) const;
+    bool inRing(const TileKey& key) const;
+    void tileHills(const TileKey& key, std::vector<Hill>& hills) const;
+    /** adds the hills to a base height at global sample (gc, gr) */
+    float addHills(float base, int gc, int gr, const std::vector<Hill>& hills) const;
+    /** normalized height at global sample (gc, gr): noise plus the hills of tileHills() */
+    float sampleHeight(int gc, int gr, const std::vector<Hill>& hills) const;
+    /** normalized height at a global sample, from the resident tile if there is one */
+    float heightAtSample(int gc, int gr);
+    std::shared_ptr<TileData> buildTile(const TileKey& key) const;
+    int acquireSlot();
+    void upload(const std::shared_ptr<TileData>& data);
+    /** tile holding global sample (gc, gr) and the local sample index inside it */
+    const TileData* residentData(int gc, int gr, TileKey& key, int& lc, int& lr) const;
+};
+
+#endif
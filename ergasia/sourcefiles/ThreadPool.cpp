@@ -0,0 +1,54 @@
+#include "ThreadPool.h"
+#include "Parallel.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int threads) : active(0), stopping(false) {
+    if (threads <= 0) threads = workerCount();
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    available.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+void ThreadPool::submit(function<void()> job) {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    available.notify_one();
+}
+
+void ThreadPool::wait() {
+    unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return jobs.empty() && active == 0; });
+}
+
+void ThreadPool::workerLoop() {
+    for (;;) {
+        function<void()> job;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            active++;
+        }
+        job();
+        {
+            lock_guard<std::mutex> lock(mutex);
+            active--;
+            if (jobs.empty() && active == 0) idle.notify_all();
+        }
+    }
+}
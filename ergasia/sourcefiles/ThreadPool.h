@@ -0,0 +1,37 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+
+/**
+ * Fixed set of worker threads pulling jobs from a FIFO queue. Jobs that are
+ * still queued when the pool is destroyed are dropped.
+ */
+class ThreadPool {
+public:
+    /** threads <= 0 uses one thread per core */
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    void submit(std::function<void()> job);
+    /** Blocks until the queue is empty and every worker is idle */
+    void wait();
+    int size() const { return (int)workers.size(); }
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable available, idle;
+    int active;
+    bool stopping;
+};
+
+#endif
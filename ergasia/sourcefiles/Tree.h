@@ -14,8 +14,10 @@ public:
     GLuint texture;
     int vertexCount;
     std::vector<glm::mat4> instanceMatrices;
+    /** model-space bounds of the mesh, wind sway included */
+    glm::vec3 boundsMin, boundsMax;
 
-    Tree() : vao(0), texture(0), vertexCount(0) {}
+    Tree() : vao(0), texture(0), vertexCount(0), boundsMin(0.0f), boundsMax(0.0f), instanceBytes(0), culled(false) {}
 
     void init(const std::string& objPath, const std::string& texPath) {
         std::vector<glm::vec3> vertices;
@@ -24,6 +26,16 @@ public:
 
         loadOBJWithTiny(objPath.c_str(), vertices, uvs, normals);
         vertexCount = vertices.size();
+        if (!vertices.empty()) boundsMin = boundsMax = vertices[0];
+        for (const glm::vec3& v : vertices) {
+            boundsMin = glm::min(boundsMin, v);
+            boundsMax = glm::max(boundsMax, v);
+        }
+        // veget.vertexshader sways vertices above 400 by up to 15 in x and z
+        if (boundsMax.y > 400.0f) {
+            boundsMin -= glm::vec3(15.0f, 0.0f, 15.0f);
+            boundsMax += glm::vec3(15.0f, 0.0f, 15.0f);
+        }
         texture = loadSOIL(texPath.c_str());
 
         glGenVertexArrays(1, &vao);
@@ -63,19 +75,69 @@ public:
 
     void setupInstances(const std::vector<glm::mat4>& matrices) {
         instanceMatrices = matrices;
+        instanceBytes = instanceMatrices.size() * sizeof(glm::mat4);
         glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-        glBufferData(GL_ARRAY_BUFFER, instanceMatrices.size() * sizeof(glm::mat4), &instanceMatrices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, instanceBytes, instanceMatrices.empty() ? nullptr : &instanceMatrices[0], GL_STATIC_DRAW);
     }
 
-    void draw(GLuint shader) {
+    /**
+     * Uploads instanceMatrices after the caller rewrote them in place, for
+     * instances that move every frame. The buffer is only reallocated, for
+     * streaming, when the instances outgrow it.
+     */
+    void streamInstances() {
         if (instanceMatrices.empty()) return;
+        size_t bytes = instanceMatrices.size() * sizeof(glm::mat4);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (bytes > instanceBytes) {
+            glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+            instanceBytes = bytes;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &instanceMatrices[0]);
+        culled = false;
+    }
+
+    void updateInstance(int i, const glm::mat4& matrix) {
+        instanceMatrices[i] = matrix;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferSubData(GL_ARRAY_BUFFER, i * sizeof(glm::mat4), sizeof(glm::mat4), &instanceMatrices[i]);
+    }
+
+    /**
+     * Draws every instance, or only the indices in visible. A culled draw
+     * packs its instances at the front of the buffer, the next full draw
+     * puts them all back.
+     */
+    void draw(GLuint shader, const std::vector<int>* visible = nullptr) {
+        if (instanceMatrices.empty()) return;
+        size_t count = instanceMatrices.size();
+        if (visible) {
+            drawn.clear();
+            for (int i : *visible) drawn.push_back(instanceMatrices[i]);
+            count = drawn.size();
+            if (count == 0) return;
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), &drawn[0]);
+            culled = true;
+        }
+        else if (culled) {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), &instanceMatrices[0]);
+            culled = false;
+        }
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texture);
         glBindVertexArray(vao);
-        glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, instanceMatrices.size());
+        glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, count);
         glBindVertexArray(0);
     }
+
+private:
+    std::vector<glm::mat4> drawn;
+    /** size of instanceVBO's storage */
+    size_t instanceBytes;
+    bool culled;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/**
+ * Hands the latest value from one writer thread to one reader thread
+ * without locks or blocking. The writer fills writeSlot() and publishes it,
+ * the reader calls update() and reads read(); each side owns one of three
+ * slots and they only ever swap the third. Values the reader never got to
+ * are overwritten, so it always sees the newest complete one.
+ */
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : middle(1), back(2), front(0) {}
+
+    /** Writer: the slot to fill, it keeps whatever it held two publishes ago */
+    T& writeSlot() { return slots[back]; }
+    /** Writer: makes the filled slot the newest value */
+    void publish() { back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+    /** Reader: takes the newest value if one was published since the last call */
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    /** Reader: the value taken by the last update() */
+    const T& read() const { return slots[front]; }
+
+private:
+    static const int INDEX = 3, FRESH = 4;
+
+    T slots[3];
+    /** index of the shared slot, with FRESH set while the reader has not taken it */
+    std::atomic<int> middle;
+    int back, front;
+};
+
+#endif
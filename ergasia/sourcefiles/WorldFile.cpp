@@ -0,0 +1,80 @@
+#include "WorldFile.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+
+using namespace std;
+
+static const char WORLD_MAGIC[4] = { 'S', 'S', 'W', 'D' };
+static const uint32_t WORLD_VERSION = 2;
+
+static uint64_t alignUp(uint64_t x) {
+    return (x + 15) & ~(uint64_t)15;
+}
+
+void WorldFile::Writer::add(Section id, const void* data, size_t bytes) {
+    Entry e;
+    e.id = (uint32_t)id;
+    e.bytes.assign(static_cast<const char*>(data), static_cast<const char*>(data) + bytes);
+    entries.push_back(e);
+}
+
+void WorldFile::Writer::write(const string& path, Header header) const {
+    memcpy(header.magic, WORLD_MAGIC, 4);
+    header.version = WORLD_VERSION;
+    header.sectionCount = (uint32_t)entries.size();
+
+    vector<TableEntry> table(entries.size());
+    uint64_t offset = alignUp(sizeof(Header) + table.size() * sizeof(TableEntry));
+    for (size_t i = 0; i < entries.size(); i++) {
+        table[i].id = entries[i].id;
+        table[i].pad = 0;
+        table[i].offset = offset;
+        table[i].size = entries[i].bytes.size();
+        offset = alignUp(offset + table[i].size);
+    }
+
+    ofstream out(path.c_str(), ios::binary | ios::trunc);
+    if (!out) throw runtime_error("Could not open world file for writing: " + path);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    if (!table.empty()) out.write(reinterpret_cast<const char*>(&table[0]), table.size() * sizeof(TableEntry));
+
+    static const char zeros[16] = { 0 };
+    uint64_t written = sizeof(Header) + table.size() * sizeof(TableEntry);
+    for (size_t i = 0; i < entries.size(); i++) {
+        out.write(zeros, (streamsize)(table[i].offset - written));
+        if (!entries[i].bytes.empty()) out.write(&entries[i].bytes[0], entries[i].bytes.size());
+        written = table[i].offset + table[i].size;
+    }
+    if (!out) throw runtime_error("Failed writing world file: " + path);
+}
+
+bool WorldFile::exists(const string& path) {
+    return MappedFile::exists(path);
+}
+
+WorldFile::WorldFile(const string& path) : file(path), base(file.data()), length(file.size()) {
+    bool valid = length >= sizeof(Header) && memcmp(header().magic, WORLD_MAGIC, 4) == 0 && header().version == WORLD_VERSION &&
+                 length >= sizeof(Header) + (size_t)header().sectionCount * sizeof(TableEntry);
+    if (valid) {
+        const TableEntry* table = reinterpret_cast<const TableEntry*>(base + sizeof(Header));
+        for (uint32_t i = 0; i < header().sectionCount; i++) {
+            if (table[i].offset > length || table[i].size > length - table[i].offset) valid = false;
+        }
+    }
+    if (!valid) throw runtime_error("Not a valid world file: " + path);
+}
+
+const void* WorldFile::section(Section id, size_t& bytes) const {
+    const TableEntry* table = reinterpret_cast<const TableEntry*>(base + sizeof(Header));
+    for (uint32_t i = 0; i < header().sectionCount; i++) {
+        if (table[i].id == (uint32_t)id) {
+            bytes = (size_t)table[i].size;
+            return base + table[i].offset;
+        }
+    }
+    bytes = 0;
+    return nullptr;
+}
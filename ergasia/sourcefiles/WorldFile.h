@@ -0,0 +1,79 @@
+#ifndef WORLD_FILE_H
+#define WORLD_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "MappedFile.h"
+
+/**
+ * Binary snapshot of a generated world: a fixed header followed by a table
+ * of 16-byte aligned sections (terrain heights and material weights, instance
+ * matrices, spatial grids). Reading maps the file into memory and hands out
+ * pointers into the mapping, so loading costs little more than the copies
+ * into the runtime structures.
+ */
+class WorldFile {
+public:
+    enum Section {
+        HEIGHTS = 1,     // rows * cols float
+        MATERIAL_WEIGHTS, // rows * cols * 2 bytes, also the splat texels
+        OAK_TREES,       // mat4 arrays
+        PINE_TREES,
+        GRASS,
+        RED_FLOWERS,
+        BELL_FLOWERS,
+        MUSHROOMS,
+        MUSHROOMS2,
+        PIZZA,
+        TREE_GRID,       // int32 streams, see main.cpp
+        FLOWER_GRID
+    };
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t seed;
+        int32_t rows, cols;
+        float scalar, scalarY, cellSize;
+        uint32_t sectionCount;
+    };
+
+    /** Collects sections in memory and writes them out in one go */
+    class Writer {
+    public:
+        void add(Section id, const void* data, size_t bytes);
+        /** throws std::runtime_error when the file cannot be written */
+        void write(const std::string& path, Header header) const;
+    private:
+        struct Entry { uint32_t id; std::vector<char> bytes; };
+        std::vector<Entry> entries;
+    };
+
+    /** Maps path read-only, throws std::runtime_error on a missing or malformed file */
+    explicit WorldFile(const std::string& path);
+
+    const Header& header() const { return *reinterpret_cast<const Header*>(base); }
+    /** Pointer into the mapping and its size, nullptr when the section is absent */
+    const void* section(Section id, size_t& bytes) const;
+    /** Section as an array of T, count is 0 when it is absent */
+    template <class T>
+    const T* array(Section id, int& count) const {
+        size_t bytes = 0;
+        const void* p = section(id, bytes);
+        count = (int)(bytes / sizeof(T));
+        return static_cast<const T*>(p);
+    }
+
+    static bool exists(const std::string& path);
+
+private:
+    struct TableEntry { uint32_t id, pad; uint64_t offset, size; };
+
+    MappedFile file;
+    const char* base;
+    size_t length;
+};
+
+#endif
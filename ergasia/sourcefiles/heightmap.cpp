@@ -1,6 +1,9 @@
 #include "heightmap.h"
-#include <random>
+#include "Parallel.h"
+#include "MaterialLayer.h"
+#include "TerrainLighting.h"
 #include <algorithm>
+#include <cmath>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 
@@ -8,46 +11,65 @@ using namespace std;
 using namespace glm;
 
 Heightmap::Heightmap(const HillAlgorithmParameters& params)
-    : Heightmap(generate(params))
+    : Drawable(vector<vec3>()), HeightGrid(params)
 {
-    this->scalar = params.scalar;
-    this->scalarY = params.scalarY;
-    this->rows = params.rows;
-    this->cols = params.columns;
-    this->position = glm::vec3(0.0f, 0.0f, 0.0f);
+    createResources(params.buildMesh);
+}
 
-    // splat map
-    glGenTextures(1, &splatTextureID);
-    glBindTexture(GL_TEXTURE_2D, splatTextureID);
+Heightmap::Heightmap(int rows, int cols, float scalar, float scalarY, const float* heights, const unsigned char* materials,
+                     bool buildMesh)
+    : Drawable(vector<vec3>()), HeightGrid(rows, cols, scalar, scalarY, heights, materials)
+{
+    createResources(buildMesh);
+}
 
+Heightmap::Heightmap(const HeightStore* store, int rows, int cols, float scalar, float scalarY, bool buildMesh)
+    : Drawable(vector<vec3>()), HeightGrid(store, rows, cols, scalar, scalarY)
+{
+    createResources(buildMesh);
+}
 
-    std::vector<unsigned char> imageBuffer;
-    imageBuffer.reserve(rows * cols * 3); // Reserve for RGB 
+void Heightmap::createResources(bool buildMesh) {
+    this->splatTextureID = 0;
+    this->lightingTextureID = 0;
+    bakeLighting({ 0, 0, rows, cols });
+    uploadSplat();
+    uploadLighting();
+    if (buildMesh) createMesh();
+}
 
-    for (int r = 0; r < rows; r++) {
-        for (int c = 0; c < cols; c++) {
-            float val = this->typeGrid[r][c];
+void Heightmap::uploadSplat() {
+    // splat map, straight from the material weights: rock in red, bouncy in green
+    glGenTextures(1, &splatTextureID);
+    glBindTexture(GL_TEXTURE_2D, splatTextureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, cols, rows, 0, GL_RG, GL_UNSIGNED_BYTE, &materials[0]);
 
-            unsigned char red = 0;
-            unsigned char green = 0;
-            unsigned char blue = 0;
 
-            if (val > 0.5f) {       // Rock (1.0)
-                red = 255;
-            }
-            else if (val < -0.5f) { // Bouncy (-1.0)
-                green = 255;
-            }
-            // Else it stays black (Grass)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
 
-            imageBuffer.push_back(red);
-            imageBuffer.push_back(green);
-            imageBuffer.push_back(blue);
-        }
-    }
+void Heightmap::bakeLighting(const SampleRect& rect) {
+    lighting.resize((size_t)rows * cols * LIGHTING_CHANNELS);
+    bakeTerrainLighting(heightGrid, scalar / (float)(cols - 1), scalar / (float)(rows - 1), scalarY,
+                        rect.r0, rect.c0, rect.r1, rect.c1, &lighting[0]);
+    if (lightingTextureID == 0) return;
+    glBindTexture(GL_TEXTURE_2D, lightingTextureID);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, cols, rows, 0, GL_RGB, GL_UNSIGNED_BYTE, &imageBuffer[0]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, cols);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, rect.c0, rect.r0, rect.c1 - rect.c0, rect.r1 - rect.r0, GL_RGBA, GL_UNSIGNED_BYTE,
+                    &lighting[((size_t)rect.r0 * cols + rect.c0) * LIGHTING_CHANNELS]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
 
+void Heightmap::uploadLighting() {
+    glGenTextures(1, &lightingTextureID);
+    glBindTexture(GL_TEXTURE_2D, lightingTextureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cols, rows, 0, GL_RGBA, GL_UNSIGNED_BYTE, &lighting[0]);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -55,174 +77,118 @@ Heightmap::Heightmap(const HillAlgorithmParameters& params)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 }
 
-Heightmap::Heightmap(const MeshData& data)
-    : Drawable(data.v, data.uv, data.n)
-{
-    rows = 0; cols = 0; scalar = 0; scalarY = 0;
-    this->heightGrid = data.grid;
-    this->typeGrid = data.typeGrid; // Copy the type grid
-    this->splatTextureID = 0;
-}
-
 Heightmap::~Heightmap() {
     if (splatTextureID != 0) glDeleteTextures(1, &splatTextureID);
+    if (lightingTextureID != 0) glDeleteTextures(1, &lightingTextureID);
 }
 
-Heightmap::MeshData Heightmap::generate(const HillAlgorithmParameters& params)
-{
-    MeshData data;
-    // Initialize grids
-    std::vector<std::vector<float>> grid(params.rows, std::vector<float>(params.columns, 0.0f));
-    std::vector<std::vector<float>> typeGrid(params.rows, std::vector<float>(params.columns, 0.0f));
-
-    std::random_device rd;
-    std::mt19937 generator(rd());
-    std::uniform_int_distribution<int> rDist(params.hillRadiusMin, params.hillRadiusMax);
-    std::uniform_real_distribution<float> hDist(params.hillMinHeight, params.hillMaxHeight);
-    std::uniform_int_distribution<int> rowDist(0, params.rows - 1);
-    std::uniform_int_distribution<int> colDist(0, params.columns - 1);
-    //gen Hills
-    for (int i = 0; i < params.numHills; i++) {
-        int cR = rowDist(generator);
-        int cC = colDist(generator);
-        int rad = rDist(generator);
-        float hillH = hDist(generator);
-
-        for (int r = cR - rad; r < cR + rad; r++) {
-            for (int c = cC - rad; c < cC + rad; c++) {
-                if (r < 0 || r >= params.rows || c < 0 || c >= params.columns) continue;
-                float r2 = float(rad * rad);
-                float dx = float(cC - c);
-                float dy = float(cR - r);
-                float hVal = (r2 - dx * dx - dy * dy) / 5;
-                if (hVal > 0.0f) {
-                    grid[r][c] += hillH * (hVal / r2);
-                    if (grid[r][c] > 1.0f) grid[r][c] = 1.0f;
-                }
-            }
-        }
-    }
-
-    for (int r = 0; r < params.rows; r++) {
-        for (int c = 0; c < params.columns; c++) {
-            float height = grid[r][c];
-
-            //bouncy <0
-            // Rock (Value <0.07)
-			// grass psila >=0.07
+vec3 Heightmap::meshNormal(int r, int c) const {
+    // central differences like getNormalAt, then divided by the model scale
+    // so that M * normal points along the world-space normal
+    float hL = heightGrid[r][std::max(c - 1, 0)]; float hR = heightGrid[r][std::min(c + 1, cols - 1)];
+    float hD = heightGrid[std::max(r - 1, 0)][c]; float hU = heightGrid[std::min(r + 1, rows - 1)][c];
+    float stepX = scalar / (float)(cols - 1), stepZ = scalar / (float)(rows - 1);
+    vec3 tangentX(2.0f * stepX, (hR - hL) * scalarY, 0.0f);
+    vec3 tangentZ(0.0f, (hU - hD) * scalarY, 2.0f * stepZ);
+    vec3 n = normalize(cross(tangentZ, tangentX));
+    return vec3(n.x / scalar, n.y / scalarY, n.z / scalar);
+}
 
-            if (height < 0.0f) {
-                typeGrid[r][c] = -1.0f; // NEW: Bouncy Area
+void Heightmap::createMesh() {
+    // one vertex per sample in row-major order, so an edited rectangle is one
+    // contiguous range per row of the vertex and normal buffers
+    indexedVertices.resize(rows * cols);
+    indexedNormals.resize(rows * cols);
+    indexedUVS.resize(rows * cols);
+    indices.resize((rows - 1) * (cols - 1) * 6);
+    parallelFor(0, rows, [&](int r0, int r1) {
+        for (int r = r0; r < r1; r++) {
+            for (int c = 0; c < cols; c++) {
+                int k = r * cols + c;
+                indexedVertices[k] = vec3(-0.5f + (float)c / (cols - 1), heightGrid[r][c], -0.5f + (float)r / (rows - 1));
+                indexedUVS[k] = vec2((float)c / (cols - 1), (float)r / (rows - 1));
+                indexedNormals[k] = meshNormal(r, c);
             }
-            else if (height < 0.07f) {
-                typeGrid[r][c] = 1.0f;  // Rock Area
+            if (r == rows - 1) continue;
+            unsigned int* quad = &indices[r * (cols - 1) * 6];
+            for (int c = 0; c < cols - 1; c++, quad += 6) {
+                unsigned int a = r * cols + c, b = a + cols;
+                quad[0] = a; quad[1] = b; quad[2] = a + 1;
+                quad[3] = b; quad[4] = b + 1; quad[5] = a + 1;
             }
-            else {
-                typeGrid[r][c] = 0.0f;  // Grass Area
-            }
-        }
-    }
-
-    auto tempGrid = typeGrid;
-    for (int r = 1; r < params.rows - 1; r++) {
-        for (int c = 1; c < params.columns - 1; c++) {
-            float sum = 0.0f;
-            for (int ir = -1; ir <= 1; ir++)
-                for (int ic = -1; ic <= 1; ic++)
-                    sum += tempGrid[r + ir][c + ic];
-            typeGrid[r][c] = sum / 9.0f;
-        }
-    }
-
-    data.grid = grid;
-    data.typeGrid = typeGrid;
-
-    int numQuads = (params.rows - 1) * (params.columns - 1);
-    data.v.reserve(numQuads * 6);
-    data.uv.reserve(numQuads * 6);
-    data.n.reserve(numQuads * 6);
-
-    for (int i = 0; i < params.rows - 1; i++) {
-        for (int j = 0; j < params.columns - 1; j++) {
-            auto addVert = [&](int r, int c) {
-                float h = grid[r][c];
-                data.v.push_back(vec3(-0.5f + (float)c / (params.columns - 1), h, -0.5f + (float)r / (params.rows - 1)));
-                data.uv.push_back(vec2((float)c / (params.columns - 1), (float)r / (params.rows - 1)));
-                data.n.push_back(vec3(0, 1, 0));
-                };
-            addVert(i, j); addVert(i + 1, j); addVert(i, j + 1);
-            addVert(i + 1, j); addVert(i + 1, j + 1); addVert(i, j + 1);
         }
-    }
-    return data;
+    }, 16);
+
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    glGenBuffers(1, &verticesVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
+    glBufferData(GL_ARRAY_BUFFER, indexedVertices.size() * sizeof(vec3), &indexedVertices[0], GL_DYNAMIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(0);
+
+    glGenBuffers(1, &normalsVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
+    glBufferData(GL_ARRAY_BUFFER, indexedNormals.size() * sizeof(vec3), &indexedNormals[0], GL_DYNAMIC_DRAW);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(1);
+
+    glGenBuffers(1, &uvsVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
+    glBufferData(GL_ARRAY_BUFFER, indexedUVS.size() * sizeof(vec2), &indexedUVS[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(2);
+
+    glGenBuffers(1, &elementVBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBindVertexArray(0);
 }
 
 mat4 Heightmap::returnplaneMatrix() {
     return scale(mat4(), vec3(scalar, scalarY, scalar));
 }
 
-float Heightmap::getHeightAt(float worldX, float worldZ) {
-    float localX = (worldX - position.x) / scalar;
-    float localZ = (worldZ - position.z) / scalar;
-    float u = localX + 0.5f;
-    float v = localZ + 0.5f;
-    if (u < 0.0f || u >= 1.0f || v < 0.0f || v >= 1.0f) return -99999.0f;
-
-    float r_f = v * (rows - 1);
-    float c_f = u * (cols - 1);
-    int r = (int)r_f;
-    int c = (int)c_f;
-    if (r < 0) r = 0; if (r >= rows - 1) r = rows - 2;
-    if (c < 0) c = 0; if (c >= cols - 1) c = cols - 2;
-
-    // Digrammikh parembolh
-    float h00 = heightGrid[r][c];     float h10 = heightGrid[r + 1][c];
-    float h01 = heightGrid[r][c + 1]; float h11 = heightGrid[r + 1][c + 1];
-    float percentU = c_f - c; float percentV = r_f - r;
-    float hTop = h00 * (1.0f - percentU) + h01 * percentU;
-    float hBot = h10 * (1.0f - percentU) + h11 * percentU;
-    return (hTop * (1.0f - percentV) + hBot * percentV) * scalarY + position.y;
+Heightmap::SampleRect Heightmap::deform(const vec3& center, float radius, const function<float(float)>& profile) {
+    SampleRect dirty = HeightGrid::deform(center, radius, profile);
+    uploadRegion(dirty);
+    return dirty;
 }
 
-float Heightmap::getGroundTypeAt(float worldX, float worldZ) {
-    float localX = (worldX - position.x) / scalar;
-    float localZ = (worldZ - position.z) / scalar;
-    float u = localX + 0.5f;
-    float v = localZ + 0.5f;
-
-    if (u < 0.0f || u >= 1.0f || v < 0.0f || v >= 1.0f) return 0.0f; 
-
-    float r_f = v * (rows - 1);
-    float c_f = u * (cols - 1);
-    int r = (int)r_f;
-    int c = (int)c_f;
-    if (r < 0) r = 0; if (r >= rows - 1) r = rows - 2;
-    if (c < 0) c = 0; if (c >= cols - 1) c = cols - 2;
+void Heightmap::uploadRegion(const SampleRect& dirty) {
+    if (dirty.empty()) return;
 
-    // Digrammikh parembolh
-    float t00 = typeGrid[r][c];     float t10 = typeGrid[r + 1][c];
-    float t01 = typeGrid[r][c + 1]; float t11 = typeGrid[r + 1][c + 1];
-
-    float percentU = c_f - c;
-    float percentV = r_f - r;
-
-    float tTop = t00 * (1.0f - percentU) + t01 * percentU;
-    float tBot = t10 * (1.0f - percentU) + t11 * percentU;
+    if (splatTextureID != 0) {
+        glBindTexture(GL_TEXTURE_2D, splatTextureID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, cols);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, dirty.c0, dirty.r0, dirty.c1 - dirty.c0, dirty.r1 - dirty.r0, GL_RG, GL_UNSIGNED_BYTE,
+                        &materials[((size_t)dirty.r0 * cols + dirty.c0) * MATERIAL_CHANNELS]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
 
-    return tTop * (1.0f - percentV) + tBot * percentV;
+    // occlusion sees heights up to HORIZON_RADIUS samples away
+    SampleRect shaded;
+    shaded.r0 = std::max(dirty.r0 - HORIZON_RADIUS, 0); shaded.r1 = std::min(dirty.r1 + HORIZON_RADIUS, rows);
+    shaded.c0 = std::max(dirty.c0 - HORIZON_RADIUS, 0); shaded.c1 = std::min(dirty.c1 + HORIZON_RADIUS, cols);
+    bakeLighting(shaded);
+
+    if (VAO != 0) {
+        int width = dirty.c1 - dirty.c0;
+        for (int r = dirty.r0; r < dirty.r1; r++) {
+            for (int c = dirty.c0; c < dirty.c1; c++) {
+                indexedVertices[r * cols + c].y = heightGrid[r][c];
+                indexedNormals[r * cols + c] = meshNormal(r, c);
+            }
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
+        for (int r = dirty.r0; r < dirty.r1; r++) {
+            glBufferSubData(GL_ARRAY_BUFFER, (r * cols + dirty.c0) * sizeof(vec3), width * sizeof(vec3), &indexedVertices[r * cols + dirty.c0]);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
+        for (int r = dirty.r0; r < dirty.r1; r++) {
+            glBufferSubData(GL_ARRAY_BUFFER, (r * cols + dirty.c0) * sizeof(vec3), width * sizeof(vec3), &indexedNormals[r * cols + dirty.c0]);
+        }
+    }
 }
-
-vec3 Heightmap::getNormalAt(float worldX, float worldZ) {
-    float localX = (worldX - position.x) / scalar;
-    float localZ = (worldZ - position.z) / scalar;
-    int r = (int)((localZ + 0.5f) * (rows - 1));
-    int c = (int)((localX + 0.5f) * (cols - 1));
-    if (r < 1) r = 1; if (r >= rows - 1) r = rows - 2;
-    if (c < 1) c = 1; if (c >= cols - 1) c = cols - 2;
-    float hL = heightGrid[r][c - 1]; float hR = heightGrid[r][c + 1];
-    float hD = heightGrid[r - 1][c]; float hU = heightGrid[r + 1][c];
-    float unitStep = scalar / (float)(cols - 1);
-    vec3 tangentX(2.0f * unitStep, (hR - hL) * scalarY, 0.0f);
-    vec3 tangentZ(0.0f, (hU - hD) * scalarY, 2.0f * unitStep);
-    return normalize(cross(tangentZ, tangentX));
-}
\ No newline at end of file
@@ -1,47 +1,45 @@
 #pragma once
 #include <vector>
+#include <functional>
 #include <glm/glm.hpp>
 #include "common/model.h" 
+#include "HeightGrid.h"
 
-class Heightmap : public Drawable {
+// The single-map terrain with its mesh, splat and lighting textures; the
+// data and every query live in HeightGrid.
+class Heightmap : public Drawable, public HeightGrid {
 public:
-    struct HillAlgorithmParameters {
-        HillAlgorithmParameters(int rows, int columns, int numHills, int rMin, int rMax, float hMin, float hMax, float s, float sY)
-            : rows(rows), columns(columns), numHills(numHills), hillRadiusMin(rMin), hillRadiusMax(rMax), hillMinHeight(hMin), hillMaxHeight(hMax), scalar(s), scalarY(sY){
-        }
-        int rows, columns, numHills, hillRadiusMin, hillRadiusMax;
-        float hillMinHeight, hillMaxHeight,scalar, scalarY;
-    };
-    float scalar, scalarY;
-    glm::vec3 position; 
-
-    std::vector<std::vector<float>> heightGrid;
-    std::vector<std::vector<float>> typeGrid;
-
     GLuint splatTextureID;
 
-    int rows, cols;
+    // baked normal (rgb) and horizon occlusion (alpha) per sample, see
+    // TerrainLighting.h; kept in sync with heightGrid by deform()
+    std::vector<unsigned char> lighting;
+    GLuint lightingTextureID;
 
     // Public Constructor
     Heightmap(const HillAlgorithmParameters& params);
+    // rebuild from stored row-major heights and material weights (world files)
+    Heightmap(int rows, int cols, float scalar, float scalarY, const float* heights, const unsigned char* materials,
+              bool buildMesh = true);
+    // DEM terrain: heightGrid and materials are a rows x cols resampling of the store, which must outlive this
+    Heightmap(const HeightStore* store, int rows, int cols, float scalar, float scalarY, bool buildMesh = true);
     ~Heightmap();
 
     glm::mat4 returnplaneMatrix();
-    float getHeightAt(float worldX, float worldZ);
-    glm::vec3 getNormalAt(float worldX, float worldZ);
-    float getGroundTypeAt(float worldX, float worldZ);
-private:
-    // PRIVATE struct to hold data temporarily
-    struct MeshData {
-        std::vector<glm::vec3> v;
-        std::vector<glm::vec2> uv;
-        std::vector<glm::vec3> n;
 
-        std::vector<std::vector<float>> grid;
-        std::vector<std::vector<float>> typeGrid;
-    };
-
-    Heightmap(const MeshData& data);
-
-    static MeshData generate(const HillAlgorithmParameters& params);
+    // HeightGrid::deform, then the splat and lighting texels and mesh rows
+    // of the touched samples
+    SampleRect deform(const glm::vec3& center, float radius, const std::function<float(float)>& profile);
+    // the texture and mesh half of deform, for samples HeightGrid::deform
+    // already changed; GL, so only on the render thread
+    void uploadRegion(const SampleRect& dirty);
+private:
+    // textures and, with buildMesh, the mesh of the grid as constructed
+    void createResources(bool buildMesh);
+    void createMesh();
+    glm::vec3 meshNormal(int r, int c) const;
+    void uploadSplat();
+    // bakes the lighting texels of rect and refreshes them on the GPU once uploaded
+    void bakeLighting(const SampleRect& rect);
+    void uploadLighting();
 };
\ No newline at end of file
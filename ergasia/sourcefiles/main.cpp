@@ -17,6 +17,9 @@
 #include <common/light.h>
 #include "Snail.h"
 #include "heightmap.h"
+#include "TerrainStreamer.h"
+#include "HeightfieldRenderer.h"
+#include "TerrainClipmap.h"
 #include "Flower.h"
 #include "Collision.h"
 #include <common/model.h>
@@ -25,6 +28,20 @@
 #include "Eagle.h"
 #include "Menu.h"
 #include "Tree.h"
+#include "WorldFile.h"
+#include "HeightStore.h"
+#include "DemImporter.h"
+#include "RigidBodyWorld.h"
+#include "Random.h"
+#include "Simulation.h"
+#include "TripleBuffer.h"
+#include "InputRecording.h"
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -50,6 +67,7 @@ void uploadLight(const Light& light);
 void uploadSnailMaterial(const Material& mtl);
 void uploadSnailLight(const Light& light);
 void uploadTreeLight(const Light& light);
+void refitWorldInstances(const vector<int>& trees, const vector<int>& grass, const vector<FlowerHandle>& flowers);
 
 #define W_WIDTH 1920
 #define W_HEIGHT 1080
@@ -102,8 +120,18 @@ GLint modelLoc, colorLoc,useTextureMenuLoc;
 Tree oakTree;
 Tree pineTree;
 std::vector<glm::mat4> allTreeMatrices;
-//grass
+//grass, the simulation re-seats its copy of the tufts on dents and the grid finds them
 Tree grassSystem;
+std::vector<glm::mat4> allGrassMatrices;
+TreeGrid grassGrid;
+//every tree, grass tuft and flower, for culling and the eagle's line of sight
+InstanceBvh worldInstances;
+// each flower kind's mesh bounds, for its instances' boxes
+InstanceBvh::Box flowerBounds[FLOWER_KINDS];
+//loose shells rolling around the map, --shells N
+RigidBodyWorld* debris = nullptr;
+int shellCount = 0;
+Tree shellSystem;
 
 //LOULOUDIAAAAAA (me powerups)
 Flower* redFlower,* purpulFlower, * pizza, *mushroom, *mushroom2;
@@ -118,6 +146,21 @@ GameState currentState;
 Menu* mainMenu;
 int desiredTreeCount = 700;   
 int desiredFlowerCount = 100;
+// world seed, override with --seed N for reproducible runs
+unsigned int worldSeed = 1;
+// --world file: load the world from file, or generate it and write it there
+string worldPath;
+// --dem file [--dem-size W H]: terrain from elevation data, imported once into file.tiles
+string demPath;
+int demWidth = 0, demHeight = 0;
+HeightStore* heightStore = nullptr;
+// --record file: write each physics step's controls there; --replay file:
+// rebuild the recorded world and drive the snail from the recording until it
+// runs out, reporting where the state stops matching it
+string recordPath, replayPath;
+InputRecording* replay = nullptr;
+// what the terrain of this run is built from, recordings carry it
+InputRecording::TerrainSource terrainSource = InputRecording::GENERATED_TERRAIN;
 struct Material {
     vec4 Ka; 
     vec4 Kd;
@@ -131,17 +174,6 @@ struct Material {
 Eagle* eagle;
 GLuint eagleIconTex;
 
-//collision detection
-unordered_map<GridKey, vector<int>, GridKeyHash> treeGrid;
-float cellSize = 10.0f;
-
-struct FlowerHandle {
-    Flower* type; 
-    int index;   
-};
-
-unordered_map<GridKey, vector<FlowerHandle>, GridKeyHash> flowerGrid;
-
 Light* light = new Light(window,
     vec4{ 1, 1, 1, 1 },
     vec4{ 1, 1, 1, 1 },
@@ -150,6 +182,16 @@ Light* light = new Light(window,
 );
 
 Heightmap* terrain;
+// streamed tiles instead of the fixed map, enabled with --infinite
+TerrainStreamer* streamer = nullptr;
+bool infiniteTerrain = false;
+// what the snail stands on: terrain or streamer
+HeightField* ground;
+// draw terrain by displacing a shared patch from a height texture, enabled with --gpu-terrain
+HeightfieldRenderer* heightfieldRenderer = nullptr;
+bool gpuTerrain = false;
+// pre-blended terrain albedo around the camera, fixed map only
+TerrainClipmap* clipmap = nullptr;
 Snail* snail;
 Drawable* quad;
 
@@ -157,6 +199,72 @@ Drawable* quad;
 // Standard acceleration due to gravity
 const float g = 9.80665f;
 
+// fixed physics step, set with --physics-hz, and the most steps one frame may
+// run to catch up before the backlog is dropped
+float physicsStep = 1.0f / 120.0f;
+int maxPhysicsSteps = 8;
+// --integrator euler|verlet|rk4|rk45, how the snail is stepped
+IntegratorType snailIntegrator = RUNGE_KUTTA_4;
+
+// The simulation runs on its own thread at the physics rate. It reads the
+// controls from `inputs` and hands each step's result to the render thread
+// through `snapshots`; neither side waits for the other.
+struct SimulationSnapshot {
+    // wall clock time the step was due
+    double time;
+    SnailSnapshot snail;
+    EagleSnapshot eagle;
+    RigidBodyWorld::Snapshot debris;
+};
+// the input of one render frame; a key pressed in a frame the steps skip
+// stays down in later frames until a step has taken one that had it
+struct FrameInput {
+    InputState input;
+    unsigned int frame;
+};
+TripleBuffer<FrameInput> inputs;
+// the frame of the input the last step took
+atomic<unsigned int> consumedFrame(0);
+TripleBuffer<SimulationSnapshot> snapshots;
+// held by a simulation step, and by the render thread while it changes what
+// a step reads (terrain edits, streamed tiles)
+mutex worldMutex;
+// GL work the simulation asks for, run by the render thread under worldMutex
+mutex renderCommandMutex;
+vector<function<void()>> renderCommands;
+
+void postToRenderThread(const function<void()>& command) {
+    lock_guard<mutex> lock(renderCommandMutex);
+    renderCommands.push_back(command);
+}
+
+void runRenderCommands() {
+    vector<function<void()>> commands;
+    {
+        lock_guard<mutex> lock(renderCommandMutex);
+        commands.swap(renderCommands);
+    }
+    for (auto& command : commands) command();
+}
+
+double wallSeconds() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// GLFW may only be asked from the main thread
+unsigned int pollInput() {
+    static const struct { int key; InputKey bit; } bindings[] = {
+        { GLFW_KEY_W, KEY_FORWARD }, { GLFW_KEY_S, KEY_BACK }, { GLFW_KEY_A, KEY_LEFT }, { GLFW_KEY_D, KEY_RIGHT },
+        { GLFW_KEY_LEFT_SHIFT, KEY_SPRINT }, { GLFW_KEY_LEFT_CONTROL, KEY_RETRACT },
+        { GLFW_KEY_SPACE, KEY_FLY }, { GLFW_KEY_E, KEY_EAT }
+    };
+    unsigned int keys = 0;
+    for (const auto& binding : bindings) {
+        if (glfwGetKey(window, binding.key) == GLFW_PRESS) keys |= binding.bit;
+    }
+    return keys;
+}
+
 //load skybox faces
 
 unsigned int loadCubemap(std::vector<std::string> faces) {
@@ -273,56 +381,268 @@ void initUI() {
     quad = new Drawable(quadVertices, quadUVs);
 }
 
-void buildCollisionGrid(const std::vector<mat4>& instanceMatrices) {
-    treeGrid.clear();
-    for (int i = 0; i < instanceMatrices.size(); i++) {
-        vec3 pos = vec3(instanceMatrices[i][3]);
+// Dents or raises the terrain and re-seats the trees, grass and flowers of the
+// spatial grid cells the edit overlaps, with their culling boxes. Only the heights and matrices a
+// simulation step reads change here, so the simulation thread calls it
+// inside its step; the textures, meshes and instance buffers follow on the
+// render thread.
+void deformTerrain(const vec3& center, float radius, const function<float(float)>& profile) {
+    if (!terrain) return;
+    Heightmap::SampleRect dirty = terrain->HeightGrid::deform(center, radius, profile);
+    if (dirty.empty()) return;
+
+    // one extra cell for the normals that changed around the edge
+    vector<int> trees, grass;
+    vector<FlowerHandle> flowers;
+    int x0 = gridCell(center.x - radius) - 1, x1 = gridCell(center.x + radius) + 1;
+    int z0 = gridCell(center.z - radius) - 1, z1 = gridCell(center.z + radius) + 1;
+    for (int x = x0; x <= x1; x++) {
+        for (int i : treeGrid.column(x, z0, z1)) {
+            mat4& m = allTreeMatrices[i];
+            m[3].y = terrain->getHeightAt(m[3].x, m[3].z);
+            trees.push_back(i);
+        }
+        for (int i : grassGrid.column(x, z0, z1)) {
+            mat4& m = allGrassMatrices[i];
+            m[3].y = terrain->getHeightAt(m[3].x, m[3].z);
+            grass.push_back(i);
+        }
+        for (const FlowerHandle& handle : flowerGrid.column(x, z0, z1)) {
+            mat4& m = handle.type->instanceMatrices[handle.index];
+            m[3].y = terrain->getHeightAt(m[3].x, m[3].z);
+            flowers.push_back(handle);
+        }
+    }
+    // culling runs on the render thread under worldMutex, like this step
+    refitWorldInstances(trees, grass, flowers);
+
+    postToRenderThread([center, radius, dirty, trees, grass, flowers] {
+        terrain->uploadRegion(dirty);
+        if (heightfieldRenderer) heightfieldRenderer->updateRegion(dirty.r0, dirty.c0, dirty.r1, dirty.c1);
+        if (clipmap) {
+            // the splat map is filtered, so one more sample of reach
+            float reach = radius + 2.0f * terrain->scalar / (terrain->cols - 1);
+            clipmap->invalidate(vec2(center.x - reach, center.z - reach), vec2(center.x + reach, center.z + reach));
+        }
+        int oakCount = (int)oakTree.instanceMatrices.size();
+        for (int i : trees) {
+            if (i < oakCount) oakTree.updateInstance(i, allTreeMatrices[i]);
+            else pineTree.updateInstance(i - oakCount, allTreeMatrices[i]);
+        }
+        for (int i : grass) grassSystem.updateInstance(i, allGrassMatrices[i]);
+        for (const FlowerHandle& handle : flowers) {
+            handle.type->updateInstance(handle.index, handle.type->instanceMatrices[handle.index]);
+        }
+    });
+}
+
+// flower kinds in the order the world file indexes them
+vector<Flower*> flowerKinds() {
+    return { redFlower, purpulFlower, mushroom, mushroom2, pizza };
+}
+
+// the mesh and collision cylinder of tree i, where it stands now
+InstanceBvh::Box treeInstanceBox(int i) {
+    const Tree& mesh = i < (int)oakTree.instanceMatrices.size() ? oakTree : pineTree;
+    InstanceBvh::Box local = { mesh.boundsMin, mesh.boundsMax };
+    return InstanceBvh::merge(InstanceBvh::transform(local, allTreeMatrices[i]), treeCollisionBox(allTreeMatrices[i]));
+}
+
+// the mesh of grass tuft i, where it stands now
+InstanceBvh::Box grassInstanceBox(int i) {
+    InstanceBvh::Box local = { grassSystem.boundsMin, grassSystem.boundsMax };
+    return InstanceBvh::transform(local, allGrassMatrices[i]);
+}
 
-        int gridX = static_cast<int>(floor(pos.x / cellSize));
-        int gridZ = static_cast<int>(floor(pos.z / cellSize));
+void buildWorldInstances() {
+    worldInstances.clear();
+    for (size_t i = 0; i < allTreeMatrices.size(); i++) {
+        worldInstances.add(TREE_INSTANCES, (int)i, treeInstanceBox((int)i));
+    }
+    for (size_t i = 0; i < allGrassMatrices.size(); i++) {
+        worldInstances.add(GRASS_INSTANCES, (int)i, grassInstanceBox((int)i));
+    }
+    vector<Flower*> kinds = flowerKinds();
+    for (int k = 0; k < FLOWER_KINDS; k++) {
+        const vector<vec3>& vertices = kinds[k]->vertices;
+        InstanceBvh::Box& local = flowerBounds[k];
+        local.min = local.max = vertices.empty() ? vec3(0.0f) : vertices[0];
+        for (const vec3& v : vertices) {
+            local.min = glm::min(local.min, v);
+            local.max = glm::max(local.max, v);
+        }
+        for (size_t i = 0; i < kinds[k]->instanceMatrices.size(); i++) {
+            worldInstances.add(FLOWER_INSTANCES + k, (int)i, InstanceBvh::transform(local, kinds[k]->instanceMatrices[i]));
+        }
+    }
+    worldInstances.build();
+}
 
-        treeGrid[{gridX, gridZ}].push_back(i);
+// follows the trees, grass and flowers a dent re-seated
+void refitWorldInstances(const vector<int>& trees, const vector<int>& grass, const vector<FlowerHandle>& flowers) {
+    for (int i : trees) worldInstances.refit(TREE_INSTANCES, i, treeInstanceBox(i));
+    for (int i : grass) worldInstances.refit(GRASS_INSTANCES, i, grassInstanceBox(i));
+    vector<Flower*> kinds = flowerKinds();
+    for (const FlowerHandle& handle : flowers) {
+        int k = (int)(find(kinds.begin(), kinds.end(), handle.type) - kinds.begin());
+        worldInstances.refit(FLOWER_INSTANCES + k, handle.index,
+                             InstanceBvh::transform(flowerBounds[k], handle.type->instanceMatrices[handle.index]));
     }
 }
 
-void buildFlowerGrid() {
-    flowerGrid.clear();
+// Spatial grids are stored as int32 streams: cell count, then per cell
+// x, z, entry count and the entries (tree index, or flower kind and index).
+template <class T, class Pack>
+vector<int32_t> packGrid(const CellGrid<T>& grid, Pack pack) {
+    vector<int32_t> out(1, 0);
+    grid.forEachCell([&](int x, int z, typename CellGrid<T>::Range items) {
+        out[0]++;
+        out.push_back(x);
+        out.push_back(z);
+        out.push_back((int32_t)(items.end() - items.begin()));
+        for (const T& item : items) pack(item, out);
+    });
+    return out;
+}
 
-    // List of all your flower types
-    vector<Flower*> allFlowers = { redFlower, purpulFlower, mushroom, mushroom2, pizza };
+vector<int32_t> packTreeGrid() {
+    return packGrid(treeGrid, [](int index, vector<int32_t>& out) { out.push_back(index); });
+}
 
-    for (Flower* flower : allFlowers) {
-        for (int i = 0; i < flower->instanceMatrices.size(); i++) {
-            vec3 pos = vec3(flower->instanceMatrices[i][3]);
+vector<int32_t> packFlowerGrid() {
+    vector<Flower*> kinds = flowerKinds();
+    return packGrid(flowerGrid, [&kinds](const FlowerHandle& handle, vector<int32_t>& out) {
+        out.push_back((int32_t)(find(kinds.begin(), kinds.end(), handle.type) - kinds.begin()));
+        out.push_back(handle.index);
+    });
+}
 
-            int gridX = static_cast<int>(floor(pos.x / cellSize));
-            int gridZ = static_cast<int>(floor(pos.z / cellSize));
+// Both loaders reject a grid that is truncated or names an instance the
+// world does not have; the caller then rebuilds it from the instances.
+bool loadTreeGrid(const WorldFile* world) {
+    int n;
+    const int32_t* p = world->array<int32_t>(WorldFile::TREE_GRID, n);
+    if (!p || n < 1 || world->header().cellSize != cellSize) return false;
+    vector<int> cellX, cellZ, indices;
+    const int32_t* end = p + n;
+    int cells = *p++;
+    for (int c = 0; c < cells; c++) {
+        if (p + 3 > end) return false;
+        int x = p[0], z = p[1], count = p[2];
+        p += 3;
+        if (count < 0 || count > end - p) return false;
+        for (int i = 0; i < count; i++, p++) {
+            if (*p < 0 || *p >= (int)allTreeMatrices.size()) return false;
+            cellX.push_back(x);
+            cellZ.push_back(z);
+            indices.push_back(*p);
+        }
+    }
+    treeGrid.build(cellX, cellZ, indices);
+    return true;
+}
 
-            // Store the pointer and the index
-            flowerGrid[{gridX, gridZ}].push_back({ flower, i });
+bool loadFlowerGrid(const WorldFile* world) {
+    int n;
+    const int32_t* p = world->array<int32_t>(WorldFile::FLOWER_GRID, n);
+    if (!p || n < 1 || world->header().cellSize != cellSize) return false;
+    vector<Flower*> kinds = flowerKinds();
+    vector<int> cellX, cellZ;
+    vector<FlowerHandle> handles;
+    const int32_t* end = p + n;
+    int cells = *p++;
+    for (int c = 0; c < cells; c++) {
+        if (p + 3 > end) return false;
+        int x = p[0], z = p[1], count = p[2];
+        p += 3;
+        if (count < 0 || count > (end - p) / 2) return false;
+        for (int i = 0; i < count; i++, p += 2) {
+            if (p[0] < 0 || p[0] >= (int)kinds.size()) return false;
+            if (p[1] < 0 || p[1] >= (int)kinds[p[0]]->instanceMatrices.size()) return false;
+            cellX.push_back(x);
+            cellZ.push_back(z);
+            handles.push_back({ kinds[p[0]], p[1] });
         }
     }
+    flowerGrid.build(cellX, cellZ, handles);
+    return true;
+}
+
+vector<mat4> storedMatrices(const WorldFile* world, WorldFile::Section id) {
+    int n;
+    const mat4* m = world->array<mat4>(id, n);
+    return m ? vector<mat4>(m, m + n) : vector<mat4>();
+}
+
+Flower* createFlower(const WorldFile* world, WorldFile::Section id, const char* objPath, const char* mtlPath,
+                     int count, float scale, bool mtl, int mapSize) {
+    if (world) {
+        int n;
+        const mat4* m = world->array<mat4>(id, n);
+        return new Flower(objPath, mtlPath, m, n, mtl);
+    }
+    return new Flower(objPath, mtlPath, ground, count, scale, mtl, mapSize);
+}
+
+void saveWorld(const string& path) {
+    vector<float> heights;
+    heights.reserve(terrain->rows * terrain->cols);
+    for (int r = 0; r < terrain->rows; r++) {
+        heights.insert(heights.end(), terrain->heightGrid[r].begin(), terrain->heightGrid[r].end());
+    }
+    vector<int32_t> trees = packTreeGrid();
+    vector<int32_t> flowers = packFlowerGrid();
+
+    WorldFile::Writer writer;
+    writer.add(WorldFile::HEIGHTS, &heights[0], heights.size() * sizeof(float));
+    writer.add(WorldFile::MATERIAL_WEIGHTS, &terrain->materials[0], terrain->materials.size());
+    auto addMatrices = [&](WorldFile::Section id, const vector<mat4>& m) {
+        writer.add(id, m.empty() ? nullptr : &m[0], m.size() * sizeof(mat4));
+    };
+    addMatrices(WorldFile::OAK_TREES, oakTree.instanceMatrices);
+    addMatrices(WorldFile::PINE_TREES, pineTree.instanceMatrices);
+    addMatrices(WorldFile::GRASS, grassSystem.instanceMatrices);
+    addMatrices(WorldFile::RED_FLOWERS, redFlower->instanceMatrices);
+    addMatrices(WorldFile::BELL_FLOWERS, purpulFlower->instanceMatrices);
+    addMatrices(WorldFile::MUSHROOMS, mushroom->instanceMatrices);
+    addMatrices(WorldFile::MUSHROOMS2, mushroom2->instanceMatrices);
+    addMatrices(WorldFile::PIZZA, pizza->instanceMatrices);
+    writer.add(WorldFile::TREE_GRID, &trees[0], trees.size() * sizeof(int32_t));
+    writer.add(WorldFile::FLOWER_GRID, &flowers[0], flowers.size() * sizeof(int32_t));
+
+    WorldFile::Header header;
+    header.seed = worldSeed;
+    header.rows = terrain->rows;
+    header.cols = terrain->cols;
+    header.scalar = terrain->scalar;
+    header.scalarY = terrain->scalarY;
+    header.cellSize = cellSize;
+    writer.write(path, header);
+    cout << "World written to " << path << endl;
 }
 
+// grass draws from its own stream, so the rand() sequence the flowers are
+// placed from is the one WorldLayout sees, which has no grass
 vector<mat4> generateGrassPositions(int amount) {
     vector<mat4> matrices;
     int attempts = 0;
+    CounterRng rng(worldSeed, 0x62a55U);
 
     while (matrices.size() < amount && attempts < amount * 2) {
         attempts++;
 
         // Random Position
-        float x = (rand() % (MAP_SIZE * 2) - MAP_SIZE);
-        float z = (rand() % (MAP_SIZE * 2) - MAP_SIZE);
-        float y = terrain->getHeightAt(x, z);
+        float x = (float)rng.uniformInt(-MAP_SIZE, MAP_SIZE - 1);
+        float z = (float)rng.uniformInt(-MAP_SIZE, MAP_SIZE - 1);
+        float y = ground->getHeightAt(x, z);
 
         
-        float type = terrain->getGroundTypeAt(x, z);
+        float type = ground->getGroundTypeAt(x, z);
         if (abs(type) > 0.2f ) continue; // spawn only on grass
 
         mat4 model = translate(mat4(1.0f), vec3(x, y, z));
 
-        vec3 normal = normalize(terrain->getNormalAt(x, z));
+        vec3 normal = normalize(ground->getNormalAt(x, z));
         vec3 up = vec3(0.0f, 1.0f, 0.0f);
 
         if (abs(dot(up, normal)) < 0.999f) { 
@@ -330,7 +650,7 @@ vector<mat4> generateGrassPositions(int amount) {
             float angle = acos(dot(up, normal));
             model = rotate(model, angle, axis);
         }
-        model = rotate(model, radians((float)(rand() % 360)), vec3(0, 1, 0));
+        model = rotate(model, radians((float)rng.uniformInt(0, 359)), vec3(0, 1, 0));
 
         float scaleVal = 30.0f;
         model = scale(model, vec3(scaleVal, scaleVal/2, scaleVal));
@@ -340,41 +660,29 @@ vector<mat4> generateGrassPositions(int amount) {
     return matrices;
 }
 
-vector<mat4> generateTreePositions(int amount,float scalar) {
-	vector<mat4> instanceMatrices;
-    for (int i = 0; i < amount; i++) {
-        float x = (rand() % (MAP_SIZE * 2) - MAP_SIZE); // Random X
-        float z = (rand() % (MAP_SIZE * 2) - MAP_SIZE); // Random Z
-        float y = terrain->getHeightAt(x, z);    // Get Y from heightmap
-        mat4 model = translate(mat4(1.0f), vec3(x, y, z));
-        model = rotate(model, radians((float)(rand() % 360)), vec3(0, 1, 0)); // Random rotation
-        model = scale(model, vec3(scalar, scalar, scalar));
-        instanceMatrices.push_back(model);
-    }
-	return instanceMatrices;
-}
-
-void initTree() {
+void initTree(const WorldFile* world) {
     allTreeMatrices.clear(); 
 
     oakTree.init("models/tree.obj", "models/tree2.bmp");
-    vector<mat4> oakPos = generateTreePositions(desiredTreeCount/2,4.0f);
+    vector<mat4> oakPos = world ? storedMatrices(world, WorldFile::OAK_TREES) : placeTrees(ground, desiredTreeCount/2, 4.0f, MAP_SIZE);
     oakTree.setupInstances(oakPos);
 
     allTreeMatrices.insert(allTreeMatrices.end(), oakPos.begin(), oakPos.end());
 
 
     pineTree.init("models/tree2.obj", "models/tree2.bmp");
-    vector<mat4> pinePos = generateTreePositions(desiredTreeCount/2,0.1f);
+    vector<mat4> pinePos = world ? storedMatrices(world, WorldFile::PINE_TREES) : placeTrees(ground, desiredTreeCount/2, 0.1f, MAP_SIZE);
     pineTree.setupInstances(pinePos);
 
     // Create tree grid
     allTreeMatrices.insert(allTreeMatrices.end(), pinePos.begin(), pinePos.end());
     grassSystem.init("models/grass2.obj","textures/grass3.bmp");
-    vector<mat4> grassPos = generateGrassPositions(500);
+    vector<mat4> grassPos = world ? storedMatrices(world, WorldFile::GRASS) : generateGrassPositions(500);
     grassSystem.setupInstances(grassPos);
+    allGrassMatrices = grassPos;
+    buildTreeGrid(allGrassMatrices, grassGrid);
 
-    buildCollisionGrid(allTreeMatrices);
+    if (!world || !loadTreeGrid(world)) buildTreeGrid(allTreeMatrices);
 }
 
 void createContext() {
@@ -545,11 +853,81 @@ void updateProgressBar(float percent) {
 void createContext2() {
     // 0% - Start
     updateProgressBar(0.0f);
+    auto startTime = chrono::high_resolution_clock::now();
+
+    if (!replayPath.empty()) {
+        delete replay;
+        replay = new InputRecording(replayPath);
+        const InputRecording::Header& h = replay->header();
+        worldSeed = h.seed;
+        physicsStep = h.physicsStep;
+        desiredTreeCount = h.treeCount;
+        desiredFlowerCount = h.flowerCount;
+        shellCount = h.shellCount;
+        snailIntegrator = (IntegratorType)h.integrator;
+    }
+
+    WorldFile* world = nullptr;
+    if (!worldPath.empty() && !infiniteTerrain && WorldFile::exists(worldPath)) {
+        try {
+            world = new WorldFile(worldPath);
+            worldSeed = world->header().seed;
+        }
+        catch (runtime_error& ex) {
+            cout << ex.what() << ", generating a new world" << endl;
+        }
+    }
+
+    terrainSource = infiniteTerrain ? InputRecording::STREAMED_TERRAIN
+                  : world ? InputRecording::WORLD_FILE_TERRAIN
+                  : !demPath.empty() ? InputRecording::DEM_TERRAIN : InputRecording::GENERATED_TERRAIN;
+    if (replay) replay->check(terrainSource);
 
     // Terrain 
 	//rows, columns, numHills, minRadius, maxRadius, minHeight, maxHeight, scalar, scalarY
-    Heightmap::HillAlgorithmParameters params(400, 400, 100, 10, 40, -2.0f, 5.0f, MAP_SIZE * 2, 50);
-    terrain = new Heightmap(params);
+    if (infiniteTerrain) {
+        TerrainStreamer::Parameters streamParams;
+        streamParams.seed = worldSeed;
+        streamer = new TerrainStreamer(streamParams);
+        streamer->preload(vec3(0.0f));
+        ground = streamer;
+    }
+    else if (world) {
+        const WorldFile::Header& h = world->header();
+        int heightCount, materialCount;
+        const float* heights = world->array<float>(WorldFile::HEIGHTS, heightCount);
+        const unsigned char* materials = world->array<unsigned char>(WorldFile::MATERIAL_WEIGHTS, materialCount);
+        if (heightCount != h.rows * h.cols || materialCount != h.rows * h.cols * 2) {
+            throw runtime_error("World file terrain does not match its header: " + worldPath);
+        }
+        terrain = new Heightmap(h.rows, h.cols, h.scalar, h.scalarY, heights, materials, !gpuTerrain);
+        ground = terrain;
+        if (gpuTerrain) heightfieldRenderer = new HeightfieldRenderer(terrain);
+    }
+    else if (!demPath.empty()) {
+        string storePath = demPath + ".tiles";
+        if (!MappedFile::exists(storePath)) {
+            DemImportOptions options;
+            options.width = demWidth;
+            options.height = demHeight;
+            importDem(demPath, storePath, options);
+        }
+        heightStore = new HeightStore(storePath);
+        // the mesh stays at the generated resolution, collision samples the store
+        terrain = new Heightmap(heightStore, 400, 400, MAP_SIZE * 2, 50, !gpuTerrain);
+        ground = terrain;
+        if (gpuTerrain) heightfieldRenderer = new HeightfieldRenderer(terrain);
+    }
+    else {
+        Heightmap::HillAlgorithmParameters params(400, 400, 100, 10, 40, -2.0f, 5.0f, MAP_SIZE * 2, 50, worldSeed);
+        params.buildMesh = !gpuTerrain;
+        terrain = new Heightmap(params);
+        ground = terrain;
+        if (gpuTerrain) heightfieldRenderer = new HeightfieldRenderer(terrain);
+    }
+    if (terrain) clipmap = new TerrainClipmap(terrain, terrainGrassTexture, terrainRockTexture, terrainRubberTexture);
+    // placement of trees, grass and flowers follows the same seed
+    srand(worldSeed);
 
     // 20% - Terrain Done
     updateProgressBar(20.0f);
@@ -557,9 +935,23 @@ void createContext2() {
     // Snail Initialization 
     float spawnX = 0.0f;
     float spawnZ = 0.0f;
-    float spawnY = terrain->getHeightAt(spawnX, spawnZ);
+    float spawnY = ground->getHeightAt(spawnX, spawnZ);
     vec3 initPos = vec3(spawnX, spawnY + 1.0f, spawnZ);
     snail = new Snail(initPos, 1.0f, 1.2f);
+    snail->integrator = snailIntegrator;
+
+    if (shellCount > 0) {
+        debris = new RigidBodyWorld(ground);
+        CounterRng rng(worldSeed, 0x5e115U);
+        for (int i = 0; i < shellCount; i++) {
+            float x = spawnX + rng.uniform(-60.0f, 60.0f), z = spawnZ + rng.uniform(-60.0f, 60.0f);
+            float radius = rng.uniform(0.3f, 0.8f);
+            int body = debris->addBody(vec3(x, ground->getHeightAt(x, z) + rng.uniform(2.0f, 20.0f), z),
+                                       radius * radius * radius, radius);
+            debris->setVelocity(body, vec3(rng.uniform(-3.0f, 3.0f), 0.0f, rng.uniform(-3.0f, 3.0f)));
+        }
+        shellSystem.init("models/Mesh_Snail_Retracted.obj", "models/Tex_Snail.bmp");
+    }
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -572,26 +964,40 @@ void createContext2() {
     // 60% - Skybox Done
     updateProgressBar(60.0f);
 
-    initTree();
+    initTree(world);
 
     // 80% - Geometry Done
     updateProgressBar(80.0f);
 
-    redFlower = new Flower("models/flowers/redFlower.obj", "models/flowers/redFlower.mtl", terrain, desiredFlowerCount, 5.0f, true, MAP_SIZE);
+    redFlower = createFlower(world, WorldFile::RED_FLOWERS, "models/flowers/redFlower.obj", "models/flowers/redFlower.mtl", desiredFlowerCount, 5.0f, true, MAP_SIZE);
  
     updateProgressBar(85.0f);
 
-    purpulFlower = new Flower("models/flowers/bellFlower.obj", "models/flowers/bellFlower.mtl", terrain, desiredFlowerCount, 4.0f, true, MAP_SIZE);
-    mushroom = new Flower("models/flowers/mushroom.obj", "models/flowers/mushroom.mtl", terrain, desiredFlowerCount / 2, 0.3f, true, MAP_SIZE);
+    purpulFlower = createFlower(world, WorldFile::BELL_FLOWERS, "models/flowers/bellFlower.obj", "models/flowers/bellFlower.mtl", desiredFlowerCount, 4.0f, true, MAP_SIZE);
+    mushroom = createFlower(world, WorldFile::MUSHROOMS, "models/flowers/mushroom.obj", "models/flowers/mushroom.mtl", desiredFlowerCount / 2, 0.3f, true, MAP_SIZE);
    
     updateProgressBar(90.0f);
 
-    mushroom2 = new Flower("models/flowers/mushroom.obj", "models/flowers/mushroom2.mtl", terrain, desiredFlowerCount/2, 0.3f, true, MAP_SIZE);
-    pizza = new Flower("models/flowers/pizza.obj", "models/flowers/pizza.bmp", terrain, 1, 1.0f, false, 40);
+    mushroom2 = createFlower(world, WorldFile::MUSHROOMS2, "models/flowers/mushroom.obj", "models/flowers/mushroom2.mtl", desiredFlowerCount/2, 0.3f, true, MAP_SIZE);
+    pizza = createFlower(world, WorldFile::PIZZA, "models/flowers/pizza.obj", "models/flowers/pizza.bmp", 1, 1.0f, false, 40);
 
-    buildFlowerGrid();
+    if (!world || !loadFlowerGrid(world)) {
+        vector<Flower*> kinds = flowerKinds();
+        buildFlowerGrid(vector<FlowerField*>(kinds.begin(), kinds.end()));
+    }
+    buildWorldInstances();
+
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - startTime);
+    if (world) {
+        cout << "World loaded from " << worldPath << " in " << elapsed.count() << " ms" << endl;
+        delete world;
+    }
+    else if (!worldPath.empty() && terrain) {
+        saveWorld(worldPath);
+    }
 
     eagle = new Eagle(vec3(0, 300, 0));
+    eagle->cover = [](const vec3& a, const vec3& b) { return treesBlock(worldInstances, allTreeMatrices, a, b); };
     // 100% - Finished!
     updateProgressBar(100.0f);
 }
@@ -601,7 +1007,8 @@ void drawTerrain(GLuint program, GLuint modelLocation, GLuint diffuseSampler) {
 
     uploadLight(*light); 
 
-    mat4 modelMatrix = terrain->returnplaneMatrix();
+    // streamed tiles are already in world space
+    mat4 modelMatrix = streamer ? mat4(1.0f) : terrain->returnplaneMatrix();
     glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &modelMatrix[0][0]);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, terrainGrassTexture);
@@ -612,8 +1019,6 @@ void drawTerrain(GLuint program, GLuint modelLocation, GLuint diffuseSampler) {
     glUniform1i(glGetUniformLocation(program, "detailSampler"), 1);
     glUniform1i(useTextureLocation, 1); 
 
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, terrain->splatTextureID);
     glUniform1i(glGetUniformLocation(program, "splatMapSampler"), 3);
 
     glActiveTexture(GL_TEXTURE4);
@@ -621,6 +1026,21 @@ void drawTerrain(GLuint program, GLuint modelLocation, GLuint diffuseSampler) {
     glUniform1i(glGetUniformLocation(program, "bouncySampler"), 4);
 
     glUniform1i(useTextureLocation, 1);
+    if (streamer) {
+        streamer->draw();
+        return;
+    }
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, terrain->splatTextureID);
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D, terrain->lightingTextureID);
+    glUniform1i(glGetUniformLocation(program, "terrainLightingSampler"), 6);
+    glUniform1i(glGetUniformLocation(program, "terrainLightingMode"), 1);
+    if (clipmap) clipmap->bind(program, 7);
+    if (heightfieldRenderer) {
+        heightfieldRenderer->draw(program);
+        return;
+    }
     terrain->bind();
     terrain->draw();
 
@@ -736,6 +1156,7 @@ void depth_pass() {
     oakTree.draw(shadowLoader);
     pineTree.draw(shadowLoader);
     grassSystem.draw(shadowLoader);
+    shellSystem.draw(shadowLoader);
     drawFlowers(shadowLoader, true);
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -758,6 +1179,8 @@ void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix, float retractFactor,f
     drawTerrain(terrainProgram, modelMatrixLocation, diffuseColorSampler);
 
     //draw eagle
+    glUniform1i(glGetUniformLocation(terrainProgram, "terrainLightingMode"), 0);
+    glUniform1i(glGetUniformLocation(terrainProgram, "clipmapMode"), 0);
     glUniform1i(useTextureLocation, 1);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, eagleIconTex);
@@ -767,7 +1190,7 @@ void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix, float retractFactor,f
     glUseProgram(snailShaderProgram);
     glUniformMatrix4fv(snailViewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
     glUniformMatrix4fv(snailProjectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);    
-    float snailSpeed = length(snail->v);
+    float snailSpeed = length(snail->shown.v);
     drawSnail(snailShaderProgram, snailModelMatrixLocation, (float)glfwGetTime(), snailSpeed, retractFactor);
 
     glUseProgram(vegetShader);
@@ -779,10 +1202,26 @@ void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix, float retractFactor,f
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, depthTexture);
     glUniform1i(treeDepthMapSampler, 2);
-    oakTree.draw(vegetShader);
-    pineTree.draw(vegetShader);
+    // only the trees and grass whose boxes reach into the view
+    vector<InstanceBvh::Item> visible;
+    {
+        // dents refit the boxes inside simulation steps
+        lock_guard<mutex> lock(worldMutex);
+        worldInstances.frustum(projectionMatrix * viewMatrix, visible);
+    }
+    vector<int> oaks, pines, grass;
+    int oakCount = (int)oakTree.instanceMatrices.size();
+    for (const InstanceBvh::Item& item : visible) {
+        if (item.kind == GRASS_INSTANCES) grass.push_back(item.index);
+        else if (item.kind != TREE_INSTANCES) continue;
+        else if (item.index < oakCount) oaks.push_back(item.index);
+        else pines.push_back(item.index - oakCount);
+    }
+    oakTree.draw(vegetShader, &oaks);
+    pineTree.draw(vegetShader, &pines);
 
-    grassSystem.draw(vegetShader);
+    grassSystem.draw(vegetShader, &grass);
+    shellSystem.draw(vegetShader);
 
 
     glUseProgram(flowerShading);
@@ -826,61 +1265,18 @@ void drawSpeedBar(float speed, float maxSpeed) {
 }
 
 void free() {
+    delete debris;
+    delete clipmap;
+    delete heightfieldRenderer;
     delete terrain;
+    delete heightStore;
+    delete streamer;
     glDeleteProgram(terrainProgram);
     glDeleteProgram(snailShaderProgram); // Cleanup new shader
     glDeleteProgram(shadowLoader);
     glfwTerminate();
 }
 
-void tryEatFlowers() {
-    int snailGridX = static_cast<int>(floor(snail->x.x / cellSize));
-    int snailGridZ = static_cast<int>(floor(snail->x.z / cellSize));
-
-    // Check 3x3 area
-    for (int x = -1; x <= 1; x++) {
-        for (int z = -1; z <= 1; z++) {
-            GridKey key = { snailGridX + x, snailGridZ + z };
-
-            if (flowerGrid.count(key)) {
-                for (const auto& handle : flowerGrid[key]) {
-                    // Pass 'false' for isRetracted to trigger Eating Logic
-                    bool ate = handle.type->checkCollisionByIndex(handle.index, snail, false);
-
-                    if (ate) {
-                        if (handle.type == redFlower) { snail->maxSpeed += 10.0f; snail->moveSpeed += 2.0f; }
-                        else if (handle.type == purpulFlower) { snail->staminaMax += 100.0f; snail->staminaDepletionRate -= 10.0f; }
-                        else if (handle.type == mushroom) {
-                            if (snail->s <5.0f) { snail->s *= 2; snail->radius *= 2; snail->m *= 2; }
-                        }
-                        else if (handle.type == mushroom2) { snail->s /= 2; snail->radius /= 2; snail->m /= 2; }
-                        else if (handle.type == pizza) { snail->abilityUnlocked = true; }
-                        return; 
-                    }
-                }
-            }
-        }
-    }
-}
-
-void applyFlowerPhysics() {
-    int snailGridX = static_cast<int>(floor(snail->x.x / cellSize));
-    int snailGridZ = static_cast<int>(floor(snail->x.z / cellSize));
-
-    for (int x = -1; x <= 1; x++) {
-        for (int z = -1; z <= 1; z++) {
-            GridKey key = { snailGridX + x, snailGridZ + z };
-
-            if (flowerGrid.count(key)) {
-                for (const auto& handle : flowerGrid[key]) {
-                    // Pass 'true' for isRetracted to trigger Physics Logic
-                    handle.type->checkCollisionByIndex(handle.index, snail, true);
-                }
-            }
-        }
-    }
-}
-
 void menuLoop() {
     double x, y;
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
@@ -956,250 +1352,166 @@ void mainLoop() {
 
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetCursorPos(window, W_WIDTH / 2, W_HEIGHT / 2);
-    float t = glfwGetTime();
-    float camDist = 35.0f;
-    float camHeight = 20.0f;
-    bool isGrounded = false;
-    bool onTree = false;
-    bool isMoving = false;
-    bool isControlKeyHeld = false;
+    // what the simulation steers by, taken from the render thread once per step
+    InputState input = { 0, camera->horizontalAngle };
 
     camera->position = vec3(0.0f, 20.0f, 0.0f);
-    do {
-        float currentTime = glfwGetTime();
-        float dt = currentTime - t;
-        if (dt > 0.1f) dt = 0.1f;
-
-        glViewport(0, 0, W_WIDTH, W_HEIGHT);
-        camera->update(snail);
-		light->update(snail->x);
-        eagle->update(dt, snail);
-        bool controlPressed = (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS);
-
-        if (controlPressed && !isControlKeyHeld){
-            
-            if (snail->retractTarget == 0.0f) {
-                snail->retractTarget = 1.0f;
-                snail->isSprinting = false;
-            }
-            else if (snail->x.y < terrain->getHeightAt(snail->x.x,snail->x.z) + 4 * snail->radius ){
-                snail->retractTarget = 0.0f;
-            }
-
-
-        }
-        isControlKeyHeld = controlPressed;
-        if (snail->retractCurrent < snail->retractTarget) {
-            snail->retractCurrent += snail->retractSpeed * dt;
-        }
-        else if (snail->retractCurrent > snail->retractTarget) {
-            snail->retractCurrent -= snail->retractSpeed * dt;
-        }
-        snail->retractCurrent = clamp(snail->retractCurrent, 0.0f, 1.0f);
 
-        if (snail->retractTarget == 0.0f) {
-            snail->isRetracted = false;
-        }
-        else if (snail->retractCurrent > 0.0f) {
-            snail->isRetracted = true;
-		}
-
-        if (snail->retractCurrent > 0.0f)applyFlowerPhysics();
-        onTree = handleSnailTreeCollision(snail, allTreeMatrices);
-        isGrounded = handleSnailTerrainCollision(snail, terrain, onTree);
-        if (isGrounded) {
-            vec3 n = normalize(terrain->getNormalAt(snail->x.x, snail->x.z));
-
-            float impactSpeed = dot(snail->v, n);
-            float groundType = terrain->getGroundTypeAt(snail->x.x, snail->x.z);
+    Simulation simulation(ground, terrain, snail, eagle);
+    simulation.debris = debris;
+    simulation.trees = &allTreeMatrices;
+    vector<Flower*> kinds = flowerKinds();
+    for (int k = 0; k < FLOWER_KINDS; k++) simulation.flowers[k] = kinds[k];
+    simulation.gravity = g;
+    simulation.time = 0.0f;
+    // a dent changes the terrain within its step, so replays see it at the
+    // same step; deformTerrain leaves the GL side to the render thread, as
+    // eaten flowers do
+    simulation.onDent = [](const vec3& center, float reach, float depth) {
+        deformTerrain(center, reach, [depth](float t) { return -depth * (1.0f - t * t); });
+    };
+    simulation.onEaten = [kinds](int kind, int index) {
+        Flower* type = kinds[kind];
+        postToRenderThread([type, index] { type->showEaten(index); });
+    };
 
-            float bounciness = 0.0f; 
+    // the state the first frame draws
+    SimulationSnapshot& first = snapshots.writeSlot();
+    first.time = wallSeconds();
+    first.snail = snail->snapshot();
+    first.eagle = eagle->snapshot();
+    if (debris) debris->snapshot(first.debris);
+    snapshots.publish();
+
+    InputRecording::Writer* recorder = nullptr;
+    if (!recordPath.empty()) {
+        if (infiniteTerrain) cout << "Streamed tiles load asynchronously, a replay of this session may diverge" << endl;
+        InputRecording::Header h;
+        h.seed = worldSeed;
+        h.physicsStep = physicsStep;
+        h.treeCount = desiredTreeCount;
+        h.flowerCount = desiredFlowerCount;
+        h.shellCount = shellCount;
+        h.integrator = snailIntegrator;
+        // once a second at the default rate
+        h.hashInterval = 120;
+        h.terrainSource = terrainSource;
+        h.producer = InputRecording::GAME_PRODUCER;
+        recorder = new InputRecording::Writer(recordPath, h);
+    }
 
-            if (groundType < -0.5f) {
-                bounciness = 1.2f; 
+    // physics at a fixed rate on its own thread; each step's state goes to
+    // the render thread through the snapshot buffer
+    atomic<bool> simulating(true);
+    thread simulationThread([&] {
+        bool replaying = replay != nullptr, diverged = false;
+        double next = wallSeconds() + physicsStep;
+        while (simulating) {
+            double now = wallSeconds();
+            if (now < next) {
+                this_thread::sleep_for(chrono::duration<double>(next - now));
+                continue;
             }
-
-            if (impactSpeed < 0.0f)
-                snail->v -= impactSpeed * n * (1.0f + bounciness);
-
-            snail->P = snail->m * snail->v;
-
-        }
-        vec3 snailForward = snail->q * vec3(0, 0, -1); //-Z is forward
-        vec3 snailRight = snail->q * vec3(1, 0, 0);
-
-        snail->forcing = [&](float t, const vector<float>& y) -> vector<float>
-            {
-                vector<float> f(6, 0.0f);
-                if (!snail->isRetracted) {
-                    float stopDamping = 7.0f; // Very strong braking
-
-                    // Linear Braking
-                    f[0] = -snail->v.x * stopDamping * snail->m;
-                    f[1] = -snail->v.y * stopDamping * snail->m;
-                    f[2] = -snail->v.z * stopDamping * snail->m;
-
-                    // Angular Braking (Stop spinning)
-                    f[3] = -snail->w.x * stopDamping;
-                    f[4] = -snail->w.y * stopDamping;
-                    f[5] = -snail->w.z * stopDamping;
-
-                    return f;
+            for (int steps = 0; next <= now && steps < maxPhysicsSteps; steps++) {
+                bool hashed = false;
+                uint64_t recordedHash = 0;
+                if (replaying && !replay->next(input, hashed, recordedHash)) {
+                    cout << "Replay finished after " << replay->position() << " steps" << endl;
+                    replaying = false;
+                }
+                if (!replaying && inputs.update()) {
+                    input = inputs.read().input;
+                    consumedFrame.store(inputs.read().frame, memory_order_release);
                 }
-
-                
-                vec3 gravity(0.0f, -snail->m * g, 0.0f);
-                vec3 totalForce(0.0f);
-                if (!(eagle->state == GRABBING))
-                    totalForce = gravity;
-                vec3 totalTorque(0.0f);
-
-                if (isGrounded)
                 {
-                    const float inputForce = 800.0f; 
-                    const float BIAS = 1e-4f;
-
-                    float groundType = abs(terrain->getGroundTypeAt(snail->x.x, snail->x.z)) + 0.2f;
-
-                    float muK = 2.0f * groundType;
-                    float muS = 5.0f * groundType;
-
-                    vec3 n = normalize(terrain->getNormalAt(snail->x.x, snail->x.z));
-                    vec3 up(0, 1, 0);
-
-                    // ---- Cancel normal gravity
-                    vec3 gN = dot(gravity, n) * n;
-                    vec3 gT = gravity - gN;
-                    totalForce -= gN;
-
-                    vec3 camForwardFlat = normalize(vec3(sin(camera->horizontalAngle), 0, cos(camera->horizontalAngle)));
-
-                    // 2. Project camera forward onto the slope
-                    vec3 slopeForward = camForwardFlat - dot(camForwardFlat, n) * n;
-                    if (length(slopeForward) < BIAS) {
-                        // Fallback if looking straight down/up a cliff
-                        slopeForward = vec3(0, 0, -1) - dot(vec3(0, 0, -1), n) * n;
-                    }
-                    slopeForward = normalize(slopeForward);
-
-                    vec3 slopeRight = normalize(cross(slopeForward, n));
-
-                    vec3 vT = snail->v - dot(snail->v, n) * n;
-
-                    float N = snail->m * g * clamp(dot(n, up), 0.0f, 1.0f);
-
-                    vec3 drive(0.0f);
-                    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) drive -= slopeForward; 
-                    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) drive += slopeForward; 
-                    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) drive -= slopeRight;   
-                    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) drive += slopeRight;  
-                    
-                    if (length(drive) > BIAS)
-                        drive = normalize(drive) * inputForce;
-                    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS && snail->abilityUnlocked) totalForce += 50.0f * -gravity;
-                    vec3 friction(0.0f);
-                    if (length(vT) < 0.05f && length(drive + gT) < muS * N)
-                    {
-                        // STATIC friction  cancel the desire to move
-                        friction = -(0.5f * drive + gT);
+                    lock_guard<mutex> lock(worldMutex);
+                    simulation.step(physicsStep, input);
+                    if (hashed && !diverged && simulation.stateHash() != recordedHash) {
+                        cout << "Replay diverged by step " << replay->position() - 1 << endl;
+                        diverged = true;
                     }
-                    else if (length(vT) > BIAS)
-                    {
-                        // KINETIC friction  slide
-                        friction = -normalize(vT) * muK * N;
-                    }
-
-                    vec3 tangentForce = gT + drive + friction;
-
-                    float maxT = muK * N;
-                    if (length(tangentForce) > maxT && length(vT) > 0.1f)
-                        tangentForce = normalize(tangentForce) * maxT;
-
-                    totalForce += tangentForce;
-                    float speed = length(vT);
-
-                    if (speed > 0.01f) {
-                        vec3 rollAxis = normalize(cross(n, vT));
-                        float radius = snail->radius;
-                        vec3 idealOmega = rollAxis * (speed / radius);
-                        vec3 torque = (idealOmega - snail->w) * 10.0f;
-                        totalTorque += torque;
-                        
-                    }
-
-                    float groundRollingResistance = mix(5.5f, 2.5f, groundType);
-                    totalTorque -= snail->w * groundRollingResistance;
-                    
+                    if (recorder) recorder->record(input, recorder->hashDue() ? simulation.stateHash() : 0);
                 }
-
-                
-                f[0] = totalForce.x;
-                f[1] = totalForce.y;
-                f[2] = totalForce.z;
-
-                f[3] = totalTorque.x;
-                f[4] = totalTorque.y;
-                f[5] = totalTorque.z;
-                return f;
-            };
-
-
-        
-        if (isGrounded && snail->retractCurrent == 0.0f) {
-            snail->isSprinting = false;
-            snail->isMoving = false;
-            float turnSpeed = radians(100.0f) * dt; 
-            float moveSpeed;
-            if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS && snail->stamina > 0){
-                moveSpeed = snail->maxSpeed;
-                snail->isSprinting = true;
-            }
-            else  moveSpeed = snail->moveSpeed;
-            vec3 n;
-            if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-                snail->v -= snailForward * moveSpeed;
-                snail->isMoving = true;
-            }
-            else if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-                snail->v += snailForward * moveSpeed / 10.0f;
-                snail->isMoving = true;
-            }
-            if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-                quat turn = angleAxis(-turnSpeed, vec3(0, 1, 0));
-                snail->q = normalize(snail->q * turn);
+                SimulationSnapshot& snapshot = snapshots.writeSlot();
+                snapshot.time = next;
+                snapshot.snail = snail->snapshot();
+                snapshot.eagle = eagle->snapshot();
+                if (debris) debris->snapshot(snapshot.debris);
+                snapshots.publish();
+                next += physicsStep;
             }
-            if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-                quat turn = angleAxis(turnSpeed, vec3(0, 1, 0));
-                snail->q = normalize(snail->q * turn);
-            }
-            
-            snail->P = snail->v * snail->m;
+            // a long stall only replays maxPhysicsSteps of it
+            if (next <= now) next = now + physicsStep;
+        }
+    });
 
-            //eating events
-            if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) {
-                tryEatFlowers();
-            }
+    // keys down last frame, presses not yet taken by a step and the frame of the newest
+    unsigned int frame = 0, heldKeys = 0, latchedKeys = 0, latchedFrame = 0;
+    do {
+        float currentTime = glfwGetTime();
+
+        // draw between the two states of the newest step, one step behind
+        // the simulation so there is always a state to move towards
+        snapshots.update();
+        const SimulationSnapshot& shown = snapshots.read();
+        float alpha = clamp((float)((wallSeconds() - shown.time) / physicsStep), 0.0f, 1.0f);
+        snail->interpolate(shown.snail, alpha);
+        eagle->interpolate(shown.eagle, alpha);
+        if (debris) {
+            // the retracted snail mesh has a radius of 1.73 at scale 1
+            RigidBodyWorld::instanceMatrices(shown.debris, alpha, 1.0f / 1.73f, shellSystem.instanceMatrices);
+            shellSystem.streamInstances();
+        }
 
+        {
+            // what the simulation reads only changes between its steps
+            lock_guard<mutex> lock(worldMutex);
+            runRenderCommands();
+            if (streamer) streamer->update(snail->renderPosition);
+            // the spring arm raycasts terrain a step may be denting
+            camera->update(snail, terrain);
         }
-        handleBoxSnailCollision(terrain, snail);
 
-        snail->update(t, dt);
+        glViewport(0, 0, W_WIDTH, W_HEIGHT);
+        if (clipmap) clipmap->update(camera->position);
+		light->update(snail->renderPosition);
+
+        // the keys and heading the next steps steer by, with the presses no
+        // step has seen yet so a tap shorter than a step is not lost
+        unsigned int keys = pollInput();
+        frame++;
+        if (keys & ~heldKeys) {
+            latchedKeys |= keys & ~heldKeys;
+            latchedFrame = frame;
+        } else if (consumedFrame.load(memory_order_acquire) >= latchedFrame) {
+            latchedKeys = 0;
+        }
+        heldKeys = keys;
+        FrameInput& frameInput = inputs.writeSlot();
+        frameInput.input.keys = keys | latchedKeys;
+        frameInput.input.cameraAngle = camera->horizontalAngle;
+        frameInput.frame = frame;
+        inputs.publish();
 
         depth_pass(); 
 
         mat4 projectionMatrix = camera->projectionMatrix;
         mat4 viewMatrix = camera->viewMatrix;
-        lighting_pass(viewMatrix, projectionMatrix, snail->retractCurrent, currentTime);
+        lighting_pass(viewMatrix, projectionMatrix, snail->shown.retractCurrent, currentTime);
         //Render Skybox last
         drawSkybox(viewMatrix, projectionMatrix);
-        drawStaminaBar(snail->stamina,snail->staminaMax);
-        drawSpeedBar(length(vec3(snail->v.x,0, snail->v.z )), 200.0f);
-        t += dt;
+        drawStaminaBar(snail->shown.stamina, snail->shown.staminaMax);
+        drawSpeedBar(length(vec3(snail->shown.v.x, 0, snail->shown.v.z)), 200.0f);
         glfwSwapBuffers(window);
         glfwPollEvents();
 
     } while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
         glfwWindowShouldClose(window) == 0);
+
+    simulating = false;
+    simulationThread.join();
+    runRenderCommands();
+    delete recorder;
 }
 
 void initialize() {
@@ -1297,7 +1609,30 @@ void uploadTreeLight(const Light& light) {
         light.lightPosition_worldspace.y, light.lightPosition_worldspace.z);
 }
 
-int main(void) {
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc) worldSeed = (unsigned int)stoul(argv[++i]);
+        else if (arg == "--infinite") infiniteTerrain = true;
+        else if (arg == "--gpu-terrain") gpuTerrain = true;
+        else if (arg == "--physics-hz" && i + 1 < argc) physicsStep = 1.0f / stof(argv[++i]);
+        else if (arg == "--shells" && i + 1 < argc) shellCount = stoi(argv[++i]);
+        else if (arg == "--integrator" && i + 1 < argc) {
+            string name = argv[++i];
+            if (name == "euler") snailIntegrator = SEMI_IMPLICIT_EULER;
+            else if (name == "verlet") snailIntegrator = VELOCITY_VERLET;
+            else if (name == "rk45") snailIntegrator = DORMAND_PRINCE_45;
+            else snailIntegrator = RUNGE_KUTTA_4;
+        }
+        else if (arg == "--world" && i + 1 < argc) worldPath = argv[++i];
+        else if (arg == "--dem" && i + 1 < argc) demPath = argv[++i];
+        else if (arg == "--record" && i + 1 < argc) recordPath = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replayPath = argv[++i];
+        else if (arg == "--dem-size" && i + 2 < argc) {
+            demWidth = stoi(argv[++i]);
+            demHeight = stoi(argv[++i]);
+        }
+    }
     try {
         initialize();
         createContext();